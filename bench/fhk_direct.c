@@ -0,0 +1,369 @@
+/* fhk solver overhead: coroutine (fhk_continue) against direct callbacks (fhk_solve).
+ *
+ * usage: fhk_direct [-n iterations]
+ *
+ * solves small graphs modeled after tests/testgraph.lua test cases (plus one with many
+ * instances) from a fresh solver state each iteration, once by handling the yielded requests
+ * in a fhk_continue loop and once by handing the same handlers to fhk_solve. models are
+ * trivial, so the time is the search plus the cost of delivering requests. reports ns per
+ * solve, ns per request and the speedup of the direct interface. */
+
+#include "fhk/fhk.h"
+#include "mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define MAXV         16
+#define MAXM         256
+#define NBIG         1000
+#define ARENASIZE    (1 << 22)
+
+// interval subset [first, first+n), see fhk.h
+#ifdef FHK_WIDEINST
+#define IVAL(first,n) ((fhk_subset)((1ull << 63) | (((uint64_t)(1-(n)) & 0x7fffffff) << 32) | (first)))
+#else
+#define IVAL(first,n) ((fhk_subset)(0xffff000000000000ull | (((uint64_t)(1-(n)) & 0xffff) << 16) | (first)))
+#endif
+
+typedef void (*bench_mod)(fhk_modcall *mc);
+
+struct bench {
+	const char *name;
+	fhk_graph *G;
+	fhk_grp ng;
+	fhk_inst shape[4];
+	fhk_idx root;
+	fhk_inst nroot;
+	double *given[MAXV];   // by var index, NULL for computed
+	bench_mod mods[MAXM];  // by -model index
+	uint64_t nreq;
+};
+
+static double out[NBIG], ref[NBIG], one[NBIG], pos[1] = {1}, neg[1] = {-1};
+
+/* ---- models ---------------------------------------- */
+
+static void m_id(fhk_modcall *mc){
+	*(double *) mc->edges[1].p = *(double *) mc->edges[0].p;
+}
+
+static void m_sum(fhk_modcall *mc){
+	double s = 0;
+	for(size_t i=0;i<mc->edges[0].n;i++)
+		s += ((double *) mc->edges[0].p)[i];
+	*(double *) mc->edges[1].p = s;
+}
+
+static void m_one(fhk_modcall *mc){
+	*(double *) mc->edges[mc->np].p = 1;
+}
+
+static void m_two(fhk_modcall *mc){
+	*(double *) mc->edges[mc->np].p = 2;
+}
+
+static void m_z(fhk_modcall *mc){
+	*(double *) mc->edges[3].p = 100 * *(double *) mc->edges[0].p
+		+ 10 * *(double *) mc->edges[1].p + *(double *) mc->edges[2].p;
+}
+
+// -> x%d: returns its own number, stored in the modcall by the graph setup.
+static double mval[MAXM];
+
+static void m_val(fhk_modcall *mc){
+	*(double *) mc->edges[mc->np].p = mval[-mc->mref.idx];
+}
+
+/* ---- request handlers ---------------------------------------- */
+
+static int32_t h_shape(void *udata, fhk_solver *S, fhk_grp group){
+	struct bench *B = udata;
+	B->nreq++;
+	fhkS_setshape(S, group, B->shape[group]);
+	return 0;
+}
+
+static int32_t h_vref(void *udata, fhk_solver *S, fhk_idx xi, fhk_inst inst, fhk_inst num){
+	struct bench *B = udata;
+	B->nreq++;
+	if(!B->given[xi])
+		return 1;
+	fhkS_setvaluei(S, xi, inst, num, B->given[xi] + inst);
+	return 0;
+}
+
+static int32_t h_mapcall(void *udata, fhk_solver *S, fhk_extmap map, fhk_inst inst){
+	(void)S; (void)map; (void)inst;
+	((struct bench *) udata)->nreq++;
+	return 1;
+}
+
+static int32_t h_modcall(void *udata, fhk_solver *S, fhk_modcall *mc){
+	(void)S;
+	struct bench *B = udata;
+	B->nreq++;
+	B->mods[-mc->mref.idx](mc);
+	return 0;
+}
+
+static const fhk_cb cb = {
+	.shape = h_shape,
+	.vref = h_vref,
+	.mapcall = h_mapcall,
+	.modcall = h_modcall
+};
+
+static fhk_status drive_co(struct bench *B, fhk_solver *S){
+	for(;;){
+		fhk_status status = fhk_continue(S);
+		fhk_sarg arg = FHK_ARG(status);
+		int32_t stop;
+
+		switch(FHK_CODE(status)){
+			case FHK_OK:
+			case FHK_ERROR:
+				return status;
+			case FHKS_SHAPE: stop = h_shape(B, S, arg.s_group); break;
+			case FHKS_VREF:
+				stop = h_vref(B, S, FHK_SVREF(arg).idx, FHK_SVREF(arg).inst, FHK_SVREF(arg).num);
+				break;
+			case FHKS_MAPCALL:
+				stop = h_mapcall(B, S, FHK_SMAPCALL(arg).idx, FHK_SMAPCALL(arg).inst);
+				break;
+			case FHKS_MODCALL: stop = h_modcall(B, S, arg.s_modcall); break;
+			default: stop = 1;
+		}
+
+		if(stop)
+			return status;
+	}
+}
+
+/* ---- graphs ---------------------------------------- */
+
+static fhk_obj model(fhk_def *D, fhk_grp group, float k, float c){
+	return fhk_def_add_model(D, group, k, c, k, 0);
+}
+
+static void finish(struct bench *B, fhk_def *D, fhk_obj *ms, bench_mod *fs, double *vals, int nm){
+	B->G = fhk_build_graph(D, malloc(fhk_graph_size(D)));
+	for(int i=0;i<nm;i++){
+		fhk_idx mi = fhk_graph_idx(D, ms[i]);
+		B->mods[-mi] = fs[i];
+		if(vals)
+			mval[-mi] = vals[i];
+	}
+}
+
+static void given(struct bench *B, fhk_def *D, fhk_obj x, double *v){
+	B->given[fhk_graph_idx(D, x)] = v;
+}
+
+// m { "a -> x", id }
+static void g_single(struct bench *B){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj m = model(D, 0, 1, 1);
+	fhk_def_add_param(D, m, a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m, x, FHKMAP_IDENT);
+	finish(B, D, &m, (bench_mod[]){m_id}, NULL, 1);
+	given(B, D, a, one);
+	B->name = "single"; B->ng = 1; B->shape[0] = 1;
+	B->root = fhk_graph_idx(D, x); B->nroot = 1;
+	fhk_destroy_def(D);
+}
+
+// m { "a -> x", id }, m { "x -> y", id } over `n` instances
+static void g_chain(struct bench *B, fhk_inst n, const char *name){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj y = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj m[2] = { model(D, 0, 1, 1), model(D, 0, 1, 1) };
+	fhk_def_add_param(D, m[0], a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_param(D, m[1], x, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[1], y, FHKMAP_IDENT);
+	finish(B, D, m, (bench_mod[]){m_id, m_id}, NULL, 2);
+	given(B, D, a, one);
+	B->name = name; B->ng = 1; B->shape[0] = n;
+	B->root = fhk_graph_idx(D, y); B->nroot = n;
+	fhk_destroy_def(D);
+}
+
+// m { "-> x [a>=0+10]", cf {1} }, m { "-> x [a<=0+10]", cf {2} }
+static void g_given_check(struct bench *B, double *av, const char *name){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj ge = fhk_def_add_shadow(D, a, FHKC_GEF64, (fhk_shvalue){.f64=0});
+	fhk_obj le = fhk_def_add_shadow(D, a, FHKC_LEF64, (fhk_shvalue){.f64=0});
+	fhk_obj m[2] = { model(D, 0, 1, 1), model(D, 0, 1, 1) };
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_check(D, m[0], ge, FHKMAP_IDENT, 10);
+	fhk_def_add_return(D, m[1], x, FHKMAP_IDENT);
+	fhk_def_add_check(D, m[1], le, FHKMAP_IDENT, 10);
+	finish(B, D, m, (bench_mod[]){m_one, m_two}, NULL, 2);
+	given(B, D, a, av);
+	B->name = name; B->ng = 1; B->shape[0] = 1;
+	B->root = fhk_graph_idx(D, x); B->nroot = 1;
+	fhk_destroy_def(D);
+}
+
+// m { "default# a -> x", id }, m { "g# x:@space -> g#y", dot }
+static void g_set_chain(struct bench *B){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj y = fhk_def_add_var(D, 1, 8, 0);
+	fhk_obj m[2] = { model(D, 0, 1, 1), model(D, 1, 1, 1) };
+	fhk_def_add_param(D, m[0], a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_param(D, m[1], x, FHKMAP_SPACE);
+	fhk_def_add_return(D, m[1], y, FHKMAP_IDENT);
+	finish(B, D, m, (bench_mod[]){m_id, m_sum}, NULL, 2);
+	given(B, D, a, one);
+	B->name = "set_chain"; B->ng = 2; B->shape[0] = 3; B->shape[1] = 1;
+	B->root = fhk_graph_idx(D, y); B->nroot = 1;
+	fhk_destroy_def(D);
+}
+
+// test_solver_stress_candidates
+static void g_stress_candidates(struct bench *B){
+	fhk_def *D = fhk_create_def();
+	fhk_obj w[10], x[10], y[10], ms[MAXM];
+	bench_mod fs[MAXM];
+	double vals[MAXM];
+	int nm = 0;
+
+	fhk_obj z = fhk_def_add_var(D, 0, 8, 0);
+	for(int i=0;i<10;i++){
+		w[i] = fhk_def_add_var(D, 0, 8, 0);
+		x[i] = fhk_def_add_var(D, 0, 8, 0);
+		y[i] = fhk_def_add_var(D, 0, 8, 0);
+	}
+
+	for(int i=1;i<=10;i++){
+		float kw = (i-1)/10.0, kx = i*i, ky = 100-10*i;
+		fhk_obj mw = model(D, 0, kw, 1);
+		fhk_obj mx = model(D, 0, kx, 1);
+		fhk_obj my = model(D, 0, ky, 1);
+		fhk_def_add_return(D, mw, w[i-1], FHKMAP_IDENT);
+		fhk_def_add_return(D, mx, x[i-1], FHKMAP_IDENT);
+		fhk_def_add_return(D, my, y[i-1], FHKMAP_IDENT);
+		ms[nm] = mw; fs[nm] = m_val; vals[nm++] = i;
+		ms[nm] = mx; fs[nm] = m_val; vals[nm++] = i;
+		ms[nm] = my; fs[nm] = m_val; vals[nm++] = i;
+	}
+
+	for(int i=0;i<10;i++){
+		for(int j=0;j<10;j++){
+			fhk_obj m = model(D, 0, 0, 1);
+			fhk_def_add_param(D, m, x[i], FHKMAP_IDENT);
+			fhk_def_add_param(D, m, y[i], FHKMAP_IDENT);
+			fhk_def_add_param(D, m, w[j], FHKMAP_IDENT);
+			fhk_def_add_return(D, m, z, FHKMAP_IDENT);
+			ms[nm] = m; fs[nm] = m_z; vals[nm++] = 0;
+		}
+	}
+
+	finish(B, D, ms, fs, vals, nm);
+	B->name = "stress_candidates"; B->ng = 1; B->shape[0] = 1;
+	B->root = fhk_graph_idx(D, z); B->nroot = 1;
+	fhk_destroy_def(D);
+}
+
+/* ---- timing ---------------------------------------- */
+
+static double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// returns seconds for `iter` solves, in coroutine or direct mode.
+static double run(struct bench *B, arena *ar, fhk_solver *S, int direct, int iter){
+	B->nreq = 0;
+	double start = now();
+
+	for(int i=0;i<iter;i++){
+		arena_reset(ar);
+		fhk_reset_solver(S, ar);
+		fhkS_setroot(S, B->root, IVAL(0, B->nroot), out);
+		fhk_status status = direct ? fhk_solve(S, &cb, B) : drive_co(B, S);
+		if(status != FHK_OK){
+			fprintf(stderr, "%s: solver failed (status 0x%lx)\n", B->name, (unsigned long) status);
+			exit(1);
+		}
+	}
+
+	return now() - start;
+}
+
+static void bench(struct bench *B, int iter){
+	// the solver lives in `sa`, each solve resets `ar`
+	arena *sa = arena_create(ARENASIZE);
+	arena *ar = arena_create(ARENASIZE);
+	fhk_solver *S = fhk_create_solver(B->G, sa);
+	int n = B->nroot >= NBIG ? iter/NBIG+1 : iter;
+
+	// warmup
+	run(B, ar, S, 0, n/10+1);
+	run(B, ar, S, 1, n/10+1);
+
+	double tco = run(B, ar, S, 0, n);
+	uint64_t nreq = B->nreq;
+	memcpy(ref, out, B->nroot*sizeof(*out));
+	double tdi = run(B, ar, S, 1, n);
+
+	if(nreq != B->nreq || memcmp(ref, out, B->nroot*sizeof(*out))){
+		fprintf(stderr, "%s: direct solve differs (%lu vs %lu requests)\n", B->name,
+				(unsigned long) nreq, (unsigned long) B->nreq);
+		exit(1);
+	}
+
+	printf("%-20s %8.1f %8.1f %8.1f %8.1f %8.2fx\n", B->name,
+			1e9*tco/n, 1e9*tdi/n, 1e9*tco/nreq, 1e9*tdi/nreq, tco/tdi);
+
+	arena_destroy(ar);
+	arena_destroy(sa);
+}
+
+int main(int argc, char **argv){
+	int iter = 1000000;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:")) != -1){
+		switch(opt){
+			case 'n': iter = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	for(int i=0;i<NBIG;i++)
+		one[i] = 1;
+
+	static struct bench B[7];
+	g_single(&B[0]);
+	g_chain(&B[1], 1, "chain");
+	g_given_check(&B[2], pos, "given_check(a=1)");
+	g_given_check(&B[3], neg, "given_check(a=-1)");
+	g_set_chain(&B[4]);
+	g_stress_candidates(&B[5]);
+	g_chain(&B[6], NBIG, "chain(n=1000)");
+
+	printf("%-20s %8s %8s %8s %8s %9s\n", "graph", "co", "direct", "co/req", "dir/req", "speedup");
+	printf("%-20s %8s %8s %8s %8s %9s\n", "", "ns", "ns", "ns", "ns", "");
+	for(size_t i=0;i<sizeof(B)/sizeof(*B);i++)
+		bench(&B[i], iter);
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+/* fhk guard scan: S_checkscan (a word at a time with sw_guardw) against a scalar loop.
+ *
+ * usage: fhk_guard [-n iterations] [-N instances]
+ *
+ * evaluates each guard type over `-N` random values, starting from an instance that isn't
+ * word-aligned so the scalar head and tail are included. the scalar reference evaluates and
+ * stores one instance at a time, like S_checkscan did before the word loop. results are
+ * checked against the reference. reports ns per instance and the speedup.
+ *
+ * S_checkscan is static, so this includes the solver source. build with the same flags as
+ * the solver (CCARCH=-march=native to get the AVX paths). */
+
+#include "fhk/solve.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define FIRST        3            /* first instance, not word-aligned */
+
+static const char *names[] = { "f32>=", "f32<=", "f64>=", "f64<=", "u8&m64" };
+
+static double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static void scalar(bitmap *bm, struct fhk_shadow *w, void *vp, xinst inst, xinst end){
+	for(;inst<end;inst++){
+		uint64_t ok;
+		switch(w->guard){
+			case FHKC_GEF32: ok = ((float *) vp)[inst] >= w->arg.f32; break;
+			case FHKC_LEF32: ok = ((float *) vp)[inst] <= w->arg.f32; break;
+			case FHKC_GEF64: ok = ((double *) vp)[inst] >= w->arg.f64; break;
+			case FHKC_LEF64: ok = ((double *) vp)[inst] <= w->arg.f64; break;
+			default: ok = !!((1ULL << ((uint8_t *) vp)[inst]) & w->arg.u64); break;
+		}
+		bm[SW_BMIDX(inst)] |= (ok | SW_EVAL) << SW_BMOFF(inst);
+	}
+}
+
+int main(int argc, char **argv){
+	int iter = 500;
+	int n = 60000;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:N:")) != -1){
+		switch(opt){
+			case 'n': iter = atoi(optarg); break;
+			case 'N': n = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-N instances]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if(n <= FIRST || (uint64_t)n >= FHK_NINST){
+		fprintf(stderr, "instances must be in (%d, %lu)\n", FIRST, (unsigned long) FHK_NINST);
+		return 1;
+	}
+
+	float *f32 = malloc(n * sizeof(*f32));
+	double *f64 = malloc(n * sizeof(*f64));
+	uint8_t *u8 = malloc(n);
+	size_t nbm = SW_BMIDX(n)+1;
+	bitmap *bm = malloc(nbm * sizeof(*bm));
+	bitmap *ref = malloc(nbm * sizeof(*ref));
+
+	for(int i=0;i<n;i++){
+		f32[i] = rand() % 100;
+		f64[i] = rand() % 100;
+		u8[i] = rand() % 64;
+	}
+
+	// the solver only reads the value pointer of the guarded variable
+	static char sbuf[sizeof(struct fhk_solver) + sizeof(void *)];
+	struct fhk_solver *S = (struct fhk_solver *) sbuf;
+	void *value[1];
+	S->s_value = value;
+
+	void *vps[] = { f32, f32, f64, f64, u8 };
+
+	printf("%-8s %10s %10s %9s\n", "guard", "scalar", "checkscan", "speedup");
+	printf("%-8s %10s %10s %9s\n", "", "ns/inst", "ns/inst", "");
+
+	for(int g=FHKC_GEF32;g<=FHKC_U8_MASK64;g++){
+		struct fhk_shadow w = { .xi = 0, .guard = g };
+		switch(g){
+			case FHKC_GEF32: case FHKC_LEF32: w.arg.f32 = 50; break;
+			case FHKC_GEF64: case FHKC_LEF64: w.arg.f64 = 50; break;
+			default: w.arg.u64 = 0x9abcdef012345678ull;
+		}
+		value[0] = vps[g];
+
+		double start = now();
+		for(int i=0;i<iter;i++){
+			memset(ref, 0, nbm * sizeof(*ref));
+			scalar(ref, &w, vps[g], FIRST, n);
+			__asm__ volatile("" :: "r"(ref) : "memory");
+		}
+		double ts = now() - start;
+
+		start = now();
+		for(int i=0;i<iter;i++){
+			memset(bm, 0, nbm * sizeof(*bm));
+			S_checkscan(S, bm, &w, FIRST, n);
+			__asm__ volatile("" :: "r"(bm) : "memory");
+		}
+		double tc = now() - start;
+
+		if(memcmp(bm, ref, nbm * sizeof(*bm))){
+			fprintf(stderr, "%s: S_checkscan differs from the scalar loop\n", names[g]);
+			return 1;
+		}
+
+		printf("%-8s %10.3f %10.3f %8.2fx\n", names[g], 1e9*ts/iter/n, 1e9*tc/iter/n, ts/tc);
+	}
+
+	return 0;
+}
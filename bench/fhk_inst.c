@@ -0,0 +1,244 @@
+/* fhk instance width: the same solves with 16-bit and 32-bit (FHK_WIDEINST) instances.
+ *
+ * usage: fhk_inst16 [-n instances]
+ *        fhk_inst32 [-n instances] [-N group size]
+ *
+ * both binaries are built from this file. each graph is solved over a group of 1000
+ * instances from a fresh solver state, repeating until `-n` instances are solved in total:
+ *
+ *   chain      a -> x -> y, root y over the whole group (interval iteration, no maps)
+ *   space      x:@space -> s, a single root that gathers the whole group
+ *   complex    x:usermap -> s, the map selects runs of 4 out of every 8 instances
+ *              (complex subset iteration)
+ *
+ * compare the 16-bit numbers against a build before FHK_WIDEINST to check the default build
+ * is unaffected, and against fhk_inst32 for the cost of wide instances. the 32-bit build
+ * also runs every graph over a group of `-N` (default 200000) instances, which doesn't fit
+ * in 16 bits. */
+
+#include "fhk/fhk.h"
+#include "mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#define NSMALL       1000
+#define RUN          4            /* complex map: run length */
+#define STRIDE       8            /* complex map: run stride */
+#define ARENASIZE    (1 << 24)
+
+// interval subset [first, first+n) and complex subset intervals, see fhk.h
+#ifdef FHK_WIDEINST
+#define IVAL(first,n) ((fhk_subset)((1ull << 63) | (((uint64_t)(1-(n)) & 0x7fffffff) << 32) | (first)))
+#define CIVAL(first,n) ((uint64_t)(first) | ((uint64_t)(1-(n)) << 32))
+typedef uint64_t civ;
+#else
+#define IVAL(first,n) ((fhk_subset)(0xffff000000000000ull | (((uint64_t)(1-(n)) & 0xffff) << 16) | (first)))
+#define CIVAL(first,n) ((uint32_t)(first) | (((uint32_t)(1-(n)) & 0xffff) << 16))
+typedef uint32_t civ;
+#endif
+
+struct bench {
+	const char *name;
+	fhk_graph *G;
+	fhk_inst n;            // group size
+	fhk_idx root;
+	fhk_inst nroot;        // root instances (in the root's group)
+	double *a;             // given a
+	double *out;
+	civ *ivals;            // complex map intervals
+	uint32_t nival;
+	double expect;         // expected out[nroot-1]
+};
+
+/* ---- request handlers ---------------------------------------- */
+
+static int32_t h_shape(void *udata, fhk_solver *S, fhk_grp group){
+	struct bench *B = udata;
+	fhkS_setshape(S, group, group == 0 ? B->n : 1);
+	return 0;
+}
+
+static int32_t h_vref(void *udata, fhk_solver *S, fhk_idx xi, fhk_inst inst, fhk_inst num){
+	struct bench *B = udata;
+	fhkS_setvaluei(S, xi, inst, num, B->a + inst);
+	return 0;
+}
+
+static int32_t h_mapcall(void *udata, fhk_solver *S, fhk_extmap map, fhk_inst inst){
+	struct bench *B = udata;
+	fhkS_setmap(S, map, inst, ((fhk_subset)(uintptr_t)B->ivals << 16) | (B->nival-1));
+	return 0;
+}
+
+static int32_t h_modcall(void *udata, fhk_solver *S, fhk_modcall *mc){
+	(void)udata; (void)S;
+	double s = 0;
+	for(size_t i=0;i<mc->edges[0].n;i++)
+		s += ((double *) mc->edges[0].p)[i];
+	*(double *) mc->edges[mc->np].p = s;
+	return 0;
+}
+
+static const fhk_cb cb = {
+	.shape = h_shape,
+	.vref = h_vref,
+	.mapcall = h_mapcall,
+	.modcall = h_modcall
+};
+
+/* ---- graphs ---------------------------------------- */
+
+static fhk_obj model(fhk_def *D, fhk_grp group){
+	return fhk_def_add_model(D, group, 1, 1, 1, 0);
+}
+
+static void setup(struct bench *B, fhk_inst n){
+	B->n = n;
+	B->a = malloc(n * sizeof(*B->a));
+	B->out = malloc(n * sizeof(*B->out));
+	for(fhk_inst i=0;i<n;i++)
+		B->a[i] = i;
+}
+
+static void g_chain(struct bench *B, fhk_inst n){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj y = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj m[2] = { model(D, 0), model(D, 0) };
+	fhk_def_add_param(D, m[0], a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_param(D, m[1], x, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[1], y, FHKMAP_IDENT);
+	B->G = fhk_build_graph(D, malloc(fhk_graph_size(D)));
+	setup(B, n);
+	B->name = "chain";
+	B->root = fhk_graph_idx(D, y);
+	B->nroot = n;
+	B->expect = n-1;
+	fhk_destroy_def(D);
+}
+
+static void g_gather(struct bench *B, fhk_inst n, int complex){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj s = fhk_def_add_var(D, 1, 8, 0);
+	fhk_obj m[2] = { model(D, 0), model(D, 1) };
+	fhk_def_add_param(D, m[0], a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_param(D, m[1], x, complex ? FHKMAP_USER(0, 1) : FHKMAP_SPACE);
+	fhk_def_add_return(D, m[1], s, FHKMAP_IDENT);
+	B->G = fhk_build_graph(D, malloc(fhk_graph_size(D)));
+	setup(B, n);
+	B->root = fhk_graph_idx(D, s);
+	B->nroot = 1;
+
+	if(complex){
+		B->name = "complex";
+		B->nival = n / STRIDE;
+		B->ivals = malloc(B->nival * sizeof(*B->ivals));
+		B->expect = 0;
+		for(uint32_t i=0;i<B->nival;i++){
+			fhk_inst first = i*STRIDE;
+			B->ivals[i] = CIVAL(first, RUN);
+			B->expect += RUN*(double)first + RUN*(RUN-1)/2;
+		}
+	}else{
+		B->name = "space";
+		B->expect = (double)n*(n-1)/2;
+	}
+
+	fhk_destroy_def(D);
+}
+
+/* ---- timing ---------------------------------------- */
+
+static double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static double run(struct bench *B, arena *ar, fhk_solver *S, long iter){
+	double start = now();
+
+	for(long i=0;i<iter;i++){
+		arena_reset(ar);
+		fhk_reset_solver(S, ar);
+		fhkS_setroot(S, B->root, IVAL(0, B->nroot), B->out);
+		fhk_status status = fhk_solve(S, &cb, B);
+		if(status != FHK_OK){
+			fprintf(stderr, "%s: solver failed (status 0x%lx)\n", B->name, (unsigned long) status);
+			exit(1);
+		}
+	}
+
+	return now() - start;
+}
+
+static void bench(struct bench *B, long total){
+	// the solver lives in `sa`, each solve resets `ar`
+	arena *sa = arena_create(ARENASIZE);
+	arena *ar = arena_create(ARENASIZE);
+	fhk_solver *S = fhk_create_solver(B->G, sa);
+	long iter = total/B->n + 1;
+
+	run(B, ar, S, iter/10+1);
+	double t = run(B, ar, S, iter);
+
+	if(B->out[B->nroot-1] != B->expect){
+		fprintf(stderr, "%s(n=%lu): wrong result %g, expected %g\n", B->name,
+				(unsigned long) B->n, B->out[B->nroot-1], B->expect);
+		exit(1);
+	}
+
+	printf("%-10s %10lu %12.1f %10.2f\n", B->name, (unsigned long) B->n, 1e9*t/iter,
+			1e9*t/iter/B->n);
+
+	arena_destroy(ar);
+	arena_destroy(sa);
+}
+
+int main(int argc, char **argv){
+	long total = 20000000;
+	unsigned long nbig = 200000;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:N:")) != -1){
+		switch(opt){
+			case 'n': total = atol(optarg); break;
+			case 'N': nbig = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-n instances] [-N group size]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	printf("%d-bit instances\n", (int) (8*sizeof(fhk_inst)));
+	printf("%-10s %10s %12s %10s\n", "graph", "n", "ns/solve", "ns/inst");
+
+	struct bench B[3] = {0};
+	g_chain(&B[0], NSMALL);
+	g_gather(&B[1], NSMALL, 0);
+	g_gather(&B[2], NSMALL, 1);
+	for(int i=0;i<3;i++)
+		bench(&B[i], total);
+
+#ifdef FHK_WIDEINST
+	struct bench W[3] = {0};
+	g_chain(&W[0], nbig);
+	g_gather(&W[1], nbig, 0);
+	g_gather(&W[2], nbig, 1);
+	for(int i=0;i<3;i++)
+		bench(&W[i], total);
+#else
+	(void) nbig;
+#endif
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/* fhk parallel solver: fhkP_solve against a single solver on a multi-instance graph.
+ *
+ * usage: fhk_par [-n iterations] [-N instances] [-t max threads] [-w model work]
+ *
+ * the graph is a -> x -> y over a group of `-N` instances, root y over the whole group.
+ * models iterate a square root `-w` times, so their cost dominates and the split over threads
+ * is what's measured. each iteration solves from a fresh solver state, first with one solver
+ * (fhk_solve) and then with fhkP_solve over 1, 2, 4, ... threads up to `-t`. every parallel
+ * result is checked against the serial one. reports ms per solve and the speedup.
+ *
+ * fhkP_solve drives its solvers with fhk_continue, so par(1) against serial is the cost of
+ * the coroutine interface plus the thread setup (see fhk_direct). */
+
+#include "fhk/fhk.h"
+#include "mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#define ARENASIZE    (1 << 24)
+
+// interval subset [first, first+n), see fhk.h
+#ifdef FHK_WIDEINST
+#define IVAL(first,n) ((fhk_subset)((1ull << 63) | (((uint64_t)(1-(n)) & 0x7fffffff) << 32) | (first)))
+#else
+#define IVAL(first,n) ((fhk_subset)(0xffff000000000000ull | (((uint64_t)(1-(n)) & 0xffff) << 16) | (first)))
+#endif
+
+struct bench {
+	fhk_graph *G;
+	fhk_inst n;
+	fhk_idx root;
+	double *a;
+	double *out;
+	double *ref;
+	int work;
+};
+
+/* ---- request handlers ---------------------------------------- */
+
+static int32_t h_shape(void *udata, fhk_solver *S, fhk_grp group){
+	fhkS_setshape(S, group, ((struct bench *) udata)->n);
+	return 0;
+}
+
+static int32_t h_vref(void *udata, fhk_solver *S, fhk_idx xi, fhk_inst inst, fhk_inst num){
+	fhkS_setvaluei(S, xi, inst, num, ((struct bench *) udata)->a + inst);
+	return 0;
+}
+
+static int32_t h_mapcall(void *udata, fhk_solver *S, fhk_extmap map, fhk_inst inst){
+	(void)udata; (void)S; (void)map; (void)inst;
+	return 1;
+}
+
+static int32_t h_modcall(void *udata, fhk_solver *S, fhk_modcall *mc){
+	(void)S;
+	double x = *(double *) mc->edges[0].p;
+	for(int i=0;i<((struct bench *) udata)->work;i++)
+		x = sqrt(x + 1);
+	*(double *) mc->edges[1].p = x;
+	return 0;
+}
+
+static const fhk_cb cb = {
+	.shape = h_shape,
+	.vref = h_vref,
+	.mapcall = h_mapcall,
+	.modcall = h_modcall
+};
+
+// fhkP_solve driver, called concurrently. the handlers only read the bench.
+static int32_t h_par(void *udata, fhk_solver *S, fhk_status status){
+	fhk_sarg arg = FHK_ARG(status);
+
+	switch(FHK_CODE(status)){
+		case FHKS_SHAPE: return h_shape(udata, S, arg.s_group);
+		case FHKS_VREF:
+			return h_vref(udata, S, FHK_SVREF(arg).idx, FHK_SVREF(arg).inst, FHK_SVREF(arg).num);
+		case FHKS_MAPCALL:
+			return h_mapcall(udata, S, FHK_SMAPCALL(arg).idx, FHK_SMAPCALL(arg).inst);
+		case FHKS_MODCALL: return h_modcall(udata, S, arg.s_modcall);
+		default: return 1;
+	}
+}
+
+/* ---- graph ---------------------------------------- */
+
+static void g_chain(struct bench *B, fhk_inst n){
+	fhk_def *D = fhk_create_def();
+	fhk_obj a = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj x = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj y = fhk_def_add_var(D, 0, 8, 0);
+	fhk_obj m[2] = { fhk_def_add_model(D, 0, 1, 1, 1, 0), fhk_def_add_model(D, 0, 1, 1, 1, 0) };
+	fhk_def_add_param(D, m[0], a, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[0], x, FHKMAP_IDENT);
+	fhk_def_add_param(D, m[1], x, FHKMAP_IDENT);
+	fhk_def_add_return(D, m[1], y, FHKMAP_IDENT);
+	B->G = fhk_build_graph(D, malloc(fhk_graph_size(D)));
+	B->root = fhk_graph_idx(D, y);
+	B->n = n;
+	B->a = malloc(n * sizeof(*B->a));
+	B->out = malloc(n * sizeof(*B->out));
+	B->ref = malloc(n * sizeof(*B->ref));
+	for(fhk_inst i=0;i<n;i++)
+		B->a[i] = i;
+	fhk_destroy_def(D);
+}
+
+/* ---- timing ---------------------------------------- */
+
+static double now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static double run_serial(struct bench *B, int iter){
+	arena *sa = arena_create(ARENASIZE);
+	arena *ar = arena_create(ARENASIZE);
+	fhk_solver *S = fhk_create_solver(B->G, sa);
+	double start = now();
+
+	for(int i=0;i<iter;i++){
+		arena_reset(ar);
+		fhk_reset_solver(S, ar);
+		fhkS_setroot(S, B->root, IVAL(0, B->n), B->ref);
+		fhk_status status = fhk_solve(S, &cb, B);
+		if(status != FHK_OK){
+			fprintf(stderr, "serial: solver failed (status 0x%lx)\n", (unsigned long) status);
+			exit(1);
+		}
+	}
+
+	double t = now() - start;
+	arena_destroy(ar);
+	arena_destroy(sa);
+	return t;
+}
+
+static double run_par(struct bench *B, uint32_t nt, int iter){
+	fhk_par *P = fhk_create_par(B->G, nt);
+	if(!P){
+		fprintf(stderr, "par(%u): fhk_create_par failed\n", nt);
+		exit(1);
+	}
+
+	double start = now();
+
+	for(int i=0;i<iter;i++){
+		fhkP_clear(P);
+		fhkP_setshape(P, 0, B->n);
+		fhkP_setroot(P, B->root, IVAL(0, B->n), B->out);
+		fhk_status status = fhkP_solve(P, h_par, B);
+		if(status != FHK_OK){
+			fprintf(stderr, "par(%u): solver failed (status 0x%lx)\n", nt, (unsigned long) status);
+			exit(1);
+		}
+	}
+
+	double t = now() - start;
+	fhk_destroy_par(P);
+
+	if(memcmp(B->out, B->ref, B->n*sizeof(*B->out))){
+		fprintf(stderr, "par(%u): result differs from serial solve\n", nt);
+		exit(1);
+	}
+
+	return t;
+}
+
+int main(int argc, char **argv){
+	int iter = 100;
+	int n = 50000;
+	int maxt = 8;
+	int opt;
+	struct bench B = { .work = 20 };
+
+	while((opt = getopt(argc, argv, "n:N:t:w:")) != -1){
+		switch(opt){
+			case 'n': iter = atoi(optarg); break;
+			case 'N': n = atoi(optarg); break;
+			case 't': maxt = atoi(optarg); break;
+			case 'w': B.work = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-N instances] [-t max threads] [-w model work]\n",
+						argv[0]);
+				return 1;
+		}
+	}
+
+	if(n < 1 || (uint64_t)n >= FHK_NINST){
+		fprintf(stderr, "instances must be in [1, %lu)\n", (unsigned long) FHK_NINST);
+		return 1;
+	}
+
+	g_chain(&B, n);
+
+	// warmup
+	run_serial(&B, iter/10+1);
+
+	double ts = run_serial(&B, iter);
+	printf("%-10s %10s %9s\n", "solver", "ms/solve", "speedup");
+	printf("%-10s %10.3f %9s\n", "serial", 1e3*ts/iter, "");
+
+	for(uint32_t nt=1;nt<=(uint32_t)maxt;nt*=2){
+		char name[16];
+		double tp = run_par(&B, nt, iter);
+		snprintf(name, sizeof(name), "par(%u)", nt);
+		printf("%-10s %10.3f %8.2fx\n", name, 1e3*tp/iter, ts/tp);
+	}
+
+	return 0;
+}
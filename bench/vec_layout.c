@@ -0,0 +1,151 @@
+/* SoA vs AoSoA band layout on a multi-band growth kernel.
+ *
+ * usage: vec_layout [rows] [rounds]
+ *
+ * the kernel reads 5 bands and writes 3 per tree, which is about what a typical diameter/height
+ * growth step does. it's run in two access patterns:
+ *   seq   all rows in order (streaming, SoA should be fine here)
+ *   idx   rows in random order (eg. trees visited through a plot index). each tree touches
+ *         one tile instead of one line per band, which is what interleaving is supposed to
+ *         win. on a 1M row heap it doesn't reliably: the tile version was 8-20% slower in most
+ *         runs and only faster in some. measure before switching a vec. */
+
+#include "sim.h"
+#include "vec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+enum { B_D, B_H, B_AGE, B_F, B_SPE, B_BA, NBANDS };
+
+static uint16_t strides[NBANDS] = { 8, 8, 8, 8, 1, 8 };
+static uint16_t tiled[NBANDS] = { B_D, B_H, B_AGE, B_F, B_SPE, B_BA };
+
+static inline void grow(double *d, double *h, double *age, double *f, uint8_t *spe, double *ba){
+	double sk = 1 + 0.05*(*spe);
+	*d += sk * (0.3 - 0.002*(*age) + 0.01*(*h)/(*d));
+	*h += 0.01 * (30 - *h);
+	*ba = (*f) * (M_PI/4) * (*d) * (*d);
+	*age += 5;
+}
+
+#define ROW(info, v, b, i) ((void *) VEC_ROW((info), (v)->bands[(b)], (b), (i)))
+
+static void kernel_seq_soa(struct vec *v){
+	double *d = v->bands[B_D], *h = v->bands[B_H], *age = v->bands[B_AGE], *f = v->bands[B_F],
+		   *ba = v->bands[B_BA];
+	uint8_t *spe = v->bands[B_SPE];
+	for(uint32_t i=0;i<v->n_used;i++)
+		grow(&d[i], &h[i], &age[i], &f[i], &spe[i], &ba[i]);
+}
+
+static void kernel_seq_tiled(struct vec *v){
+	const struct vec_info *info = v->info;
+	uint32_t tile = info->tile;
+	for(uint32_t t=0;t<v->n_used;t+=tile){
+		size_t o = (t/tile) * info->tile_size;
+		double *d = v->bands[B_D]+o, *h = v->bands[B_H]+o, *age = v->bands[B_AGE]+o,
+			   *f = v->bands[B_F]+o, *ba = v->bands[B_BA]+o;
+		uint8_t *spe = v->bands[B_SPE]+o;
+		uint32_t n = v->n_used-t < tile ? v->n_used-t : tile;
+		for(uint32_t i=0;i<n;i++)
+			grow(&d[i], &h[i], &age[i], &f[i], &spe[i], &ba[i]);
+	}
+}
+
+static void kernel_idx(struct vec *v, uint32_t *idx){
+	const struct vec_info *info = v->info;
+	for(uint32_t j=0;j<v->n_used;j++){
+		uint32_t i = idx[j];
+		grow(ROW(info, v, B_D, i), ROW(info, v, B_H, i), ROW(info, v, B_AGE, i),
+				ROW(info, v, B_F, i), ROW(info, v, B_SPE, i), ROW(info, v, B_BA, i));
+	}
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static struct vec *fill(sim *sim, struct vec_info *info, uint32_t n){
+	struct vec *v = simL_vec_create(sim, info, SIM_VSTACK);
+	simF_vec_alloc(sim, v, n);
+	for(uint16_t b=0;b<NBANDS;b++)
+		v->bands[b] = simF_vec_create_band(sim, v, b);
+
+	for(uint32_t i=0;i<n;i++){
+		*(double *) ROW(info, v, B_D, i) = 10 + (i % 30);
+		*(double *) ROW(info, v, B_H, i) = 8 + (i % 20);
+		*(double *) ROW(info, v, B_AGE, i) = 20 + (i % 80);
+		*(double *) ROW(info, v, B_F, i) = 50;
+		*(uint8_t *) ROW(info, v, B_SPE, i) = i % 8;
+	}
+
+	return v;
+}
+
+static void run(const char *name, struct vec *v, uint32_t *idx, unsigned rounds){
+	double t0 = now();
+	for(unsigned r=0;r<rounds;r++){
+		if(v->info->tile)
+			kernel_seq_tiled(v);
+		else
+			kernel_seq_soa(v);
+	}
+	double tseq = now() - t0;
+
+	t0 = now();
+	for(unsigned r=0;r<rounds;r++)
+		kernel_idx(v, idx);
+	double tidx = now() - t0;
+
+	// checksum so the compiler can't drop anything
+	double cs = 0;
+	for(uint32_t i=0;i<v->n_used;i++)
+		cs += *(double *) ROW(v->info, v, B_BA, i);
+
+	double nr = (double)v->n_used * rounds;
+	printf("%-10s seq %8.3f ns/row   idx %8.3f ns/row   (checksum %g)\n",
+			name, 1e9*tseq/nr, 1e9*tidx/nr, cs);
+}
+
+int main(int argc, char **argv){
+	uint32_t n = argc > 1 ? atoi(argv[1]) : (1 << 20);
+	unsigned rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+	sim *sim = sim_create(4, 1 << 30);
+	if(!sim){
+		fprintf(stderr, "failed to create sim\n");
+		return 1;
+	}
+
+	uint32_t *idx = malloc(n * sizeof(*idx));
+	for(uint32_t i=0;i<n;i++)
+		idx[i] = i;
+	srand(1);
+	for(uint32_t i=n-1;i>0;i--){
+		uint32_t j = rand() % (i+1);
+		uint32_t t = idx[i]; idx[i] = idx[j]; idx[j] = t;
+	}
+
+	printf("%u rows, %u rounds, %d bands\n", n, rounds, NBANDS);
+
+	run("soa", fill(sim, simS_vec_create_info(sim, NBANDS, strides), n), idx, rounds);
+
+	static const uint16_t tiles[] = { 8, 16, 32 };
+	for(size_t i=0;i<sizeof(tiles)/sizeof(*tiles);i++){
+		char name[16];
+		snprintf(name, sizeof(name), "aosoa/%u", tiles[i]);
+		struct vec_info *info = simS_vec_create_info_tiled(sim, NBANDS, strides, tiles[i],
+				NBANDS, tiled);
+		run(name, fill(sim, info, n), idx, rounds);
+	}
+
+	free(idx);
+	sim_destroy(sim);
+	return 0;
+}
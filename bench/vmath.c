@@ -0,0 +1,305 @@
+/* vmath kernel throughput against the memory hierarchy.
+ *
+ * usage: vmath [-o file.csv] [-t seconds] [-d n]
+ *
+ * runs every vmath.h kernel on arrays sized to fit in L1, L2 and L3 and on arrays that spill
+ * to DRAM, and reports ns/element and GB/s next to a STREAM-style bandwidth ceiling measured
+ * at the same size (the best of copy, scale, add, triad and a read-only sum). GB/s counts the
+ * bytes a kernel has to read and write per element (scratch buffers are not counted), so a
+ * memory-bound kernel should sit close to the ceiling and a compute-bound one (exp, log, pow,
+ * quantiles, ...) shows how far it is from it.
+ *
+ * the kernels and the ceiling both run on one thread at the best ISA; see vmath_par and
+ * vmath_isa for thread and ISA scaling. -o writes one CSV row per kernel and size for
+ * regression tracking, -d overrides the DRAM element count. */
+
+#include "vmath.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define ALIGN_UP(sz) (((sz) + 63) & ~(size_t)63)
+#define NCLASS       8
+#define NBIN         16
+
+static size_t n;
+static double *x, *y, *d, *tmp, out[NBIN], t[NBIN], sink;
+static float *fx, *fy, *fd;
+static uint8_t *k;
+static uint64_t *bm;
+
+// (name, bytes/element, call)
+#define KERNELS(_)\
+	_(vdsetc,    8,     vdsetc(d, 1.0, n))\
+	_(vdsaddc,   16,    vdsaddc(d, 2.0, x, 1.0, n))\
+	_(vdaddc,    16,    vdaddc(d, x, 1.0, n))\
+	_(vdaddsv,   24,    vdaddsv(d, x, 2.0, y, n))\
+	_(vdaddv,    24,    vdaddv(d, x, y, n))\
+	_(vdscale,   16,    vdscale(d, x, 2.0, n))\
+	_(vdmulv,    24,    vdmulv(d, x, y, n))\
+	_(vdrefl,    24,    vdrefl(d, 0.5, x, y, n))\
+	_(vdaread,   16,    vdaread(d, x, n))\
+	_(vdsum,     8,     sink += vdsum(x, n))\
+	_(vdsumm8,   9,     sink += vdsumm8(x, k, 0x55, n))\
+	_(vddot,     16,    sink += vddot(x, y, n))\
+	_(vdavgw,    16,    sink += vdavgw(x, y, n))\
+	_(vdsumr,    8,     sink += vdsumr(x, n, VMATH_RED_KAHAN))\
+	_(vddotr,    16,    sink += vddotr(x, y, n, VMATH_RED_KAHAN))\
+	_(vdavgwr,   16,    sink += vdavgwr(x, y, n, VMATH_RED_KAHAN))\
+	_(vdsumg8,   9,     vdsumg8(out, NCLASS, x, k, n))\
+	_(vdsumwg8,  17,    vdsumwg8(out, NCLASS, x, y, k, n))\
+	_(vdcntg8,   1,     vdcntg8(out, NCLASS, k, n))\
+	_(vdaddcm8,  17,    vdaddcm8(d, x, 1.0, k, 0x55, n))\
+	_(vdscalem8, 17,    vdscalem8(d, x, 2.0, k, 0x55, n))\
+	_(vdaddsvm8, 25,    vdaddsvm8(d, x, 2.0, y, k, 0x55, n))\
+	_(vdmulvm8,  25,    vdmulvm8(d, x, y, k, 0x55, n))\
+	_(vddotm8,   17,    sink += vddotm8(x, y, k, 0x55, n))\
+	_(vdavgwm8,  17,    sink += vdavgwm8(x, y, k, 0x55, n))\
+	_(vdsummb,   8.125, sink += vdsummb(x, bm, n))\
+	_(vdaddcmb,  16.125, vdaddcmb(d, x, 1.0, bm, n))\
+	_(vdscalemb, 16.125, vdscalemb(d, x, 2.0, bm, n))\
+	_(vdaddsvmb, 24.125, vdaddsvmb(d, x, 2.0, y, bm, n))\
+	_(vdmulvmb,  24.125, vdmulvmb(d, x, y, bm, n))\
+	_(vddotmb,   16.125, sink += vddotmb(x, y, bm, n))\
+	_(vdavgwmb,  16.125, sink += vdavgwmb(x, y, bm, n))\
+	_(vdquantw,  16,    sink += vdquantw(x, y, 0.5, n, tmp))\
+	_(vdcdfw,    16,    vdcdfw(out, t, NBIN, x, y, n))\
+	_(vdhistw,   16,    vdhistw(out, NBIN, 0.0, 0.5, x, y, n))\
+	_(vdexp,     16,    vdexp(d, x, n))\
+	_(vdsexp,    16,    vdsexp(d, 2.0, -1.0, x, n))\
+	_(vdlog,     16,    vdlog(d, x, n))\
+	_(vdpow,     24,    vdpow(d, x, y, n))\
+	_(vdspow,    16,    vdspow(d, 2.0, x, 1.5, n))\
+	_(vdsqrt,    16,    vdsqrt(d, x, n))\
+	_(vfsetc,    4,     vfsetc(fd, 1.0f, n))\
+	_(vfsaddc,   8,     vfsaddc(fd, 2.0f, fx, 1.0f, n))\
+	_(vfaddc,    8,     vfaddc(fd, fx, 1.0f, n))\
+	_(vfaddsv,   12,    vfaddsv(fd, fx, 2.0f, fy, n))\
+	_(vfaddv,    12,    vfaddv(fd, fx, fy, n))\
+	_(vfscale,   8,     vfscale(fd, fx, 2.0f, n))\
+	_(vfmulv,    12,    vfmulv(fd, fx, fy, n))\
+	_(vfrefl,    12,    vfrefl(fd, 0.5f, fx, fy, n))\
+	_(vfaread,   8,     vfaread(fd, fx, n))\
+	_(vfsum,     4,     sink += vfsum(fx, n))\
+	_(vfsumm8,   5,     sink += vfsumm8(fx, k, 0x55, n))\
+	_(vfdot,     8,     sink += vfdot(fx, fy, n))\
+	_(vfavgw,    8,     sink += vfavgw(fx, fy, n))\
+	_(vfsumd,    4,     sink += vfsumd(fx, n))\
+	_(vfsumm8d,  5,     sink += vfsumm8d(fx, k, 0x55, n))\
+	_(vfdotd,    8,     sink += vfdotd(fx, fy, n))\
+	_(vfddot,    12,    sink += vfddot(fx, y, n))\
+	_(vfavgwd,   8,     sink += vfavgwd(fx, fy, n))\
+	_(vfdavgw,   12,    sink += vfdavgw(fx, y, n))
+
+#define KFUNC(name, _, call) static void b_##name(){ call; }
+KERNELS(KFUNC)
+#undef KFUNC
+
+#define NKERNEL (sizeof(kernels)/sizeof(*kernels))
+
+static struct { const char *name; double bytes; void (*f)(); } kernels[] = {
+#define KENTRY(name, bytes, _) { #name, bytes, b_##name },
+	KERNELS(KENTRY)
+#undef KENTRY
+};
+
+// STREAM kernels. these are plain vectorized loops cloned for the same ISA levels as vmath,
+// so the ceiling is what the hardware gives a simple loop, not a hand-tuned memcpy.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define STREAM_TARGET __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define STREAM_TARGET
+#endif
+
+#define STREAM(name, expr)\
+	static void __attribute__((noinline)) STREAM_TARGET s_##name(){\
+		double *restrict dd = d; const double *restrict xx = x, *restrict yy = y; size_t nn = n;\
+		_Pragma("omp simd") for(size_t i=0;i<nn;i++) dd[i] = expr;\
+		(void)xx; (void)yy;\
+	}
+
+STREAM(copy,  xx[i])
+STREAM(scale, 3.0*xx[i])
+STREAM(add,   xx[i] + yy[i])
+STREAM(triad, xx[i] + 3.0*yy[i])
+
+#undef STREAM
+
+// read-only stream, the reductions don't pay for write-allocate
+static void __attribute__((noinline)) STREAM_TARGET s_read(){
+	const double *restrict xx = x; size_t nn = n;
+	double s = 0;
+	_Pragma("omp simd reduction(+:s)") for(size_t i=0;i<nn;i++) s += xx[i];
+	sink += s;
+}
+#undef STREAM_TARGET
+
+static struct { const char *name; double bytes; void (*f)(); } streams[] = {
+	{ "copy",  16, s_copy },
+	{ "scale", 16, s_scale },
+	{ "add",   24, s_add },
+	{ "triad", 24, s_triad },
+	{ "read",  8,  s_read }
+};
+
+#define NSTREAM (sizeof(streams)/sizeof(*streams))
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// ns/element over at least `mintime` seconds
+static double measure(void (*f)(), double mintime){
+	f(); // warm up caches and page in the arrays
+
+	size_t reps = 1;
+	for(;;){
+		double t0 = now();
+		for(size_t r=0;r<reps;r++)
+			f();
+		double t = now() - t0;
+		if(t >= mintime)
+			return t / reps / n * 1e9;
+		reps *= 2;
+	}
+}
+
+static size_t cachesize(int name, size_t def){
+	long sz = sysconf(name);
+	return sz > 0 ? (size_t) sz : def;
+}
+
+int main(int argc, char **argv){
+	const char *csvname = NULL;
+	double mintime = 0.02;
+	size_t ndram = 0;
+
+	int opt;
+	while((opt = getopt(argc, argv, "o:t:d:")) != -1){
+		switch(opt){
+			case 'o': csvname = optarg; break;
+			case 't': mintime = atof(optarg); break;
+			case 'd': ndram = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-o file.csv] [-t seconds] [-d n]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	// the cache sizes are in bytes. the cached sizes keep the 24 byte/element kernels
+	// within half the cache, the DRAM size makes even the 8 byte/element kernels stream
+	// twice the L3.
+	size_t l3 = cachesize(_SC_LEVEL3_CACHE_SIZE, 16 << 20);
+	struct { const char *name; size_t n; } levels[] = {
+		{ "L1",   cachesize(_SC_LEVEL1_DCACHE_SIZE, 32 << 10) / 2 / 24 },
+		{ "L2",   cachesize(_SC_LEVEL2_CACHE_SIZE, 1 << 20) / 2 / 24 },
+		{ "L3",   l3 / 2 / 24 },
+		{ "DRAM", ndram ? ndram : 2*l3/sizeof(double) }
+	};
+	int nlevel = sizeof(levels)/sizeof(*levels);
+
+	size_t nmax = 0;
+	for(int i=0;i<nlevel;i++)
+		nmax = levels[i].n > nmax ? levels[i].n : nmax;
+
+	x = aligned_alloc(64, ALIGN_UP(nmax*sizeof(double)));
+	y = aligned_alloc(64, ALIGN_UP(nmax*sizeof(double)));
+	d = aligned_alloc(64, ALIGN_UP(nmax*sizeof(double)));
+	tmp = aligned_alloc(64, ALIGN_UP(2*nmax*sizeof(double)));
+	fx = aligned_alloc(64, ALIGN_UP(nmax*sizeof(float)));
+	fy = aligned_alloc(64, ALIGN_UP(nmax*sizeof(float)));
+	fd = aligned_alloc(64, ALIGN_UP(nmax*sizeof(float)));
+	k = aligned_alloc(64, ALIGN_UP(nmax));
+	bm = aligned_alloc(64, ALIGN_UP((nmax+63)/64*sizeof(uint64_t)));
+
+	if(!x || !y || !d || !tmp || !fx || !fy || !fd || !k || !bm){
+		fprintf(stderr, "out of memory (n=%zu), try a smaller -d\n", nmax);
+		return 1;
+	}
+
+	for(size_t i=0;i<nmax;i++){
+		x[i] = 1.0 + i%7;
+		y[i] = 0.5 + i%5;
+		fx[i] = x[i];
+		fy[i] = y[i];
+		k[i] = i % NCLASS;
+	}
+	memset(d, 0, nmax*sizeof(double));
+	memset(fd, 0, nmax*sizeof(float));
+	for(size_t i=0;i<(nmax+63)/64;i++)
+		bm[i] = 0x5555555555555555ULL;
+	for(int i=0;i<NBIN;i++)
+		t[i] = 0.5*i;
+
+	vmath_set_threads(1);
+	const char *isa = vmath_isa_name(vmath_isa());
+
+	FILE *csv = NULL;
+	if(csvname){
+		if(!(csv = fopen(csvname, "w"))){
+			perror(csvname);
+			return 1;
+		}
+		fprintf(csv, "isa,level,n,kernel,bytes_per_element,ns_per_element,gbps,ceiling_gbps\n");
+	}
+
+	double ceil[sizeof(levels)/sizeof(*levels)];
+	printf("isa=%s threads=1\n%-10s", isa, "");
+	for(int i=0;i<nlevel;i++)
+		printf(" %24s", levels[i].name);
+	printf("\n%-10s", "n");
+	for(int i=0;i<nlevel;i++)
+		printf(" %24zu", levels[i].n);
+	printf("\n");
+
+	// STREAM rows, the best of them is the ceiling at each level
+	for(size_t j=0;j<NSTREAM;j++){
+		printf("%-10s", streams[j].name);
+		for(int i=0;i<nlevel;i++){
+			n = levels[i].n;
+			double ns = measure(streams[j].f, mintime);
+			double gbps = streams[j].bytes / ns;
+			if(j == 0 || gbps > ceil[i])
+				ceil[i] = gbps;
+			printf(" %10.3f %7.2f GB/s", ns, gbps);
+			if(csv)
+				fprintf(csv, "%s,%s,%zu,stream_%s,%g,%g,%g,\n", isa, levels[i].name, n,
+						streams[j].name, streams[j].bytes, ns, gbps);
+		}
+		printf("\n");
+	}
+
+	printf("%-10s", "ceiling");
+	for(int i=0;i<nlevel;i++)
+		printf(" %18.2f GB/s", ceil[i]);
+	printf("\n\n%-10s", "kernel");
+	for(int i=0;i<nlevel;i++)
+		printf(" %10s %7s %5s", "ns/el", "GB/s", "%ceil");
+	printf("\n");
+
+	for(size_t j=0;j<NKERNEL;j++){
+		printf("%-10s", kernels[j].name);
+		for(int i=0;i<nlevel;i++){
+			n = levels[i].n;
+			double ns = measure(kernels[j].f, mintime);
+			double gbps = kernels[j].bytes / ns;
+			printf(" %10.3f %7.2f %4.0f%%", ns, gbps, 100*gbps/ceil[i]);
+			if(csv)
+				fprintf(csv, "%s,%s,%zu,%s,%g,%g,%g,%g\n", isa, levels[i].name, n,
+						kernels[j].name, kernels[j].bytes, ns, gbps, ceil[i]);
+		}
+		printf("\n");
+	}
+
+	if(csv)
+		fclose(csv);
+
+	free(x); free(y); free(d); free(tmp); free(fx); free(fy); free(fd); free(k); free(bm);
+	return sink == 0.12345; // prevent dropping the reductions
+}
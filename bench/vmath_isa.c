@@ -0,0 +1,105 @@
+/* vmath kernel throughput per ISA level.
+ *
+ * usage: vmath_isa [n] [seconds]
+ *
+ * runs every kernel at each ISA level the CPU supports and reports GB/s, counting the bytes
+ * the kernel has to read and write. the default n keeps the arrays in L2 so this measures the
+ * kernels rather than DRAM. */
+
+#include "vmath.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define ALIGN_UP(sz) (((sz) + 63) & ~(size_t)63)
+
+static size_t n;
+static double *x, *y, *d, sink;
+static uint8_t *k;
+
+#define KERNELS(_)\
+	_(vdsetc,  1, vdsetc(d, 1.0, n))\
+	_(vdsaddc, 2, vdsaddc(d, 2.0, x, 1.0, n))\
+	_(vdaddc,  2, vdaddc(d, x, 1.0, n))\
+	_(vdaddsv, 3, vdaddsv(d, x, 2.0, y, n))\
+	_(vdaddv,  3, vdaddv(d, x, y, n))\
+	_(vdscale, 2, vdscale(d, x, 2.0, n))\
+	_(vdmulv,  3, vdmulv(d, x, y, n))\
+	_(vdrefl,  3, vdrefl(d, 0.5, x, y, n))\
+	_(vdaread, 2, vdaread(d, x, n))\
+	_(vdsum,   1, sink += vdsum(x, n))\
+	_(vdsumm8, 1.125, sink += vdsumm8(x, k, 0x55, n))\
+	_(vddot,   2, sink += vddot(x, y, n))\
+	_(vdavgw,  2, sink += vdavgw(x, y, n))
+
+#define KFUNC(name, _, call) static void b_##name(){ call; }
+KERNELS(KFUNC)
+#undef KFUNC
+
+static struct { const char *name; double words; void (*f)(); } kernels[] = {
+#define KENTRY(name, words, _) { #name, words, b_##name },
+	KERNELS(KENTRY)
+#undef KENTRY
+};
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// GB/s over at least `mintime` seconds
+static double measure(void (*f)(), double words, double mintime){
+	size_t reps = 1;
+	for(;;){
+		double t0 = now();
+		for(size_t r=0;r<reps;r++)
+			f();
+		double t = now() - t0;
+		if(t >= mintime)
+			return words * sizeof(double) * n * reps / t / 1e9;
+		reps *= 2;
+	}
+}
+
+int main(int argc, char **argv){
+	n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+	double mintime = argc > 2 ? atof(argv[2]) : 0.05;
+
+	x = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	y = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	d = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	k = aligned_alloc(64, ALIGN_UP(n));
+	for(size_t i=0;i<n;i++){
+		x[i] = 1.0 + i%7;
+		y[i] = 2.0 + i%5;
+		k[i] = i % 8;
+	}
+
+	int max = vmath_isa_max();
+	int isas[VMATH_NISA], nisa = 0;
+	for(int isa=VMATH_GENERIC; isa<=max; isa++){
+		if(vmath_set_isa(isa) == isa)
+			isas[nisa++] = isa;
+	}
+
+	printf("n=%zu (GB/s)\n%-10s", n, "kernel");
+	for(int i=0;i<nisa;i++)
+		printf(" %10s", vmath_isa_name(isas[i]));
+	printf("\n");
+
+	for(size_t j=0;j<sizeof(kernels)/sizeof(*kernels);j++){
+		printf("%-10s", kernels[j].name);
+		for(int i=0;i<nisa;i++){
+			vmath_set_isa(isas[i]);
+			printf(" %10.2f", measure(kernels[j].f, kernels[j].words, mintime));
+		}
+		printf("\n");
+	}
+
+	vmath_set_isa(max);
+	free(x); free(y); free(d); free(k);
+	return sink == 0.12345; // prevent dropping the reductions
+}
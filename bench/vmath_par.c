@@ -0,0 +1,94 @@
+/* vmath thread scaling.
+ *
+ * usage: vmath_par [n] [max threads] [seconds]
+ *
+ * runs a few memory- and compute-bound kernels on n elements with 1..max threads
+ * (default: OpenMP max threads) and reports ns/element and the speedup over 1 thread. */
+
+#include "vmath.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ALIGN_UP(sz) (((sz) + 63) & ~(size_t)63)
+
+static size_t n;
+static double *x, *y, *d, sink;
+
+#define KERNELS(_)\
+	_(vdaddsv, vdaddsv(d, x, 2.0, y, n))\
+	_(vdmulv,  vdmulv(d, x, y, n))\
+	_(vdexp,   vdexp(d, x, n))\
+	_(vdpow,   vdpow(d, x, y, n))\
+	_(vdsum,   sink += vdsum(x, n))\
+	_(vddot,   sink += vddot(x, y, n))\
+	_(vdavgw,  sink += vdavgw(x, y, n))
+
+#define KFUNC(name, call) static void b_##name(){ call; }
+KERNELS(KFUNC)
+#undef KFUNC
+
+static struct { const char *name; void (*f)(); } kernels[] = {
+#define KENTRY(name, _) { #name, b_##name },
+	KERNELS(KENTRY)
+#undef KENTRY
+};
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// ns/element over at least `mintime` seconds
+static double measure(void (*f)(), double mintime){
+	size_t reps = 1;
+	for(;;){
+		double t0 = now();
+		for(size_t r=0;r<reps;r++)
+			f();
+		double t = now() - t0;
+		if(t >= mintime)
+			return t / reps / n * 1e9;
+		reps *= 2;
+	}
+}
+
+int main(int argc, char **argv){
+	n = argc > 1 ? strtoul(argv[1], NULL, 10) : (1 << 22);
+	int maxt = argc > 2 ? atoi(argv[2]) : vmath_threads();
+	double mintime = argc > 3 ? atof(argv[3]) : 0.1;
+
+	x = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	y = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	d = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	for(size_t i=0;i<n;i++){
+		x[i] = 1.0 + i%7;
+		y[i] = 0.5 + i%5;
+	}
+
+	// measure the parallel path even with a small n
+	vmath_set_par_min(0);
+
+	printf("n=%zu isa=%s (ns/element, speedup)\n%-8s", n, vmath_isa_name(vmath_isa()), "threads");
+	for(size_t j=0;j<sizeof(kernels)/sizeof(*kernels);j++)
+		printf(" %16s", kernels[j].name);
+	printf("\n");
+
+	double base[sizeof(kernels)/sizeof(*kernels)];
+	for(int t=1;t<=maxt;t++){
+		vmath_set_threads(t);
+		printf("%-8d", t);
+		for(size_t j=0;j<sizeof(kernels)/sizeof(*kernels);j++){
+			double ns = measure(kernels[j].f, mintime);
+			if(t == 1)
+				base[j] = ns;
+			printf(" %9.3f %5.2fx", ns, base[j]/ns);
+		}
+		printf("\n");
+	}
+
+	free(x); free(y); free(d);
+	return sink == 0.12345; // prevent dropping the reductions
+}
@@ -0,0 +1,96 @@
+/* cost of the vmath reduction modes.
+ *
+ * usage: vmath_red [n] [seconds]
+ *
+ * runs vdsumr, vddotr and vdavgwr in each reduction mode at each ISA level the CPU supports
+ * and reports ns/element, and the error of vdsumr in each mode in ulps of the exact sum
+ * (a long double reference). */
+
+#include "vmath.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define ALIGN_UP(sz) (((sz) + 63) & ~(size_t)63)
+
+static size_t n;
+static double *x, *y, sink;
+static int mode;
+
+static void b_sum(){ sink += vdsumr(x, n, mode); }
+static void b_dot(){ sink += vddotr(x, y, n, mode); }
+static void b_avgw(){ sink += vdavgwr(x, y, n, mode); }
+
+static struct { const char *name; void (*f)(); } kernels[] = {
+	{ "vdsumr",  b_sum },
+	{ "vddotr",  b_dot },
+	{ "vdavgwr", b_avgw }
+};
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// ns/element over at least `mintime` seconds
+static double measure(void (*f)(), double mintime){
+	size_t reps = 1;
+	for(;;){
+		double t0 = now();
+		for(size_t r=0;r<reps;r++)
+			f();
+		double t = now() - t0;
+		if(t >= mintime)
+			return t / reps / n * 1e9;
+		reps *= 2;
+	}
+}
+
+int main(int argc, char **argv){
+	n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+	double mintime = argc > 2 ? atof(argv[2]) : 0.05;
+
+	x = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+	y = aligned_alloc(64, ALIGN_UP(n*sizeof(double)));
+
+	// values of mixed sign and magnitude (and a sum that cancels) so that the modes differ
+	srand(1);
+	long double ref = 0;
+	for(size_t i=0;i<n;i++){
+		x[i] = (rand() / (double)RAND_MAX - 0.5) * ldexp(1, rand()%40 - 20);
+		y[i] = rand() / (double)RAND_MAX;
+		ref += x[i];
+	}
+
+	double ulp = nextafter(fabs((double)ref), INFINITY) - fabs((double)ref);
+
+	int max = vmath_isa_max();
+	int isas[VMATH_NISA], nisa = 0;
+	for(int isa=VMATH_GENERIC; isa<=max; isa++){
+		if(vmath_set_isa(isa) == isa)
+			isas[nisa++] = isa;
+	}
+
+	printf("n=%zu (ns/element)\n%-18s", n, "kernel");
+	for(int i=0;i<nisa;i++)
+		printf(" %10s", vmath_isa_name(isas[i]));
+	printf(" %10s\n", "sum ulps");
+
+	for(size_t j=0;j<sizeof(kernels)/sizeof(*kernels);j++){
+		for(mode=0;mode<VMATH_RED_N;mode++){
+			printf("%-8s %-9s", kernels[j].name, vmath_redmode_name(mode));
+			for(int i=0;i<nisa;i++){
+				vmath_set_isa(isas[i]);
+				printf(" %10.3f", measure(kernels[j].f, mintime));
+			}
+			printf(" %10.1f\n", fabs(vdsumr(x, n, mode) - (double)ref) / ulp);
+		}
+	}
+
+	vmath_set_isa(max);
+	free(x); free(y);
+	return sink == 0.12345; // prevent dropping the reductions
+}
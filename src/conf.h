@@ -7,6 +7,27 @@
 
 //---- simulation ----------------------------------------
 #define SIM_SAVEPOINT_BLOCKSIZE    64
+#define SIM_MAXHOOK                4
 
-// alignment for bulk allocs (eg. vector ops)
-#define SIMD_ALIGN_HINT            16
+// initial vector allocation (rows), AoSoA tile widths must divide this
+#define VEC_MIN_ALLOC              64
+
+// default chunk size (rows) for chunked vector iteration, small enough that a chunk of a few
+// double bands stays in L2
+#define VEC_CHUNK_SIZE             4096
+
+// lazily deleted vectors are compacted when 1/VEC_TOMB_DIV of the rows are dead
+#define VEC_TOMB_DIV               4
+
+// alignment for bulk allocs (eg. vector ops).
+// this is one AVX-512 vector (and a cache line), so vmath kernels run without a peel loop
+// on sim-allocated bands.
+#define SIMD_ALIGN_HINT            64
+
+//---- vmath ----------------------------------------
+// parallel vmath kernels split arrays into chunks of this many elements. this is a multiple
+// of 64 so that chunks keep SIMD alignment and start on a bitmap word.
+#define VMATH_PAR_CHUNK            16384
+
+// default size (elements) from which vmath kernels run in parallel
+#define VMATH_PAR_MIN              (1 << 17)
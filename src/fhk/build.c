@@ -42,6 +42,7 @@ struct def_model {
 	struct def_edge *returns;
 	struct def_shedge *shadows;
 	fhk_grp group;
+	uint8_t flags;
 	float k, c;
 	float cmin;
 };
@@ -86,7 +87,7 @@ static void *g_copy_umaps(struct fhk_graph *G, struct fhk_def *D, void *p);
 static fhk_map g_extmap(struct fhk_graph *G, xidx xi, fhk_extmap emap);
 static fhk_map g_extmapi(struct fhk_graph *G, xidx mi, fhk_extmap emap);
 static bool g_mretbuf(struct fhk_graph *G, xidx mi);
-static void g_mflags(struct fhk_graph *G);
+static void g_mflags(struct fhk_graph *G, struct fhk_def *D);
 static void g_reorder_edges(struct fhk_graph *G, struct fhk_def *D);
 
 static void *vec_alloc(vec **v, uint32_t num);
@@ -176,7 +177,7 @@ struct fhk_graph *fhk_build_graph(struct fhk_def *D, void *p){
 	p = g_build_edges(G, D, p);
 	p = g_copy_umaps(G, D, p);
 	g_reorder_edges(G, D);
-	g_mflags(G);
+	g_mflags(G, D);
 
 #if FHK_DEBUG
 	assert(p == _mem+fhk_graph_size(D));
@@ -190,7 +191,8 @@ void fhk_destroy_graph(struct fhk_graph *G){
 	free(G->models - G->nm);
 }
 
-fhk_obj fhk_def_add_model(struct fhk_def *D, fhk_grp group, float k, float c, float cmin){
+fhk_obj fhk_def_add_model(struct fhk_def *D, fhk_grp group, float k, float c, float cmin,
+		uint8_t flags){
 	if(vec_num(D->models) == G_MAXIDX)
 		return FHKE_INVAL | E_META(1, I, G_MAXIDX);
 
@@ -200,6 +202,9 @@ fhk_obj fhk_def_add_model(struct fhk_def *D, fhk_grp group, float k, float c, fl
 	if(k < 0 || c < 1)
 		return FHKE_INVAL;
 
+	if(flags & ~FHKM_BATCH)
+		return FHKE_INVAL;
+
 	xidx idx = vec_add(&D->models);
 	if(idx < 0)
 		return FHKE_MEM;
@@ -211,6 +216,7 @@ fhk_obj fhk_def_add_model(struct fhk_def *D, fhk_grp group, float k, float c, fl
 	dm->returns = NULL;
 	dm->shadows = NULL;
 	dm->group = group;
+	dm->flags = flags;
 	dm->k = k;
 	dm->c = c;
 	dm->cmin = cmin;
@@ -289,6 +295,10 @@ fhk_ei fhk_def_add_param(struct fhk_def *D, fhk_obj model, fhk_obj var, fhk_extm
 	if(vec_num(dm->params) == G_MAXEDGE || dx->n_fwd == G_MAXFWDE)
 		return FHKE_INVAL;
 
+	// batched calls pass one value per instance on each edge
+	if((dm->flags & FHKM_BATCH) && map != FHKMAP_IDENT)
+		return FHKE_INVAL | E_META(1, I, mi);
+
 	if(!d_checkmap(D, map, dm->group, dx->group))
 		return FHKE_INVAL;
 
@@ -324,6 +334,10 @@ fhk_ei fhk_def_add_return(struct fhk_def *D, fhk_obj model, fhk_obj var, fhk_ext
 	if(vec_num(dm->returns) == G_MAXEDGE || dx->n_mod == G_MAXMODE)
 		return FHKE_INVAL;
 
+	// batched calls pass one value per instance on each edge
+	if((dm->flags & FHKM_BATCH) && map != FHKMAP_IDENT)
+		return FHKE_INVAL | E_META(1, I, mi);
+
 	if(!d_checkmap(D, map, dm->group, dx->group))
 		return FHKE_INVAL;
 
@@ -709,13 +723,16 @@ static bool g_mretbuf(struct fhk_graph *G, xidx mi){
 	return false;
 }
 
-static void g_mflags(struct fhk_graph *G){
+static void g_mflags(struct fhk_graph *G, struct fhk_def *D){
 	for(int64_t i=0;i<G->nm;i++){
 		struct fhk_model *m = &G->models[~i];
 		m->flags = 0;
 
 		if(!g_mretbuf(G, ~i))
 			m->flags |= M_NORETBUF;
+
+		if(D->models[i].flags & FHKM_BATCH)
+			m->flags |= M_BATCH;
 	}
 }
 
@@ -26,10 +26,11 @@ bool fhk_is_debug(){
 
 // debug symbol for idx, DO NOT store the return value, it's an internal ring buffer.
 // only use this for debug printing. the ring buffer is to allow using multiple debug syms
-// in the same print call.
+// in the same print call. the buffer is thread-local, so solvers sharing a graph can print
+// from different threads.
 const char *fhk_dsym(struct fhk_graph *G, xidx idx){
-	static char rbuf[4][32];
-	static int pos = 0;
+	static __thread char rbuf[4][32];
+	static __thread int pos = 0;
 
 	if(idx >= -G->nm && idx < G->nx && G->dsym && G->dsym[idx])
 		return G->dsym[idx];
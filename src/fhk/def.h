@@ -88,6 +88,7 @@ struct fhk_graph {
 
 // model flags
 #define M_NORETBUF 0x1
+#define M_BATCH    0x2
 
 // shadow flags
 #define W_COMPUTED 0x1
@@ -105,8 +106,13 @@ struct fhk_graph {
 #define G_GRPBITS    7        /* bits per group size */
 #define G_IDXBITS    15       /* bits per index (var/model) */
 #define G_MAXIDX     0x7ffe   /* max valid (positive) index */
+#ifdef FHK_WIDEINST
+#define G_INSTBITS   32       /* bits per instance */
+#define G_MAXINST    0x3ffffffe /* max valid instance (interval size must fit in 31 bits) */
+#else
 #define G_INSTBITS   16       /* bits per instance */
 #define G_MAXINST    0xfffe   /* max valid instance */
+#endif
 #define G_EDGEBITS   8        /* bits per edge count */
 #define G_MAXEDGE    0x7f     /* max (positive) edge */
 #define G_MAXFWDE    0xffff   /* max v->m forward edge (n_fwd) */
@@ -117,7 +123,7 @@ struct fhk_graph {
 
 static_assert(8*sizeof(fhk_grp) >= G_GRPBITS);
 static_assert(8*sizeof(fhk_idx) >= G_IDXBITS);
-static_assert((1<<8*sizeof(fhk_inst)) > G_MAXINST);
+static_assert((1ull<<8*sizeof(fhk_inst)) > G_MAXINST);
 static_assert(8*sizeof(fhk_map) >= G_UMAPBITS);
 
 // mappings
@@ -129,7 +135,7 @@ static_assert(8*sizeof(fhk_map) >= G_UMAPBITS);
 #define MAP_ISUSER(map,ng)  ((map) != MAP_IDENT && ((uint8_t)(map)) >= (ng)) /* is it a user map? */
 
 // error handling
-#define E_META(n,f,x)       ((FHKEI_##f << (4*((n)+1))) | ((uint64_t)(x) << (16*(n))))
+#define E_META(n,f,x)       ((FHKEI_##f << (4*((n)+1))) | (((uint64_t)(x) & 0xffff) << (16*(n))))
 
 typedef uint64_t xgrp;   // group
 typedef int64_t  xidx;   // index
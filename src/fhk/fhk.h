@@ -12,7 +12,11 @@
 // smallest types that fit (see def.h)
 typedef int16_t  fhk_idx;        // element (variable, model, shadow, map) index
 typedef uint16_t fhk_nidx;       // index counter
+#ifdef FHK_WIDEINST
+typedef uint32_t fhk_inst;       // instance
+#else
 typedef uint16_t fhk_inst;       // instance
+#endif
 typedef uint8_t  fhk_grp;        // group
 typedef int8_t   fhk_map;        // internal map
 typedef uint8_t  fhk_nmap;       // map counter
@@ -23,8 +27,18 @@ typedef struct fhk_eref {
 	fhk_inst inst;
 } fhk_eref;
 
+typedef struct fhk_vref {
+	fhk_idx idx;
+	fhk_inst inst;
+	fhk_inst num;
+} fhk_vref;
+
 enum {
+#ifdef FHK_WIDEINST
+	FHK_NINST = 0xffffffff, // invalid instance
+#else
 	FHK_NINST = 0xffff, // invalid instance
+#endif
 	FHK_NGRP  = 0xff, // invalid group
 	FHK_NIDX  = 0x7fff  // invalid variable/model/map
 };
@@ -40,11 +54,26 @@ enum {
 // +-----------+--------+--------+--------+--------+
 // | complex   |     interval pointer     | n.ival | * interval number is exclusive and non-zero.
 // +-----------+--------------------------+--------+   intervals must be sorted and distinct.
+//
+// with FHK_WIDEINST, instances are 32 bits and the fields are rearranged:
+//
+//             +-----+---------+--------+--------+
+//             | 63  | 62..32  | 31..16 | 15..0  |
+// +-----------+-----+---------+--------+--------+
+// | empty set |  0  |    1    |        0        |
+// +-----------+-----+---------+-----------------+
+// | interval  |  1  |  -size  |      first      | * size is 31 bits, first is 32 bits
+// +-----------+-----+---------+--------+--------+
+// | complex   | interval pointer       | n.ival |
+// +-----------+------------------------+--------+
+//
+// complex intervals are 64-bit (`int32_t size` in the high half) instead of 32-bit
+// (`int16_t size`), and the interval pointer must be above 0x10000.
 typedef int64_t fhk_subset;
 
 // ---- error handling ----------------------------------------
 
-// error info. 48 bits to fit fhk_status.
+// error info. 48 bits to fit fhk_status. info fields are truncated to 16 bits.
 //
 // +--------+--------+--------+-------+-------+
 // | 47..32 | 31..16 | 15..12 | 11..8 |  7..0 |
@@ -89,25 +118,44 @@ enum {
 	FHK_OK = 0,              //                         stop
 	FHK_ERROR,               // s_ei                    stop
 	FHKS_SHAPE,              // s_shape                 call fhkS_shape(_table)
-	FHKS_VREF,               // s_vref                  call fhkS_vrefi
+	FHKS_VREF,               // s_vref                  call fhkS_setvaluei
 	FHKS_MAPCALL,            // s_mapcall               call fhkS_setmap
 	FHKS_MODCALL,            // s_modcall               write values to return edges [np, np+nr)
 };
 
-// each field here must fit in 48 bits
+// batched modcalls (models defined with FHKM_BATCH):
+//     * ni is the number of instances in the call (1 for normal modcalls)
+//     * each parameter and return edge holds ni values, one per instance
+//     * edge np+nr is the instance list, p points to ni fhk_inst values (sorted)
+//     * mref.inst is the first instance in the list
+
+// each field here must fit in 48 bits.
+// with FHK_WIDEINST, s_vref and s_mapcall don't, so they point to the solver instead
+// (valid until the next fhk_continue). use FHK_SVREF/FHK_SMAPCALL to access them.
 typedef union fhk_sarg {
 	uint64_t u64;
 
 	// FHKS_VREF
-	fhk_eref s_vref;
+	// the request is for [inst, inst+num), but only inst is required: if the driver
+	// gives less, the rest is requested again.
+#ifdef FHK_WIDEINST
+	fhk_vref *s_vref;
+#else
+	fhk_vref s_vref;
+#endif
 
 	// FHKS_MAPCALL
+#ifdef FHK_WIDEINST
+	fhk_eref *s_mapcall;
+#else
 	fhk_eref s_mapcall;
+#endif
 
 	// FHKS_MODCALL
 	struct {
 		fhk_eref mref;
 		uint8_t np, nr;
+		fhk_inst ni;
 		struct {
 			void *p;
 			size_t n;
@@ -123,6 +171,14 @@ typedef union fhk_sarg {
 
 static_assert(sizeof(fhk_sarg) == sizeof(uint64_t));
 
+#ifdef FHK_WIDEINST
+#define FHK_SVREF(arg)    (*(arg).s_vref)
+#define FHK_SMAPCALL(arg) (*(arg).s_mapcall)
+#else
+#define FHK_SVREF(arg)    ((arg).s_vref)
+#define FHK_SMAPCALL(arg) ((arg).s_mapcall)
+#endif
+
 #define fhk_modcall typeof(*((fhk_sarg *)0)->s_modcall)
 #define fhk_mcedge  typeof(*((fhk_modcall *)0)->edges)
 
@@ -171,6 +227,13 @@ enum {
 	FHKO_SHADOW
 };
 
+// fhk_def_add_model flags
+enum {
+	FHKM_BATCH = 0x1  // call the model once for all selected instances, see fhk_modcall.
+	                  // all parameters and returns must be identity-mapped, adding any other
+	                  // edge fails.
+};
+
 // external map definitions
 #define FHKMAP_USER(map,inverse) ((((inverse) & 0xff) << 8) | ((map) & 0xff))
 enum {
@@ -184,15 +247,45 @@ typedef struct fhk_graph fhk_graph;
 typedef struct fhk_solver fhk_solver;
 typedef struct fhk_def fhk_def;
 typedef struct fhk_prune fhk_prune;
+typedef struct fhk_par fhk_par;
+typedef struct fhk_plan fhk_plan;
 typedef float fhk_cbound[2];
 
+// chain plan cache counters
+typedef struct fhk_pstats {
+	uint32_t hit;  // chains restored from the plan, search skipped
+	uint32_t miss; // no plan for the roots, searched and recorded (unless it used computed guards)
+	uint32_t fail; // a mapping or guard differed from the plan, searched and re-recorded
+} fhk_pstats;
+
+// parallel solver driver: handle the request in `status` for solver S. this is called
+// concurrently from multiple threads, return nonzero to stop.
+typedef int32_t (*fhk_pdriver)(void *udata, fhk_solver *S, fhk_status status);
+
+// direct callbacks (fhk_solve): handle the request like the corresponding FHKS_* status
+// of fhk_continue. the callbacks run on the solver's stack, return nonzero to stop.
+typedef struct fhk_cb {
+	int32_t (*shape)(void *udata, fhk_solver *S, fhk_grp group);
+	int32_t (*vref)(void *udata, fhk_solver *S, fhk_idx xi, fhk_inst inst, fhk_inst num);
+	int32_t (*mapcall)(void *udata, fhk_solver *S, fhk_extmap map, fhk_inst inst);
+	int32_t (*modcall)(void *udata, fhk_solver *S, fhk_modcall *mc);
+} fhk_cb;
+
 fhk_solver *fhk_create_solver(fhk_graph *G, arena *arena);
+bool fhk_reset_solver(fhk_solver *S, arena *arena);
 fhk_status fhk_continue(fhk_solver *S);
+fhk_status fhk_solve(fhk_solver *S, const fhk_cb *cb, void *udata);
 
 void fhkS_setroot(fhk_solver *S, fhk_idx xi, fhk_subset ss, void *buf);
 void fhkS_setshape(fhk_solver *S, fhk_grp group, fhk_inst shape);
 void fhkS_setvaluei(fhk_solver *S, fhk_idx xi, fhk_inst inst, uint32_t n, void *vp);
 void fhkS_setmap(fhk_solver *S, fhk_extmap map, fhk_inst inst, fhk_subset ss);
+void fhkS_setplan(fhk_solver *S, fhk_plan *P);
+void fhkS_invalidate(fhk_solver *S, fhk_idx xi, fhk_subset ss);
+
+fhk_plan *fhk_create_plan(fhk_graph *G);
+void fhk_destroy_plan(fhk_plan *P);
+fhk_pstats fhk_plan_stats(fhk_plan *P);
 
 // inspection functions (this is a private api and should probably be moved in its own file).
 // don't rely on these, they are only exposed for debugging.
@@ -203,6 +296,13 @@ void *fhkI_value(fhk_solver *S, fhk_idx xi, fhk_inst inst);
 fhk_subset fhkI_umap(fhk_solver *S, fhk_extmap map, fhk_inst inst);
 fhk_graph *fhkI_G(fhk_solver *S);
 
+fhk_par *fhk_create_par(fhk_graph *G, uint32_t nthreads);
+void fhk_destroy_par(fhk_par *P);
+void fhkP_setshape(fhk_par *P, fhk_grp group, fhk_inst shape);
+fhk_ei fhkP_setroot(fhk_par *P, fhk_idx xi, fhk_subset ss, void *buf);
+void fhkP_clear(fhk_par *P);
+fhk_status fhkP_solve(fhk_par *P, fhk_pdriver driver, void *udata);
+
 fhk_prune *fhk_create_prune(fhk_graph *G);
 void fhk_destroy_prune(fhk_prune *P);
 uint8_t *fhk_prune_flags(fhk_prune *P);
@@ -215,7 +315,7 @@ size_t fhk_graph_size(fhk_def *D);
 fhk_idx fhk_graph_idx(fhk_def *D, fhk_obj obj);
 fhk_graph *fhk_build_graph(fhk_def *D, void *p);
 void fhk_destroy_graph(fhk_graph *G);
-fhk_obj fhk_def_add_model(fhk_def *D, fhk_grp group, float k, float c, float cmin);
+fhk_obj fhk_def_add_model(fhk_def *D, fhk_grp group, float k, float c, float cmin, uint8_t flags);
 fhk_obj fhk_def_add_var(fhk_def *D, fhk_grp group, uint16_t size, float cdiff);
 fhk_obj fhk_def_add_shadow(fhk_def *D, fhk_obj var, uint8_t guard, fhk_shvalue arg);
 fhk_ei fhk_def_add_param(fhk_def *D, fhk_obj model, fhk_obj var, fhk_extmap map);
@@ -0,0 +1,214 @@
+#include "fhk.h"
+#include "def.h"
+#include "../mem.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// parallel solver. the graph is read-only after build, so each thread gets its own solver
+// (and arena) on the same graph. every root interval is split into nthreads contiguous
+// parts, part t of each root goes to thread t. the thread solvers write straight into the
+// caller's root buffers (at the part's offset), so there is nothing to merge afterwards.
+//
+// roots are assumed independent (eg. per-tree or per-stand values): anything shared between
+// parts, like a space-mapped stand variable used by all trees, is computed once per thread.
+//
+// the thread solvers are created on first use and live in their own arenas, each solve
+// resets them (fhk_reset_solver) on the per-thread solve arena.
+
+#define PAR_RSIZE       16             /* initial root buffer size */
+#define PAR_ARENASIZE   (1 << 20)      /* initial per-thread arena size */
+#define PAR_SARENASIZE  (1 << 17)      /* initial per-thread solver arena size */
+#define PAR_NOSHAPE     FHK_NINST      /* shape not given, ask the driver */
+#define PAR_EMEM        (FHK_ERROR | (((fhk_sarg){.s_ei=FHKE_MEM}).u64 << 16))
+
+// see subset representation in fhk.h. only intervals are accepted as roots.
+#define PAR_ISIVAL(ss)  ((int64_t)(ss) < 0)
+#ifdef FHK_WIDEINST
+#define PAR_EMPTYSET    0x100000000ll
+#define PAR_FIRST(ss)   ((ss) & 0xffffffff)
+#define PAR_N1(ss)      ((1-((ss) >> 32)) & 0x7fffffff)
+#define PAR_IVAL(i,n)   ((fhk_subset)((1ull << 63) | (((uint64_t)(1-(n)) & 0x7fffffff) << 32) | (i)))
+#else
+#define PAR_EMPTYSET    0x00010000
+#define PAR_FIRST(ss)   ((ss) & 0xffff)
+#define PAR_N1(ss)      ((1-((ss) >> 16)) & 0xffff)
+#define PAR_IVAL(i,n)   ((fhk_subset)(0xffff000000000000ull | (((uint64_t)(1-(n)) & 0xffff) << 16) | (i)))
+#endif
+
+struct par_root {
+	void *buf;
+	fhk_idx xi;
+	fhk_inst inst;
+	uint32_t n;
+};
+
+struct fhk_par {
+	struct fhk_graph *G;
+	arena **arenas;                    /* per-solve state, reset by each solve */
+	arena **sarenas;                   /* solvers */
+	fhk_solver **solvers;
+	fhk_status *status;
+	fhk_inst *shape;
+	struct par_root *roots;
+	uint32_t nthreads;
+	uint32_t nroot, rsize;
+};
+
+static fhk_status par_solve_part(struct fhk_par *P, uint32_t t, fhk_pdriver driver, void *udata);
+
+struct fhk_par *fhk_create_par(struct fhk_graph *G, uint32_t nthreads){
+	if(!nthreads)
+		return NULL;
+
+	struct fhk_par *P = malloc(sizeof(*P));
+	if(!P)
+		return NULL;
+
+	memset(P, 0, sizeof(*P));
+
+	P->G = G;
+	P->nthreads = nthreads;
+	P->rsize = PAR_RSIZE;
+	// zeroed so that fhk_destroy_par can clean up a partial create
+	P->arenas = calloc(nthreads, sizeof(*P->arenas));
+	P->sarenas = calloc(nthreads, sizeof(*P->sarenas));
+	P->solvers = calloc(nthreads, sizeof(*P->solvers));
+	P->status = malloc(nthreads * sizeof(*P->status));
+	P->shape = malloc(G->ng * sizeof(*P->shape));
+	P->roots = malloc(P->rsize * sizeof(*P->roots));
+	if(!(P->arenas && P->sarenas && P->solvers && P->status && P->shape && P->roots))
+		goto fail;
+
+	memset(P->shape, 0xff, G->ng * sizeof(*P->shape));
+
+	for(uint32_t i=0;i<nthreads;i++){
+		P->arenas[i] = arena_create(PAR_ARENASIZE);
+		P->sarenas[i] = arena_create(PAR_SARENASIZE);
+		if(!(P->arenas[i] && P->sarenas[i]))
+			goto fail;
+	}
+
+	return P;
+
+fail:
+	fhk_destroy_par(P);
+	return NULL;
+}
+
+void fhk_destroy_par(struct fhk_par *P){
+	for(uint32_t i=0;i<P->nthreads;i++){
+		if(P->arenas && P->arenas[i])
+			arena_destroy(P->arenas[i]);
+		if(P->sarenas && P->sarenas[i])
+			arena_destroy(P->sarenas[i]);
+	}
+
+	free(P->arenas);
+	free(P->sarenas);
+	free(P->solvers);
+	free(P->status);
+	free(P->shape);
+	free(P->roots);
+	free(P);
+}
+
+void fhkP_setshape(struct fhk_par *P, fhk_grp group, fhk_inst shape){
+	assert(group < P->G->ng);
+	P->shape[group] = shape;
+}
+
+fhk_ei fhkP_setroot(struct fhk_par *P, fhk_idx xi, fhk_subset ss, void *buf){
+	if(ss == PAR_EMPTYSET)
+		return 0;
+
+	if(!PAR_ISIVAL(ss))
+		return FHKE_NYI;
+
+	if(P->nroot == P->rsize){
+		struct par_root *roots = realloc(P->roots, 2 * P->rsize * sizeof(*P->roots));
+		if(!roots)
+			return FHKE_MEM;
+		P->roots = roots;
+		P->rsize *= 2;
+	}
+
+	struct par_root *r = &P->roots[P->nroot++];
+	r->buf = buf;
+	r->xi = xi;
+	r->inst = PAR_FIRST(ss);
+	r->n = PAR_N1(ss);
+
+	return 0;
+}
+
+void fhkP_clear(struct fhk_par *P){
+	P->nroot = 0;
+	memset(P->shape, 0xff, P->G->ng * sizeof(*P->shape));
+}
+
+// driver is called concurrently from all threads, each with its own solver, and must be
+// thread-safe. it returns nonzero to stop that thread's solver.
+// the return value is FHK_OK if every part solved, otherwise the first (by part) status
+// that stopped a solver: either an error or the request the driver refused.
+fhk_status fhkP_solve(struct fhk_par *P, fhk_pdriver driver, void *udata){
+#pragma omp parallel for num_threads(P->nthreads) schedule(static,1)
+	for(uint32_t t=0;t<P->nthreads;t++)
+		P->status[t] = par_solve_part(P, t, driver, udata);
+
+	for(uint32_t t=0;t<P->nthreads;t++){
+		if(P->status[t] != FHK_OK)
+			return P->status[t];
+	}
+
+	return FHK_OK;
+}
+
+static fhk_status par_solve_part(struct fhk_par *P, uint32_t t, fhk_pdriver driver, void *udata){
+	struct fhk_graph *G = P->G;
+	uint64_t nt = P->nthreads;
+	bool work = false;
+
+	fhk_solver *S = P->solvers[t];
+	if(!S && !(S = P->solvers[t] = fhk_create_solver(G, P->sarenas[t])))
+		return PAR_EMEM;
+
+	arena_reset(P->arenas[t]);
+	if(!fhk_reset_solver(S, P->arenas[t]))
+		return PAR_EMEM;
+
+	for(xgrp g=0;g<G->ng;g++){
+		if(P->shape[g] != PAR_NOSHAPE)
+			fhkS_setshape(S, g, P->shape[g]);
+	}
+
+	for(uint32_t i=0;i<P->nroot;i++){
+		struct par_root *r = &P->roots[i];
+		uint32_t start = r->n*(uint64_t)t/nt;
+		uint32_t end = r->n*(uint64_t)(t+1)/nt;
+
+		if(start == end)
+			continue;
+
+		fhkS_setroot(S, r->xi, PAR_IVAL(r->inst+start, end-start),
+				(char *) r->buf + start*G->vars[r->xi].size);
+		work = true;
+	}
+
+	if(!work)
+		return FHK_OK;
+
+	for(;;){
+		fhk_status status = fhk_continue(S);
+
+		if(FHK_CODE(status) == FHK_OK || FHK_CODE(status) == FHK_ERROR)
+			return status;
+
+		if(driver(udata, S, status))
+			return status;
+	}
+}
@@ -8,10 +8,16 @@
 #include <stdint.h>
 #include <stdalign.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
 #include <float.h>
+#include <setjmp.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // TODO: benchmark u32 comparisons @ candidate selector
 
@@ -24,6 +30,7 @@
 #define SBUF_MIN_BITS  16          /* first scratch buffer size */
 #define SBUF_ALIGN     8           /* alignment of scratch mem allocations */
 #define NUM_ROOTBUF    32           /* initial root queue size */
+#define NUM_PLAN       8           /* number of cached root sets per plan */
 
 #if FHK_DEBUG
 #define AINLINE
@@ -37,17 +44,81 @@
 #define SARG(...)        (((fhk_sarg){__VA_ARGS__}).u64 << 16)
 
 // see fhk.h for subset representation
+#ifdef FHK_WIDEINST
+
+typedef uint64_t ssival;                               /* complex subset interval */
+
+#define SS_UNDEF         ((fhk_subset)(~0ull))         /* all ones. this excludes any valid interval,
+													    * because first should be <= G_MAXINST */
+#define SS_EMPTYSET      0x100000000ll                 /* empty set (remain=-1) */
+#define SS_ISEMPTY(ss)   ((ss) == SS_EMPTYSET)         /* is it empty? */
+#define SS_ISCOMPLEX(ss) ((int64_t)(ss) > SS_EMPTYSET) /* is it complex? (implies nonempty) */
+#define SS_ISIVAL(ss)    ((int64_t)(ss) < 0)           /* is it a nonempty interval? */
+#define SS_CPTR(ss)      ((ssival*)((ss) >> 16))       /* complex subset interval pointer */
+#define SS_CIVAL(ss,n)   (SS_CPTR(ss)[n])              /* nth interval */
+#define SS_CNUMI(ss)     ((ss) & 0xffff)               /* num of *remaining* ivals, 0 is valid */
+#define SS_IIVAL(ss)     ((ssiter)PK_FIRST(ss) - ((ssiter)PK_N(ss) << 32)) /* interval iterator */
+#define SS_PKIVAL(i,n)   ((fhk_subset)((1ull << 63) | (((uint64_t)(1-(n)) & 0x7fffffff) << 32) | (i)))
+#define SS_IVEQ(a,b)     ((a) == (b))                  /* same interval? */
+
+// these also work on complex intervals, which have a 32-bit size and no tag bit.
+#define PK_FIRST(pki)    ((pki) & 0xffffffff)          /* first instance in packed range */
+#define PK_N(pki)        ((-((pki) >> 32)) & 0x7fffffff) /* exclusive (0x7fffffff for empty set) */
+#define PK_NS(pki)       (-((int64_t)((uint64_t)(pki) << 1) >> 33)) /* signed version of PK_N */
+#define PK_N1(pki)       ((1-((pki) >> 32)) & 0x7fffffff) /* inclusive (0 for empty set) */
+
+// packed iterator representation, see below. with wide instances this doesn't fit in 64 bits.
+//
+// +--------------+----------------+--------------+-----------+--------------+------------+
+// | 8 (127..120) | 32 (119..88)   | 23 (87..65)  | 1 (64)    | 32 (63..32)  | 32 (31..0) |
+// +--------------+----------------+--------------+-----------+--------------+------------+
+// | map index    | map instance   | hint         | more ivs  | -remaining   | current    |
+// +--------------+----------------+--------------+-----------+--------------+------------+
+typedef unsigned __int128 ssiter __attribute__((aligned(8))); /* keep solver alignment */
+
+#define SI_HINT_BITS        (127-3*G_INSTBITS-G_UMAPBITS) /* num of low bits of interval to store */
+#define SI_INST(it)         ((uint64_t)(it) & 0xffffffff) /* current instance */
+#define SI_REM(it)          (((uint64_t)(it) >> 32) & 0xffffffff) /* remaining counter */
+#define SI_MAP(it)          (((int64_t)((it) >> 64)) >> (64-G_UMAPBITS)) /* associated mapping (signed) */
+#define SI_MAP_INST(it)     (((uint64_t)((it) >> 64) >> (64-G_UMAPBITS-G_INSTBITS)) & 0xffffffff) /* instance of mapping */
+#define SI_HINT(it)         (((uint64_t)((it) >> 65)) & ((1<<SI_HINT_BITS)-1)) /* low bits of interval number */
+#define SI_INCR             (((ssiter)1 << 32) | 1)   /* increment current and decrement remaining */
+#define SI_NEXTMASK         ((ssiter)0xffffffff00000000ull) /* nonzero remaining? */
+#define SI_NEXTIMASK        ((ssiter)1 << 64)         /* more intervals left? */
+
+// complex iterator construction.
+// the interval is added, not or'd: -remaining borrows from the upper bits, and the carry
+// from the last increment gives it back, so the upper bits are intact after the interval.
+#define SI_CFIRST(map,inst,pki,more) ( \
+		(((ssiter)(map) << (128-G_UMAPBITS)) \
+		| ((ssiter)(inst) << (128-G_UMAPBITS-G_INSTBITS)) \
+		| ((ssiter)1 << 65) \
+		| ((ssiter)(more) << 64)) \
+		+ PK_FIRST(pki) - ((ssiter)PK_N(pki) << 32) )
+
+// next interval of complex iterator
+#define SI_CNEXT(it,hint,last,pki) ( \
+		(((it) & ((~(ssiter)0) << (128-G_UMAPBITS-G_INSTBITS))) \
+		| ((((ssiter)(hint)) & ((1ULL<<SI_HINT_BITS)-1)) << 65) \
+		| ((ssiter)!(last) << 64)) \
+		+ PK_FIRST(pki) - ((ssiter)PK_N(pki) << 32) )
+
+#else
+
+typedef uint32_t ssival;                               /* complex subset interval */
+
 #define SS_UNDEF         ((fhk_subset)(~0ull))         /* all ones. this excludes any valid interval,
 													    * because first should be non-negative */
 #define SS_EMPTYSET      0x00010000                    /* empty set (remain=-1) */
 #define SS_ISEMPTY(ss)   ((ss) == SS_EMPTYSET)         /* is it empty? */
 #define SS_ISCOMPLEX(ss) ((int64_t)(ss) > SS_EMPTYSET) /* is it complex? (implies nonempty) */
 #define SS_ISIVAL(ss)    ((int64_t)(ss) < 0)           /* is it a nonempty interval? */
-#define SS_CPTR(ss)      ((uint32_t*)((ss) >> 16))     /* complex subset interval pointer */
+#define SS_CPTR(ss)      ((ssival*)((ss) >> 16))       /* complex subset interval pointer */
 #define SS_CIVAL(ss,n)   (SS_CPTR(ss)[n])              /* nth interval */
 #define SS_CNUMI(ss)     ((ss) & 0xffff)               /* num of *remaining* ivals, 0 is valid */
 #define SS_IIVAL(ss)     ((ssiter)(ss))                /* you can just use this as an iterator */
-#define SS_PKIVAL(i,n)   (((~(n)) << 16) + (i) + 0xfffffffc00020000ull) /* pack interval */
+#define SS_PKIVAL(i,n)   (((~(uint64_t)(n)) << 16) + (i) + 0xfffffffc00020000ull) /* pack interval */
+#define SS_IVEQ(a,b)     ((uint32_t)(a) == (uint32_t)(b)) /* same interval? (ignores mark) */
 
 #define PK_FIRST(pki)    ((pki) & 0xffff)              /* first instance in packed range */
 #define PK_N(pki)        ((-((pki) >> 16)) & 0xffff)   /* exclusive (0xffff for empty set) */
@@ -60,7 +131,7 @@
 // +------------+-------------+------------+----------+--------------+------------+
 // | 8 (63..56) | 16 (55..40) | 7 (39..33) | 1 (32)   | 16 (31..16)  | 16 (15..0) |
 // +------------+-------------+------------+----------+--------------+------------+
-// | map        | map         | next       | last     | -remaining   | current    |
+// | map        | map         | next       | more     | -remaining   | current    |
 // | index      | instance    | interval   | interval | instances    | instance   |
 // |            |             | hint       | marker   | in interval  |            |
 // +------------+-------------+------------+----------+--------------+------------+
@@ -73,24 +144,31 @@ typedef uint64_t ssiter;
 #define SI_REM(it)          (((it) >> 16) & 0xffff) /* remaining counter */
 #define SI_MAP(it)          (((int64_t)(it)) >> (64-G_UMAPBITS)) /* associated mapping (signed) */
 #define SI_MAP_INST(it)     (((it) >> (48-G_UMAPBITS)) & 0xffff) /* instance of mapping */
-#define SI_HINT(it)         (((it) >> 33) & ~((1<<SI_HINT_BITS)-1)) /* low bits of interval number */
+#define SI_HINT(it)         (((it) >> 33) & ((1<<SI_HINT_BITS)-1)) /* low bits of interval number */
 #define SI_INCR             0x00010001              /* increment current and decrement remaining */
 #define SI_NEXTMASK         0xffff0000              /* nonzero remaining? */
 #define SI_NEXTIMASK        0x100000000ull          /* more intervals left? */
 
-static_assert(G_UMAPBITS+G_INSTBITS+SI_HINT_BITS+1+G_INSTBITS+G_INSTBITS == 8*sizeof(ssiter));
-
-// complex iterator construction
-#define SI_CFIRST(map,inst,pki) ( \
-		((ssiter)(map) << (64-G_UMAPBITS)) \
+// complex iterator construction.
+// the interval is added, not or'd: -remaining borrows from the upper bits, and the carry
+// from the last increment gives it back, so the upper bits are intact after the interval.
+#define SI_CFIRST(map,inst,pki,more) ( \
+		(((ssiter)(map) << (64-G_UMAPBITS)) \
 		| ((ssiter)(inst) << (48-G_UMAPBITS)) \
-		| (pki) )
+		| (1ULL << 33) \
+		| ((ssiter)(more) << 32)) \
+		+ PK_FIRST(pki) - ((ssiter)PK_N(pki) << 16) )
 
 // next interval of complex iterator
 #define SI_CNEXT(it,hint,last,pki) ( \
-		((it) & ((~0ull) << (48-G_UMAPBITS))) \
+		(((it) & ((~0ull) << (48-G_UMAPBITS))) \
 		| ((((ssiter)(hint)) & ((1ULL<<SI_HINT_BITS)-1)) << 33) \
-		| (pki) )
+		| ((ssiter)!(last) << 32)) \
+		+ PK_FIRST(pki) - ((ssiter)PK_N(pki) << 16) )
+
+#endif
+
+static_assert(G_UMAPBITS+G_INSTBITS+SI_HINT_BITS+1+G_INSTBITS+G_INSTBITS == 8*sizeof(ssiter));
 
 // unfortunately compilers generate confused code with an inline function so you're going
 // to have to use this to iterate.
@@ -133,7 +211,7 @@ typedef struct {
 // +-------------+-------------+-------------------+
 typedef uintptr_t ssiter3p;
 
-#define SI3P_IINCR 0x3ffff /* decrement nonzero iv num, increment iv pointer by 4 */
+#define SI3P_IINCR ((sizeof(ssival) << 16) - 1) /* decrement nonzero iv num, increment iv pointer */
 #define SI3_NEXTI(it,inst,num) \
 	{ \
 		if(UNLIKELY(it & 0xffff)) { si3_cnexti(&it, &inst, &num); continue; } \
@@ -172,6 +250,20 @@ typedef uintptr_t ssiter3p;
 // note: the most important invariant the solver maintains is that sp->cost is always a valid
 // lower bound, regardless of search state/rounding errors/cycles/whatever, it is ALWAYS
 // true that truecost >= sp->cost, for both variables and models.
+//
+// with FHK_WIDEINST, the chain instance doesn't fit in the state, so it gets its own field.
+#ifdef FHK_WIDEINST
+typedef struct {
+	union {
+		struct {
+			float cost;
+			uint32_t state;
+		};
+		uint64_t u64;
+	};
+	fhk_inst inst;
+} ssp;
+#else
 typedef union {
 	struct {
 		float cost;
@@ -179,13 +271,21 @@ typedef union {
 	};
 	uint64_t u64;
 } ssp;
+#endif
 
 #define SP_CHAIN              (1ULL << 31)
 #define SP_VALUE              (1ULL << 30)
 #define SP_EXPANDED           (1ULL << 29)
-#define SP_CHAIN_V(e,i)       (SP_EXPANDED|SP_CHAIN|((e)<<16)|(i)) /* chain always implies expanded */
 #define SP_CHAIN_EI(sp)       (((sp).state >> 16) & 0xff)
+#ifdef FHK_WIDEINST
+#define SP_CHAIN_V(e)         (SP_EXPANDED|SP_CHAIN|((e)<<16)) /* chain always implies expanded */
+#define SP_SETCHAIN(sp,e,i)   ((sp)->state = SP_CHAIN_V(e), (sp)->inst = (i))
+#define SP_CHAIN_INSTANCE(sp) ((sp).inst)
+#else
+#define SP_CHAIN_V(e,i)       (SP_EXPANDED|SP_CHAIN|((e)<<16)|(i)) /* chain always implies expanded */
+#define SP_SETCHAIN(sp,e,i)   ((sp)->state = SP_CHAIN_V(e,i))
 #define SP_CHAIN_INSTANCE(sp) ((sp).state & 0xffff)
+#endif
 #define SP_DONEMASK           ((SP_CHAIN << 32) | 0x7fffffffull)
 #define SP_UMAXCOST           ((union { uint32_t u32; float f; }){.f=MAX_COST}).u32
 #define SP_DONE(sp)           (((sp).u64 & SP_DONEMASK) >= SP_UMAXCOST)
@@ -207,6 +307,8 @@ typedef uint64_t bitmap;
 #define SW_EVAL          2
 #define SW_BMIDX(inst)   ((inst)>>5)
 #define SW_BMOFF(inst)   (((inst)<<1)&0x3f)
+#define SW_WORDINST      32                       /* instances per bitmap word */
+#define SW_EVALALL       0xaaaaaaaaaaaaaaaaull    /* SW_EVAL for every instance of a word */
 
 #define XS_PARAM     0
 #define XS_SHADOW    1
@@ -277,6 +379,63 @@ typedef union {
 	fhk_subset kmap;
 } anymap;
 
+// computed variable whose value buffer is a caller's root buffer (see fhkS_setroot)
+struct vborrow {
+	struct vborrow *next;
+	xidx xi;
+};
+
+// chain plans. the chain search is a deterministic function of the roots, the mappings
+// (including shapes) and the guard results it sees: given values are either there or the
+// solve fails, and costs are static. so a plan records, for a root set, every mapping and
+// guard result the search used together with the selected chains. when the same root set
+// comes again, the mappings and guards are re-evaluated and compared, and if they all
+// match, the chains are restored as-is and the search is skipped.
+// only searches whose guards all read given variables are recorded, see S_plan_record.
+//
+// complex subsets are copied into `ivals`, plan_map.ival is the offset.
+
+struct plan_root {
+	fhk_idx xi;
+	fhk_inst inst;
+	fhk_inst end;
+};
+
+struct plan_map {
+	fhk_subset ss;
+	uint32_t ival;
+	fhk_inst inst;
+	fhk_map map;
+};
+
+struct plan_sp {
+	ssp sp;                    // search state, SP_VALUE cleared
+	fhk_idx idx;               // var or model
+	fhk_inst inst;
+};
+
+struct plan_guard {
+	fhk_idx wi;
+	fhk_inst inst;
+	uint8_t state;             // SW_EVAL, maybe SW_PASS
+};
+
+struct plan_ent {
+	struct plan_root *roots;   // NULL if unused
+	struct plan_map *maps;
+	struct plan_sp *sps;
+	struct plan_guard *guards;
+	ssival *ivals;
+	uint32_t nroot, nmap, nsp, nguard, nival;
+};
+
+struct fhk_plan {
+	struct fhk_graph *G;
+	fhk_pstats stats;
+	uint32_t next;             // next entry to replace
+	struct plan_ent ent[NUM_PLAN];
+};
+
 // note: scratch buffers are used for temp memory to pass complex subsets outside the solver
 // (into model caller). each consecutive scratch buffer doubles in size (except
 // the first two, which are equal in size). for example, if SBUF_MIN_BITS=4 then
@@ -307,8 +466,18 @@ struct fhk_solver {
 	// uint16_t unused
 	struct rootv *r_buf;       // root queue
 	bitmap *bm0_intern;        // interned all-0 bitmap
+	struct fhk_plan *plan;     // chain plan cache (first root batch only)
+	struct fhk_direct *direct; // direct callbacks (inside fhk_solve only)
+	uint32_t *m_bgen;          // root batch each model last gathered a batched call in
+	uint32_t r_gen;            // root batch counter
+	struct vborrow *v_borrow;  // value buffers that are root buffers
+#ifdef FHK_WIDEINST
+	fhk_vref j_vref;           // FHKS_VREF argument
+	fhk_eref j_mapcall;        // FHKS_MAPCALL argument
+#endif
 #if FHK_CO_BUILTIN
 	fhk_status e_status;       // exit status
+	void *co_stack;            // coroutine stack (bottom)
 #endif
 	union {                    // note: these all share the same indexing (all are variable-like)
 		ssp *s_vstate[0];      // computed variable search state: see comment on `ssp`
@@ -319,11 +488,28 @@ struct fhk_solver {
 
 static_assert(offsetof(struct fhk_solver, C) == 0);
 
+// fhk_solve state. this lives on the caller's stack for the duration of the solve.
+struct fhk_direct {
+	const fhk_cb *cb;
+	void *udata;
+	fhk_status status;         // exit status, or pending error from the api
+	jmp_buf exit;
+};
+
 #define RBUF(mi,m,inst)  (((void **) S->s_value[(mi)]) + (inst)*(m)->p_return)
 
+// request arguments, see fhk_sarg. these access `S`.
+#ifdef FHK_WIDEINST
+#define J_VREFARG(x,i,n)   (S->j_vref = (fhk_vref){.idx=(x), .inst=(i), .num=(n)}, &S->j_vref)
+#define J_MAPARG(m,i)      (S->j_mapcall = (fhk_eref){.idx=(m), .inst=(i)}, &S->j_mapcall)
+#else
+#define J_VREFARG(x,i,n)   ((fhk_vref){.idx=(x), .inst=(i), .num=(n)})
+#define J_MAPARG(m,i)      ((fhk_eref){.idx=(m), .inst=(i)})
+#endif
+
 static void J_shape(struct fhk_solver *S, xgrp group);
 static void J_mapcall(struct fhk_solver *S, xmap map, xinst inst);
-static void J_vref(struct fhk_solver *S, xidx xi, xinst inst);
+static void J_vref(struct fhk_solver *S, xidx xi, xinst inst, xinst end);
 static void J_modcall(struct fhk_solver *S, fhk_modcall *mc);
 
 static void JE_maxdepth(struct fhk_solver *S, xidx xi, xinst inst);
@@ -334,10 +520,21 @@ static void JE_nbuf(struct fhk_solver *S);
 static void JE_nchain(struct fhk_solver *S, xidx xi, xinst inst);
 
 static void J_exit(struct fhk_solver *S, fhk_status status);
+static void J_return(struct fhk_solver *S, int32_t stop, fhk_status status);
 
 static void E_exit(struct fhk_solver *S, fhk_status status);
+static bool E_exited(struct fhk_solver *S, fhk_status *status);
 
 static void S_solve(struct fhk_solver *S);
+static void S_solve_roots(struct fhk_solver *S);
+static bool S_plan_replay(struct fhk_solver *S, struct rootv *roots, uint32_t num);
+static void S_plan_record(struct fhk_solver *S, struct rootv *roots, uint32_t num);
+static void S_reset_search(struct fhk_solver *S);
+static void S_invalidate_fwd(struct fhk_solver *S, xidx xi, xinst inst);
+static void S_invalidate_model(struct fhk_solver *S, xidx mi, xinst m_inst);
+static bool S_guards_stale(struct fhk_solver *S);
+static void S_unborrow(struct fhk_solver *S);
+static fhk_subset S_knownmap(struct fhk_solver *S, xmap map, xinst inst, xgrp group);
 
 static void S_vexpandbe(struct fhk_solver *S, xidx xi, xinst inst);
 static void S_mexpandbe(struct fhk_solver *S, xidx mi, xinst inst);
@@ -357,13 +554,17 @@ static void S_checkscan(struct fhk_solver *S, bitmap *bm, struct fhk_shadow *w,
 		xinst end);
 
 static void S_get_given(struct fhk_solver *S, xidx xi, xmap map, xinst inst);
-static bitmap *S_touch_vmstate(struct fhk_solver *S, xidx xi, xinst inst);
+static bitmap *S_touch_vmstate(struct fhk_solver *S, xidx xi, xinst inst, xinst end);
 static void S_get_missingi(struct fhk_solver *S, xidx xi, xinst inst, xinst end, bitmap *missing);
 static void S_get_given1(struct fhk_solver *S, xidx xi, xinst inst);
 static void S_get_given_si3(struct fhk_solver *S, xidx xi, ssiter3p ip, xinst inst, xinst num);
 static void S_get_giveni(struct fhk_solver *S, xidx xi, xinst inst, xinst end);
 
 static void S_compute_value(struct fhk_solver *S, xidx xi, xinst inst);
+static void S_compute_batch(struct fhk_solver *S, xidx mi);
+static void S_batch_call(struct fhk_solver *S, xidx mi, fhk_inst *insts, xinst ni, xinst m_inst);
+static bool S_batch_ready(struct fhk_solver *S, xidx mi, struct fhk_model *m, ssp m_sp,
+		xinst inst);
 static void S_get_computed_si(struct fhk_solver *S, ssiter it, xidx xi);
 
 static void S_mapE_collect(struct fhk_solver *S, fhk_mcedge *e, xidx xi, xmap map, xinst m_inst);
@@ -397,9 +598,16 @@ static bitmap *bm_getall0(struct fhk_solver *S, xinst n);
 static void bm_cleari(bitmap *bm, xinst inst, xinst num);
 static bool bm_isset(bitmap *b, xinst inst);
 static bool bm_findi(bitmap *bm, xinst *inst, xinst end);
+static xinst bm_findz(bitmap *bm, xinst inst, xinst end);
 
 static ssp *ssp_alloc(struct fhk_solver *S, size_t n, ssp init);
 
+static struct plan_ent *plan_find(struct fhk_plan *P, struct rootv *roots, uint32_t num);
+static bool plan_record_map(struct plan_ent *e, xmap map, xinst inst, fhk_subset ss);
+static bool plan_sseq(struct plan_ent *e, struct plan_map *pm, fhk_subset ss);
+static void *plan_push(void *p, uint32_t n, size_t size);
+static void plan_clear(struct plan_ent *e);
+
 static const char *dstrvalue(struct fhk_solver *S, xidx xi, xinst inst);
 
 fhk_solver *fhk_create_solver(struct fhk_graph *G, arena *arena){
@@ -407,30 +615,65 @@ fhk_solver *fhk_create_solver(struct fhk_graph *G, arena *arena){
 	// if this is changed then aligning needs to be done more carefully.
 	static_assert(alignof(struct fhk_solver) == alignof(void *));
 
-	// lazy use of memset. change the init code if you change the constant.
-	static_assert((uint64_t)SS_UNDEF == 0xffffffffffffffffull);
-
 #if FHK_CO_BUILTIN
 	// TODO: this should probably not allocate it on the arena, instead mmap a stack
 	// with a guard page. now stack overflows can corrupt the arena.
 	void *stack = arena_alloc(arena, MAX_COSTACK, COSTACK_ALIGN);
+	if(!stack)
+		return NULL;
 #endif
 	
 	struct fhk_solver *S = arena_alloc(arena, sizeof(void *)*(G->nx+G->nm)+sizeof(*S), alignof(*S));
+	void **value = arena_alloc(arena, (G->nv+G->nm) * sizeof(*S->s_value), alignof(*S->s_value));
+	anymap *mapstate = arena_alloc(arena, (G->nimap+G->nkmap) * sizeof(*S->s_mapstate),
+			alignof(*S->s_mapstate));
+	void *sbuf = arena_alloc(arena, 1 << SBUF_MIN_BITS, SBUF_ALIGN);
+	if(!(S && value && mapstate && sbuf))
+		return NULL;
+
 	S = (void *)S + G->nm * sizeof(*S->s_mstate);
-	S->s_value = G->nm + (void **) arena_alloc(arena, (G->nv+G->nm) * sizeof(*S->s_value),
-			alignof(*S->s_value));
-	S->s_mapstate = G->nimap + (anymap *) arena_alloc(arena,
-			(G->nimap+G->nkmap) * sizeof(*S->s_mapstate), alignof(*S->s_mapstate));
-	S->r_buf = arena_alloc(arena, NUM_ROOTBUF * sizeof(*S->r_buf), alignof(*S->r_buf));
-	S->b_mem[0] = arena_alloc(arena, 1 << SBUF_MIN_BITS, SBUF_ALIGN);
+	S->s_value = G->nm + value;
+	S->s_mapstate = G->nimap + mapstate;
+	S->b_mem[0] = sbuf;
 
 	S->G = G;
+
+#if FHK_CO_BUILTIN
+	S->co_stack = stack;
+#else
+	S->C.co = NULL;
+#endif
+
+	if(!fhk_reset_solver(S, arena))
+		return NULL;
+
+	return S;
+}
+
+// reset the solver to the state fhk_create_solver returns, keeping the solver itself, its
+// coroutine stack and the first scratch buffer. everything else the solve allocates (search
+// state, value buffers, root queue, ...) comes from `arena` after this, so `arena` can be
+// reset between solves. the arena the solver was created on must outlive the solver.
+// any pointers obtained from the previous solve (eg. fhkI_value) are invalid after this.
+// returns false if `arena` is out of memory, the solver can't be used until a reset succeeds.
+bool fhk_reset_solver(struct fhk_solver *S, arena *arena){
+	// lazy use of memset. change the init code if you change the constant.
+	static_assert((uint64_t)SS_UNDEF == 0xffffffffffffffffull);
+
+	struct fhk_graph *G = S->G;
+
 	S->arena = arena;
+	S->r_buf = arena_alloc(arena, NUM_ROOTBUF * sizeof(*S->r_buf), alignof(*S->r_buf));
+	S->m_bgen = arena_alloc(arena, G->nm * sizeof(*S->m_bgen), alignof(*S->m_bgen));
+	if(!(S->r_buf && S->m_bgen))
+		return false;
 
 #if FHK_CO_BUILTIN
-	fhk_co_init(&S->C, stack, MAX_COSTACK, &S_solve);
+	fhk_co_init(&S->C, S->co_stack, MAX_COSTACK, &S_solve);
 #else
+	// unfinished solve, the coroutine is still alive
+	if(S->C.co)
+		fhk_co_done(&S->C);
 	fhk_co_init(&S->C, MAX_COSTACK, &S_solve);
 #endif
 
@@ -439,6 +682,7 @@ fhk_solver *fhk_create_solver(struct fhk_graph *G, arena *arena){
 	memset(S->s_mapstate - G->nimap, 0xff, (G->nimap+G->nkmap) * sizeof(*S->s_mapstate));
 	memset(S->s_value - G->nm, 0, (G->nv+G->nm) * sizeof(*S->s_value));
 	memset(S->b_mem+1, 0, (NUM_SBUF-1) * sizeof(*S->b_mem));
+	memset(S->m_bgen, 0, G->nm * sizeof(*S->m_bgen));
 
 	S->x_state->where = XS_DONE;
 	S->x_state->x_cands = 0;
@@ -447,8 +691,76 @@ fhk_solver *fhk_create_solver(struct fhk_graph *G, arena *arena){
 	S->r_num = 0;
 	S->r_size = NUM_ROOTBUF;
 	S->bm0_size = 0;
+	S->plan = NULL;
+	S->direct = NULL;
+	S->r_gen = 0;
+	S->v_borrow = NULL;
+#if FHK_CO_BUILTIN
+	S->e_status = 0;
+#endif
 
-	return S;
+	return true;
+}
+
+// solve the queued roots without the coroutine: requests go straight to the callbacks in `cb`,
+// which are called on the caller's stack. returns FHK_OK when all roots are solved, otherwise
+// the error, or the request the callback stopped on.
+// this can be mixed with fhk_continue between solves (ie. when fhk_continue would return
+// FHK_OK), but not in the middle of one. a solve that didn't finish can't be resumed, any
+// later fhk_solve or fhk_continue returns the same status.
+fhk_status fhk_solve(struct fhk_solver *S, const fhk_cb *cb, void *udata){
+	fhk_status status;
+
+	if(UNLIKELY(E_exited(S, &status)))
+		return status;
+
+	struct fhk_direct D = { .cb = cb, .udata = udata, .status = 0 };
+	S->direct = &D;
+
+	if(LIKELY(!setjmp(D.exit))){
+		S_solve_roots(S);
+		S->direct = NULL;
+		return FHK_OK;
+	}
+
+	// unwound from J_exit, the search state is no longer consistent.
+	status = S->direct->status;
+	S->direct = NULL;
+	E_exit(S, status);
+	return status;
+}
+
+struct fhk_plan *fhk_create_plan(struct fhk_graph *G){
+	struct fhk_plan *P = malloc(sizeof(*P));
+	if(!P)
+		return NULL;
+
+	memset(P, 0, sizeof(*P));
+	P->G = G;
+	return P;
+}
+
+void fhk_destroy_plan(struct fhk_plan *P){
+	for(uint32_t i=0;i<NUM_PLAN;i++)
+		plan_clear(&P->ent[i]);
+
+	free(P);
+}
+
+fhk_pstats fhk_plan_stats(struct fhk_plan *P){
+	return P->stats;
+}
+
+// use the plan cache P for the first root batch, ie. the roots set before the first
+// fhk_continue. the plan may be shared between solvers on the same graph, but not
+// between threads.
+void fhkS_setplan(struct fhk_solver *S, struct fhk_plan *P){
+	if(UNLIKELY(P && P->G != S->G)){
+		E_exit(S, FHK_ERROR | SARG(.s_ei = FHKE_INVAL));
+		return;
+	}
+
+	S->plan = P;
 }
 
 static void fhkS_setrooti(struct fhk_solver *S, xidx xi, xinst inst, xinst num, void *buf,
@@ -494,8 +806,20 @@ void fhkS_setroot(struct fhk_solver *S, fhk_idx xi, fhk_subset ss, void *buf){
 		// if the subset is the entire space and we haven't allocated a value buffer yet,
 		// then use buf directly as the buffer to save copies.
 		// note: this means you must not modify buf as long as the solver is active
-		if((uint32_t)S->s_mapstate[x->group].kmap == (uint32_t)ss && !S->s_value[xi])
-			S->s_value[xi] = buf;
+		if(SS_IVEQ(S->s_mapstate[x->group].kmap, ss) && !S->s_value[xi]){
+			if(V_GIVEN(x)){
+				S->s_value[xi] = buf;
+			}else{
+				// remembered so that fhkS_invalidate can move the values off it
+				struct vborrow *b = arena_alloc(S->arena, sizeof(*b), alignof(*b));
+				if(LIKELY(b)){
+					b->next = S->v_borrow;
+					b->xi = xi;
+					S->v_borrow = b;
+					S->s_value[xi] = buf;
+				}
+			}
+		}
 
 		xinst inst = PK_FIRST(ss);
 		fhkS_setrooti(S, xi, inst, PK_N1(ss), buf, flags);
@@ -615,6 +939,104 @@ fail:
 	E_exit(S, FHK_ERROR | SARG(.s_ei = FHKE_INVAL | E_META(1, P, emap) | E_META(2, J, inst)));
 }
 
+// mark the values of xi:ss, and everything computed from them through the selected chains,
+// stale. the next solve recomputes them with the same chains. given instances become missing,
+// so they must be given again (fhkS_setvaluei or FHKS_VREF).
+// chains are only kept if no guard that was evaluated during the search depends on a stale
+// value. otherwise the chains (and their costs) may no longer be valid, and the whole search
+// state is forgotten: everything computed is recomputed, but given values and mappings are kept.
+// recomputed values are not written into root buffers of earlier solves: values the solver kept
+// in a root buffer are copied out of it here, so the buffer must still be valid at this point,
+// and is left alone after it.
+// call this between solves only, ie. when fhk_continue has returned FHK_OK.
+void fhkS_invalidate(struct fhk_solver *S, fhk_idx xi, fhk_subset ss){
+	if(UNLIKELY(xi < 0 || xi >= S->G->nv)) goto fail;
+	if(UNLIKELY(SS_ISEMPTY(ss))) return;
+
+	struct fhk_var *x = &S->G->vars[xi];
+	fhk_subset space = S->s_mapstate[x->group].kmap;
+
+	// no shape means no values
+	if(UNLIKELY(space == SS_UNDEF)) return;
+
+	xinst shape = PK_N1(space);
+	ssiter3p ip;
+	xinst inst, num;
+
+	si3_ss(ss, &ip, &inst, &num);
+	for(;;){
+		if(UNLIKELY(inst+num > shape)) goto fail;
+		SI3_NEXTI(ip, inst, num);
+	}
+
+	if(S->v_borrow)
+		S_unborrow(S);
+
+	if(V_GIVEN(x)){
+		bitmap *missing = S->s_vmstate[xi];
+		if(!missing) return;
+
+		bool all = SS_ISIVAL(ss) && SS_IVEQ(space, ss);
+
+		if(!all){
+			// the value buffer may be the caller's (see fhkS_setvaluei) and the bitmap may be
+			// the interned all-0 bitmap, so we must make our own copies before writing.
+			bitmap *bm = bm_alloc(S, shape, 0);
+			memcpy(bm, missing, ALIGN(shape, 64) / 8);
+			void *vp = arena_alloc(S->arena, shape*x->size, x->size);
+			memcpy(vp, S->s_value[xi], shape*x->size);
+			S->s_vmstate[xi] = bm;
+			S->s_value[xi] = vp;
+		}
+
+		si3_ss(ss, &ip, &inst, &num);
+		for(;;){
+			for(xinst i=inst;i<inst+num;i++){
+				if(bm_isset(missing, i))
+					continue;
+				if(!all)
+					S->s_vmstate[xi][i >> 6] |= 1ULL << (i & 0x3f);
+				S_invalidate_fwd(S, xi, i);
+			}
+			SI3_NEXTI(ip, inst, num);
+		}
+
+		// back to the state before any values were given, so the fast path of
+		// fhkS_setvaluei works again.
+		if(all){
+			S->s_vmstate[xi] = NULL;
+			S->s_value[xi] = NULL;
+		}
+	}else{
+		ssp *sp = S->s_vstate[xi];
+		if(!sp) return;
+
+		si3_ss(ss, &ip, &inst, &num);
+		for(;;){
+			for(xinst i=inst;i<inst+num;i++){
+				if(!(sp[i].state & SP_VALUE))
+					continue;
+				// the model must be called again, this also invalidates xi:i
+				// and the model's other returns.
+				S_invalidate_model(S, x->models[SP_CHAIN_EI(sp[i])].idx, SP_CHAIN_INSTANCE(sp[i]));
+			}
+			SI3_NEXTI(ip, inst, num);
+		}
+	}
+
+	dv("%s -- invalidated\n", fhk_dsym(S->G, xi));
+
+	if(S_guards_stale(S)){
+		dv("stale guard, forget chains\n");
+		S_reset_search(S);
+	}
+
+	return;
+
+fail:
+	E_exit(S, FHK_ERROR | SARG(.s_ei = FHKE_INVAL | E_META(1, I, xi)));
+}
+
 // inspection functions - use these for debugging only, they expose solver internals and are slow
 
 float fhkI_cost(struct fhk_solver *S, fhk_idx idx, fhk_inst inst){
@@ -678,22 +1100,45 @@ struct fhk_graph *fhkI_G(struct fhk_solver *S){
 
 AINLINE static void J_shape(struct fhk_solver *S, xgrp group){
 	dv("-> SHAPE   %lu\n", group);
-	fhkJ_yield(&S->C, FHKS_SHAPE | SARG(.s_group=group));
+	if(S->direct)
+		J_return(S, S->direct->cb->shape(S->direct->udata, S, group), FHKS_SHAPE | SARG(.s_group=group));
+	else
+		fhkJ_yield(&S->C, FHKS_SHAPE | SARG(.s_group=group));
 }
 
 AINLINE static void J_mapcall(struct fhk_solver *S, xmap map, xinst inst){
 	dv("-> MAPCALL %ld:%lu\n", map, inst);
-	fhkJ_yield(&S->C, FHKS_MAPCALL | SARG(.s_mapcall={.idx=map, .inst=inst}));
+	if(S->direct)
+		J_return(S, S->direct->cb->mapcall(S->direct->udata, S, map, inst),
+				FHKS_MAPCALL | SARG(.s_mapcall=J_MAPARG(map, inst)));
+	else
+		fhkJ_yield(&S->C, FHKS_MAPCALL | SARG(.s_mapcall=J_MAPARG(map, inst)));
 }
 
-AINLINE static void J_vref(struct fhk_solver *S, xidx xi, xinst inst){
-	dv("-> VREF    %s:%lu\n", fhk_dsym(S->G, xi), inst);
-	fhkJ_yield(&S->C, FHKS_VREF | SARG(.s_vref={.idx=xi, .inst=inst}));
+AINLINE static void J_vref(struct fhk_solver *S, xidx xi, xinst inst, xinst end){
+	dv("-> VREF    %s:%lu..%lu\n", fhk_dsym(S->G, xi), inst, end-1);
+	if(S->direct)
+		J_return(S, S->direct->cb->vref(S->direct->udata, S, xi, inst, end-inst),
+				FHKS_VREF | SARG(.s_vref=J_VREFARG(xi, inst, end-inst)));
+	else
+		fhkJ_yield(&S->C, FHKS_VREF | SARG(.s_vref=J_VREFARG(xi, inst, end-inst)));
 }
 
 AINLINE static void J_modcall(struct fhk_solver *S, fhk_modcall *mc){
 	dv("-> MODCALL %s:%u (%u->%u)\n", fhk_dsym(S->G, mc->mref.idx), mc->mref.inst, mc->np, mc->nr);
-	fhkJ_yield(&S->C, FHKS_MODCALL | SARG(.s_modcall=mc));
+	if(S->direct)
+		J_return(S, S->direct->cb->modcall(S->direct->udata, S, mc), FHKS_MODCALL | SARG(.s_modcall=mc));
+	else
+		fhkJ_yield(&S->C, FHKS_MODCALL | SARG(.s_modcall=mc));
+}
+
+// direct callback returned: exit if it wants to stop or it hit an api error.
+AINLINE static void J_return(struct fhk_solver *S, int32_t stop, fhk_status status){
+	if(UNLIKELY(stop))
+		J_exit(S, status);
+
+	if(UNLIKELY(S->direct->status))
+		J_exit(S, S->direct->status);
 }
 
 __attribute__((cold, noreturn))
@@ -728,7 +1173,13 @@ static void JE_nchain(struct fhk_solver *S, xidx xi, xinst inst){
 
 __attribute__((noreturn))
 static void J_exit(struct fhk_solver *S, fhk_status status){
+	if(S->direct){
+		S->direct->status = status;
+		longjmp(S->direct->exit, 1);
+	}
+
 #if FHK_CO_BUILTIN
+	S->e_status = status;
 	for(;;)
 		fhkJ_yield(&S->C, status);
 #else
@@ -747,6 +1198,14 @@ static void SE_exit(struct fhk_solver *S){
 
 __attribute__((cold))
 static void E_exit(struct fhk_solver *S, fhk_status status){
+	// called from a direct callback: we are on the solver's stack, so let J_return exit
+	// when the callback returns.
+	if(S->direct){
+		if(!S->direct->status)
+			S->direct->status = status;
+		return;
+	}
+
 #if FHK_CO_BUILTIN
 	S->e_status = status;
 	fhk_co_jmp(&S->C, &SE_exit);
@@ -756,13 +1215,28 @@ static void E_exit(struct fhk_solver *S, fhk_status status){
 #endif
 }
 
+// the solver has exited (see J_exit and E_exit), it will only return `status` from now on.
+static bool E_exited(struct fhk_solver *S, fhk_status *status){
+#if FHK_CO_BUILTIN
+	*status = S->e_status;
+	return S->e_status != 0;
+#else
+	*status = S->C.status;
+	return !S->C.co || S->C.destroy;
+#endif
+}
+
 static void S_solve(struct fhk_solver *S){
 	for(;;){
-		if(!S->r_num){
-			fhkJ_yield(&S->C, FHK_OK);
-			continue;
-		}
+		S_solve_roots(S);
+		fhkJ_yield(&S->C, FHK_OK);
+	}
+}
 
+// noinline: this must not end up in fhk_solve, since the compiler is very conservative with
+// functions that call setjmp.
+NOINLINE static void S_solve_roots(struct fhk_solver *S){
+	while(S->r_num){
 		uint32_t num = S->r_num;
 		struct rootv *roots = S->r_buf;
 
@@ -773,6 +1247,9 @@ static void S_solve(struct fhk_solver *S){
 				S_get_giveni(S, r->xi, r->inst, r->end);
 		}
 
+		if(UNLIKELY(S->plan) && S_plan_replay(S, roots, num))
+			goto compute;
+
 		// solve chains
 		for(uint32_t i=0;i<num;i++){
 			struct rootv *r = &roots[i];
@@ -791,6 +1268,15 @@ static void S_solve(struct fhk_solver *S){
 			} while(++inst < r->end);
 		}
 
+		if(UNLIKELY(S->plan))
+			S_plan_record(S, roots, num);
+
+compute:
+		// plans only cover the first batch, after this the search state depends on
+		// the previous batches.
+		S->plan = NULL;
+		S->r_gen++;
+
 		// compute values
 		for(uint32_t i=0;i<num;i++){
 			struct rootv *r = &roots[i];
@@ -827,6 +1313,317 @@ static void S_solve(struct fhk_solver *S){
 	}
 }
 
+static bool S_plan_replay(struct fhk_solver *S, struct rootv *roots, uint32_t num){
+	struct fhk_plan *P = S->plan;
+	struct fhk_graph *G = S->G;
+	struct plan_ent *e = plan_find(P, roots, num);
+
+	if(!e){
+		P->stats.miss++;
+		return false;
+	}
+
+	// check mappings first, this doesn't touch the search state so we can just fall back
+	// to search if something is different.
+	for(uint32_t i=0;i<e->nmap;i++){
+		struct plan_map *pm = &e->maps[i];
+		if(!plan_sseq(e, pm, S_expandumap(S, pm->map, pm->inst)))
+			goto fail;
+	}
+
+	// every recorded guard reads a given variable, so the guards don't depend on the chains
+	// either. check them before restoring anything, if one differs the search just reuses
+	// the guard states.
+	for(uint32_t i=0;i<e->nguard;i++){
+		struct plan_guard *pg = &e->guards[i];
+		struct fhk_shadow *w = &G->shadows[pg->wi];
+		xinst inst = pg->inst;
+
+		S_get_given1(S, w->xi, inst);
+		S_vexpandss(S, pg->wi);
+		bitmap *ss = S->s_sstate[pg->wi];
+		S_checkscan(S, ss, w, inst, inst+1);
+
+		if(((ss[SW_BMIDX(inst)] >> SW_BMOFF(inst)) & (SW_PASS|SW_EVAL)) != pg->state)
+			goto fail;
+	}
+
+	for(uint32_t i=0;i<e->nsp;i++){
+		struct plan_sp *ps = &e->sps[i];
+
+		if(ISVI(ps->idx)){
+			S_vexpandsp(S, ps->idx);
+			S->s_vstate[ps->idx][ps->inst] = ps->sp;
+		}else{
+			S_mexpandsp(S, ps->idx);
+			S->s_mstate[ps->idx][ps->inst] = ps->sp;
+		}
+	}
+
+	dv("plan hit (%u roots, %u chains)\n", num, e->nsp);
+	P->stats.hit++;
+	return true;
+
+fail:
+	dv("plan mismatch (%u roots)\n", num);
+	P->stats.fail++;
+	return false;
+}
+
+static void S_plan_record(struct fhk_solver *S, struct rootv *roots, uint32_t num){
+	struct fhk_plan *P = S->plan;
+	struct fhk_graph *G = S->G;
+	struct plan_ent *e = plan_find(P, roots, num);
+	void *p;
+
+	if(!e){
+		e = &P->ent[P->next];
+		P->next = (P->next+1) % NUM_PLAN;
+	}
+
+	plan_clear(e);
+
+	if(!(e->roots = malloc(num * sizeof(*e->roots))))
+		return;
+
+	for(uint32_t i=0;i<num;i++){
+		e->roots[i].xi = roots[i].xi;
+		e->roots[i].inst = roots[i].inst;
+		e->roots[i].end = roots[i].end;
+	}
+
+	e->nroot = num;
+
+	// groups first, user maps need the shapes.
+	for(xmap map=0;map<G->nkmap;map++){
+		fhk_subset ss = S->s_mapstate[map].kmap;
+		if(ss != SS_UNDEF && !plan_record_map(e, map, map < G->ng ? FHK_NINST : 0, ss))
+			goto fail;
+	}
+
+	for(xmap map=-G->nimap;map<0;map++){
+		fhk_subset *imap = S->s_mapstate[map].imap;
+		if(imap == (fhk_subset *)SS_UNDEF)
+			continue;
+
+		xinst n = PK_N1(S->s_mapstate[G->umap_assoc[map]].kmap);
+		for(xinst inst=0;inst<n;inst++){
+			if(imap[inst] != SS_UNDEF && !plan_record_map(e, map, inst, imap[inst]))
+				goto fail;
+		}
+	}
+
+	for(xidx idx=-G->nm;idx<G->nv;idx++){
+		ssp *sp;
+		xgrp group;
+
+		if(ISVI(idx)){
+			if(V_GIVEN(&G->vars[idx]))
+				continue;
+			sp = S->s_vstate[idx];
+			group = G->vars[idx].group;
+		}else{
+			sp = S->s_mstate[idx];
+			group = G->models[idx].group;
+		}
+
+		if(!sp)
+			continue;
+
+		xinst n = PK_N1(S->s_mapstate[group].kmap);
+		for(xinst inst=0;inst<n;inst++){
+			if(!(sp[inst].state & SP_CHAIN))
+				continue;
+
+			if(!(p = plan_push(e->sps, e->nsp, sizeof(*e->sps))))
+				goto fail;
+
+			e->sps = p;
+			e->sps[e->nsp] = (struct plan_sp){ .sp = sp[inst], .idx = idx, .inst = inst };
+			e->sps[e->nsp++].sp.state &= ~SP_VALUE;
+		}
+	}
+
+	// a guard on a computed variable depends on that variable's chain, which may itself
+	// depend on other guards. replaying those would need the guards checked in the order the
+	// search evaluated them, so such searches are not recorded at all.
+	for(xidx wi=G->nv;wi<G->nx;wi++){
+		bitmap *ss = S->s_sstate[wi];
+		if(!ss)
+			continue;
+
+		bool computed = V_COMPUTED(&G->vars[G->shadows[wi].xi]);
+		xinst n = PK_N1(S->s_mapstate[G->shadows[wi].group].kmap);
+		for(xinst inst=0;inst<n;inst++){
+			uint8_t state = (ss[SW_BMIDX(inst)] >> SW_BMOFF(inst)) & (SW_PASS|SW_EVAL);
+			if(!(state & SW_EVAL))
+				continue;
+
+			if(computed){
+				dv("plan not recorded: computed guard %s:%u\n", fhk_dsym(G, wi), inst);
+				goto fail;
+			}
+
+			if(!(p = plan_push(e->guards, e->nguard, sizeof(*e->guards))))
+				goto fail;
+
+			e->guards = p;
+			e->guards[e->nguard++] = (struct plan_guard){ .wi=wi, .inst=inst, .state=state };
+		}
+	}
+
+	dv("plan record (%u roots, %u maps, %u chains, %u guards)\n",
+			num, e->nmap, e->nsp, e->nguard);
+
+	return;
+
+fail:
+	// out of memory or a computed guard, not an error, just don't cache.
+	plan_clear(e);
+}
+
+// forget all search state (chains, costs, guard results, computed values), but keep given
+// values and mappings. computed values stay in their buffers, they are recomputed (if needed)
+// after the next search.
+static void S_reset_search(struct fhk_solver *S){
+	struct fhk_graph *G = S->G;
+
+	for(xidx xi=0;xi<G->nv;xi++){
+		if(V_COMPUTED(&G->vars[xi]))
+			S->s_vstate[xi] = NULL;
+	}
+
+	for(xidx wi=G->nv;wi<G->nx;wi++)
+		S->s_sstate[wi] = NULL;
+
+	memset(S->s_mstate - G->nm, 0, G->nm * sizeof(*S->s_mstate));
+}
+
+// invalidate models using xi:inst
+static void S_invalidate_fwd(struct fhk_solver *S, xidx xi, xinst inst){
+	struct fhk_var *x = &S->G->vars[xi];
+
+	for(int64_t i=0;i<x->n_fwd;i++){
+		fhk_edge e = x->fwds[i];
+		ssp *m_sp = S->s_mstate[e.idx];
+		if(!m_sp)
+			continue;
+
+		fhk_subset ss = S_knownmap(S, e.map, inst, S->G->models[e.idx].group);
+		if(SS_ISEMPTY(ss))
+			continue;
+
+		ssiter3p ip;
+		xinst m_inst, num;
+		si3_ss(ss, &ip, &m_inst, &num);
+
+		for(;;){
+			for(xinst j=m_inst;j<m_inst+num;j++){
+				if(m_sp[j].state & SP_VALUE)
+					S_invalidate_model(S, e.idx, j);
+			}
+			SI3_NEXTI(ip, m_inst, num);
+		}
+	}
+}
+
+// invalidate model mi:m_inst and the returned values whose chain selects it
+static void S_invalidate_model(struct fhk_solver *S, xidx mi, xinst m_inst){
+	struct fhk_model *m = &S->G->models[mi];
+	S->s_mstate[mi][m_inst].state &= ~SP_VALUE;
+
+	for(int64_t i=0;i<m->p_return;i++){
+		fhk_edge e = m->returns[i];
+		ssp *sp = S->s_vstate[e.idx];
+		if(!sp)
+			continue;
+
+		struct fhk_var *x = &S->G->vars[e.idx];
+		fhk_subset ss = S_knownmap(S, e.map, m_inst, x->group);
+		if(SS_ISEMPTY(ss))
+			continue;
+
+		ssiter3p ip;
+		xinst inst, num;
+		si3_ss(ss, &ip, &inst, &num);
+
+		for(;;){
+			for(xinst j=inst;j<inst+num;j++){
+				if(!(sp[j].state & SP_VALUE))
+					continue;
+
+				if(SP_CHAIN_INSTANCE(sp[j]) != m_inst || x->models[SP_CHAIN_EI(sp[j])].idx != mi)
+					continue;
+
+				sp[j].state &= ~SP_VALUE;
+				S_invalidate_fwd(S, e.idx, j);
+			}
+			SI3_NEXTI(ip, inst, num);
+		}
+	}
+}
+
+// move computed values out of the caller's root buffers before they are recomputed
+static void S_unborrow(struct fhk_solver *S){
+	for(struct vborrow *b=S->v_borrow; b; b=b->next){
+		struct fhk_var *x = &S->G->vars[b->xi];
+		size_t size = PK_N1(S->s_mapstate[x->group].kmap) * x->size;
+		void *vp = arena_alloc(S->arena, size, x->size);
+		if(UNLIKELY(!vp)){
+			E_exit(S, FHK_ERROR | SARG(.s_ei = FHKE_MEM));
+			return;
+		}
+		memcpy(vp, S->s_value[b->xi], size);
+		S->s_value[b->xi] = vp;
+		S->v_borrow = b->next;
+	}
+}
+
+// did any evaluated guard see a value that is now stale?
+static bool S_guards_stale(struct fhk_solver *S){
+	struct fhk_graph *G = S->G;
+
+	for(xidx wi=G->nv;wi<G->nx;wi++){
+		bitmap *ss = S->s_sstate[wi];
+		if(!ss)
+			continue;
+
+		struct fhk_shadow *w = &G->shadows[wi];
+		ssp *sp = S->s_vstate[w->xi];
+		bitmap *missing = S->s_vmstate[w->xi];
+		bool computed = V_COMPUTED(&G->vars[w->xi]);
+		xinst n = PK_N1(S->s_mapstate[w->group].kmap);
+
+		for(xinst inst=0;inst<n;inst++){
+			if(!((ss[SW_BMIDX(inst)] >> SW_BMOFF(inst)) & SW_EVAL))
+				continue;
+
+			if(computed ? !(sp[inst].state & SP_VALUE) : (!missing || bm_isset(missing, inst)))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// mapped subset if it has been expanded, otherwise the whole target group.
+// this never calls out of the solver, so it's usable outside the solver coroutine.
+static fhk_subset S_knownmap(struct fhk_solver *S, xmap map, xinst inst, xgrp group){
+	if(LIKELY(map == MAP_IDENT))
+		return SS_PKIVAL(inst, 1);
+
+	anymap ms = S->s_mapstate[map];
+
+	if(MAP_ISCONST(map)){
+		if(ms.kmap != SS_UNDEF)
+			return ms.kmap;
+	}else if(ms.imap != (fhk_subset *)SS_UNDEF && ms.imap[inst] != SS_UNDEF){
+		return ms.imap[inst];
+	}
+
+	return S->s_mapstate[group].kmap;
+}
+
 // expand backward edges of computed variable
 static void S_vexpandbe(struct fhk_solver *S, xidx xi, xinst inst){
 	struct fhk_var *x = &S->G->vars[xi];
@@ -1229,7 +2026,7 @@ candidate:
 		// was already solved.
 		if(UNLIKELY(sp->state & SP_CHAIN)){
 			X_cost = m_cost;
-			X->x_sp->state = SP_CHAIN_V(m_cand->m_ei, m_inst);
+			SP_SETCHAIN(X->x_sp, m_cand->m_ei, m_inst);
 			goto x_chosen;
 		}
 
@@ -1428,7 +2225,7 @@ param_solved:       // solved under bound, we good
 		X_cost = costf((struct fhk_model *)&X->m, M_costS);
 		X->m_sp->cost = X_cost;
 		X->m_sp->state = SP_CHAIN;
-		X->x_sp->state = SP_CHAIN_V(X->m_ei, X->m_inst);
+		SP_SETCHAIN(X->x_sp, X->m_ei, X->m_inst);
 
 		dv("%s:%u [%s:%u] -- chain solved [%g/%g]\n",
 				fhk_dsym(S->G, X->d_xi), X->d_xinst,
@@ -1439,6 +2236,129 @@ param_solved:       // solved under bound, we good
 	}
 }
 
+// guard results for SW_WORDINST consecutive instances starting at vp, bit i is instance i.
+// the vector versions compare 4-16 values at once and collect the results with movemask.
+// the version is picked at compile time (CCARCH), a portable build gets the SSE2 compares.
+AINLINE static uint32_t sw_guardw(struct fhk_shadow *w, void *vp){
+	uint32_t m = 0;
+
+	switch(w->guard){
+		case FHKC_GEF32:
+		case FHKC_LEF32:
+		{
+			float *v = vp;
+			float f32 = w->arg.f32;
+#if defined(__AVX__)
+			__m256 a = _mm256_set1_ps(f32);
+			if(w->guard == FHKC_GEF32){
+				for(int i=0;i<SW_WORDINST;i+=8)
+					m |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v+i), a, _CMP_GE_OQ)) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i+=8)
+					m |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v+i), a, _CMP_LE_OQ)) << i;
+			}
+#elif defined(__SSE2__)
+			__m128 a = _mm_set1_ps(f32);
+			if(w->guard == FHKC_GEF32){
+				for(int i=0;i<SW_WORDINST;i+=4)
+					m |= (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(v+i), a)) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i+=4)
+					m |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(v+i), a)) << i;
+			}
+#else
+			if(w->guard == FHKC_GEF32){
+				for(int i=0;i<SW_WORDINST;i++)
+					m |= (uint32_t)(v[i] >= f32) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i++)
+					m |= (uint32_t)(v[i] <= f32) << i;
+			}
+#endif
+			return m;
+		}
+
+		case FHKC_GEF64:
+		case FHKC_LEF64:
+		{
+			double *v = vp;
+			double f64 = w->arg.f64;
+#if defined(__AVX__)
+			__m256d a = _mm256_set1_pd(f64);
+			if(w->guard == FHKC_GEF64){
+				for(int i=0;i<SW_WORDINST;i+=4)
+					m |= (uint32_t)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(v+i), a, _CMP_GE_OQ)) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i+=4)
+					m |= (uint32_t)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(v+i), a, _CMP_LE_OQ)) << i;
+			}
+#elif defined(__SSE2__)
+			__m128d a = _mm_set1_pd(f64);
+			if(w->guard == FHKC_GEF64){
+				for(int i=0;i<SW_WORDINST;i+=2)
+					m |= (uint32_t)_mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(v+i), a)) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i+=2)
+					m |= (uint32_t)_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(v+i), a)) << i;
+			}
+#else
+			if(w->guard == FHKC_GEF64){
+				for(int i=0;i<SW_WORDINST;i++)
+					m |= (uint32_t)(v[i] >= f64) << i;
+			}else{
+				for(int i=0;i<SW_WORDINST;i++)
+					m |= (uint32_t)(v[i] <= f64) << i;
+			}
+#endif
+			return m;
+		}
+
+		default:
+		{
+			assert(w->guard == FHKC_U8_MASK64);
+			uint8_t *v = vp;
+			uint64_t u64 = w->arg.u64;
+#if defined(__SSSE3__)
+			// look up byte v>>3 of the mask and test bit v&7 of it. v is < 64, so the
+			// upper half of the table is never used.
+			__m128i tab = _mm_set_epi64x(0, u64);
+			__m128i bit = _mm_set_epi64x(0, 0x8040201008040201ull);
+			__m128i lo3 = _mm_set1_epi8(7);
+			for(int i=0;i<SW_WORDINST;i+=16){
+				__m128i x = _mm_loadu_si128((__m128i *)(v+i));
+				__m128i b = _mm_shuffle_epi8(tab, _mm_and_si128(_mm_srli_epi16(x, 3), lo3));
+				__m128i k = _mm_shuffle_epi8(bit, _mm_and_si128(x, lo3));
+				__m128i z = _mm_cmpeq_epi8(_mm_and_si128(b, k), _mm_setzero_si128());
+				m |= (uint32_t)(~_mm_movemask_epi8(z) & 0xffff) << i;
+			}
+#else
+			for(int i=0;i<SW_WORDINST;i++)
+				m |= (uint32_t)((u64 >> v[i]) & 1) << i;
+#endif
+			return m;
+		}
+	}
+}
+
+// spread guard results into the interleaved shadow state layout: bit i goes to SW_PASS of
+// instance i, and every instance gets SW_EVAL.
+AINLINE static bitmap sw_spread(uint32_t m){
+#if defined(__BMI2__)
+	return _pdep_u64(m, ~SW_EVALALL) | SW_EVALALL;
+#else
+	uint64_t x = m;
+	x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+	x = (x | (x << 8))  & 0x00ff00ff00ff00ffull;
+	x = (x | (x << 4))  & 0x0f0f0f0f0f0f0f0full;
+	x = (x | (x << 2))  & 0x3333333333333333ull;
+	x = (x | (x << 1))  & 0x5555555555555555ull;
+	return x | SW_EVALALL;
+#endif
+}
+
+// evaluate the guard for [inst, end) and set the shadow state.
+// instances are evaluated one at a time up to the next bitmap word, then a word at a time
+// (sw_guardw), and the tail again one at a time.
 static void S_checkscan(struct fhk_solver *S, bitmap *bm, struct fhk_shadow *w, xinst inst,
 		xinst end){
 
@@ -1451,13 +2371,17 @@ static void S_checkscan(struct fhk_solver *S, bitmap *bm, struct fhk_shadow *w,
 	bm += SW_BMIDX(inst);
 	uint64_t offset = SW_BMOFF(inst);
 	xinst num = end - inst;
-	bitmap state = *bm;
+	bitmap state;
 
 	float f32 = w->arg.f32;
 	double f64 = w->arg.f64;
 	uint64_t u64 = w->arg.u64;
 	uint64_t ok = 0;
 
+	if(!offset)
+		goto words;
+
+	state = *bm;
 	goto *L;
 
 f32_ge: ok = *(float *)vp >= f32; goto next;
@@ -1480,9 +2404,22 @@ next:
 
 	if(!offset){
 		*bm++ = state;
-		state = *bm;
+		goto words;
+	}
+
+	goto *L;
+
+words:
+	while(num >= SW_WORDINST){
+		*bm++ |= sw_spread(sw_guardw(w, vp));
+		vp += SW_WORDINST*stride;
+		num -= SW_WORDINST;
 	}
 
+	if(!num)
+		return;
+
+	state = *bm;
 	goto *L;
 }
 
@@ -1505,13 +2442,13 @@ static void S_get_given(struct fhk_solver *S, xidx xi, xmap map, xinst inst){
 	}	
 }
 
-AINLINE static bitmap *S_touch_vmstate(struct fhk_solver *S, xidx xi, xinst inst){
+AINLINE static bitmap *S_touch_vmstate(struct fhk_solver *S, xidx xi, xinst inst, xinst end){
 	bitmap *missing = S->s_vmstate[xi];
 
 	if(LIKELY(missing))
 		return missing;
 
-	J_vref(S, xi, inst);
+	J_vref(S, xi, inst, end);
 
 	missing = S->s_vmstate[xi];
 	if(UNLIKELY(!missing))
@@ -1523,26 +2460,28 @@ AINLINE static bitmap *S_touch_vmstate(struct fhk_solver *S, xidx xi, xinst inst
 AINLINE static void S_get_missingi(struct fhk_solver *S, xidx xi, xinst inst, xinst end,
 		bitmap *missing){
 
+	// ask for the whole missing run at once. the driver may give less, as long as it gives
+	// the first one: the rest of the run is asked again.
 	while(bm_findi(missing, &inst, end)){
-		J_vref(S, xi, inst);
+		J_vref(S, xi, inst, bm_findz(missing, inst, end));
 		if(UNLIKELY(bm_isset(missing, inst)))
 			JE_nvalue(S, xi, inst);
 	}
 }
 
 static void S_get_given1(struct fhk_solver *S, xidx xi, xinst inst){
-	bitmap *missing = S_touch_vmstate(S, xi, inst);
+	bitmap *missing = S_touch_vmstate(S, xi, inst, inst+1);
 
 	if(!bm_isset(missing, inst))
 		return;
 
-	J_vref(S, xi, inst);
+	J_vref(S, xi, inst, inst+1);
 	if(UNLIKELY(bm_isset(missing, inst)))
 		JE_nvalue(S, xi, inst);
 }
 
 static void S_get_given_si3(struct fhk_solver *S, xidx xi, ssiter3p ip, xinst inst, xinst num){
-	bitmap *missing = S_touch_vmstate(S, xi, inst);
+	bitmap *missing = S_touch_vmstate(S, xi, inst, inst+num);
 
 	for(;;){
 		S_get_missingi(S, xi, inst, inst+num, missing);
@@ -1551,12 +2490,12 @@ static void S_get_given_si3(struct fhk_solver *S, xidx xi, ssiter3p ip, xinst in
 }
 
 static void S_get_giveni(struct fhk_solver *S, xidx xi, xinst inst, xinst end){
-	S_get_missingi(S, xi, inst, end, S_touch_vmstate(S, xi, inst));
+	S_get_missingi(S, xi, inst, end, S_touch_vmstate(S, xi, inst, end));
 }
 
 // xi must be uncomputed with a chain, use S_get_value* if you're unsure
 static void S_compute_value(struct fhk_solver *S, xidx xi, xinst inst){
-	static_assert(sizeof(fhk_modcall) + 2*G_MAXEDGE*sizeof(fhk_mcedge) < (1 << SBUF_MIN_BITS));
+	static_assert(sizeof(fhk_modcall) + (2*G_MAXEDGE+1)*sizeof(fhk_mcedge) < (1 << SBUF_MIN_BITS));
 
 	assert(V_COMPUTED(&S->G->vars[xi]));
 	assert((S->s_vstate[xi][inst].state & (SP_CHAIN|SP_VALUE)) == SP_CHAIN);
@@ -1565,16 +2504,22 @@ static void S_compute_value(struct fhk_solver *S, xidx xi, xinst inst){
 
 	size_t m_ei = SP_CHAIN_EI(*sp);
 	xinst m_inst = SP_CHAIN_INSTANCE(*sp);
-	// it's safe to assign this here, this can't call itself recursively with the same sp since
-	// that would imply a cycle in the selected chain.
-	sp->state |= SP_VALUE;
-
 	struct fhk_var *x = &S->G->vars[xi];
 	fhk_edge m_e = x->models[m_ei];
 	xidx mi = m_e.idx;
 	struct fhk_model *m = &S->G->models[mi];
 	ssp *m_sp = &S->s_mstate[mi][m_inst];
 
+	// the first call of a batched model in each root batch gathers the batch. this solves the
+	// parameters of other instances, which may need this value, so it goes before anything is
+	// marked here.
+	if(UNLIKELY(m->flags & M_BATCH) && S->m_bgen[~mi] != S->r_gen)
+		S_compute_batch(S, mi);
+
+	// it's safe to assign this here, this can't call itself recursively with the same sp since
+	// that would imply a cycle in the selected chain.
+	sp->state |= SP_VALUE;
+
 	if(UNLIKELY(m_sp->state & SP_VALUE))
 		goto unpackvalue;
 
@@ -1594,11 +2539,17 @@ static void S_compute_value(struct fhk_solver *S, xidx xi, xinst inst){
 		S_get_given(S, e.idx, e.map, m_inst);
 	}
 
+	if(m->flags & M_BATCH){
+		S_batch_call(S, mi, NULL, 1, m_inst);
+		goto unpackvalue;
+	}
+
 	fhk_modcall *cm = sbuf_alloc_init(S, sizeof(*cm) + (m->p_param+m->p_return)*sizeof(*cm->edges));
 	cm->mref.idx = mi;
 	cm->mref.inst = m_inst;
 	cm->np = m->p_param;
 	cm->nr = m->p_return;
+	cm->ni = 1;
 
 	for(int32_t i=0;i<m->p_param;i++){
 		fhk_edge e = m->params[i];
@@ -1654,6 +2605,176 @@ unpackvalue:
 	dv("%s:%zu -- solved value [%s]\n", fhk_dsym(S->G, xi), inst, dstrvalue(S, xi, inst));
 }
 
+// batched modcall. this calls the model once for every instance where it is selected on a
+// chain, so that eg. a tree-level model is called once for all trees instead of once per tree.
+// the batch is gathered on the first call in each root batch, when the chains for all roots
+// are selected. it includes the instances that are still unsolved after their computed
+// parameters are solved: solving them may call the model again, those calls (and any later
+// calls in the same root batch) are made for one instance at a time.
+// the model must have M_BATCH (all edges are identity maps).
+static void S_compute_batch(struct fhk_solver *S, xidx mi){
+	struct fhk_model *m = &S->G->models[mi];
+	ssp *m_sp = S->s_mstate[mi];
+	xinst shape = S_shape(S, m->group);
+	// the list must survive the yields below, so it can't live in the scratch buffer
+	fhk_inst *insts = arena_alloc(S->arena, shape*sizeof(*insts), alignof(*insts));
+	xinst ni = 0;
+
+	assert(m->flags & M_BATCH);
+	S->m_bgen[~mi] = S->r_gen;
+
+	for(xinst j=0;j<shape;j++){
+		if(S_batch_ready(S, mi, m, m_sp[j], j))
+			insts[ni++] = j;
+	}
+
+	for(xinst k=0;k<ni;k++){
+		for(int32_t i=0;i<m->p_cparam;i++){
+			xidx xi = m->params[i].idx;
+			if(!(S->s_vstate[xi][insts[k]].state & SP_VALUE))
+				S_compute_value(S, xi, insts[k]);
+		}
+	}
+
+	xinst n = 0;
+	for(xinst k=0;k<ni;k++){
+		xinst j = insts[k];
+		if(S_batch_ready(S, mi, m, m_sp[j], j)){
+			m_sp[j].state |= SP_VALUE;
+			insts[n++] = j;
+		}
+	}
+
+	if(!n)
+		return;
+
+	// load given parameters a run of consecutive instances at a time
+	for(int32_t i=m->p_cparam;i<m->p_param;i++){
+		xidx xi = m->params[i].idx;
+		for(xinst k=0;k<n;){
+			xinst start = insts[k], end = start+1;
+			while(++k < n && insts[k] == end)
+				end++;
+			S_get_giveni(S, xi, start, end);
+		}
+	}
+
+	S_batch_call(S, mi, insts, n, 0);
+}
+
+// call a batched model for the sorted instance list insts, or for m_inst alone if insts is
+// NULL. the parameters of every instance must be available.
+static void S_batch_call(struct fhk_solver *S, xidx mi, fhk_inst *insts, xinst ni, xinst m_inst){
+	struct fhk_model *m = &S->G->models[mi];
+	uint32_t ne = m->p_param + m->p_return;
+
+	// nothing below yields before J_modcall, so the scratch buffer stays valid
+	fhk_modcall *cm = sbuf_alloc_init(S, sizeof(*cm) + (ne+1)*sizeof(*cm->edges));
+
+	if(!insts){
+		insts = S_sbuf_alloc(S, sizeof(*insts));
+		insts[0] = m_inst;
+	}
+
+	xinst first = insts[0];
+	bool contiguous = (xinst)(insts[ni-1] - first) == ni-1;
+
+	cm->mref.idx = mi;
+	cm->mref.inst = first;
+	cm->np = m->p_param;
+	cm->nr = m->p_return;
+	cm->ni = ni;
+	cm->edges[ne].p = insts;
+	cm->edges[ne].n = ni;
+
+	for(int32_t i=0;i<m->p_param;i++){
+		fhk_edge e = m->params[i];
+		fhk_mcedge *mce = &cm->edges[e.ex];
+		size_t sz = S->G->vars[e.idx].size;
+		void *vp = S->s_value[e.idx];
+
+		mce->n = ni;
+
+		if(LIKELY(contiguous)){
+			mce->p = vp + sz*first;
+		}else{
+			mce->p = S_sbuf_alloc(S, sz*ni);
+			for(xinst k=0;k<ni;k++)
+				memcpy(mce->p + sz*k, vp + sz*insts[k], sz);
+		}
+	}
+
+	fhk_mcedge *mce = cm->edges + cm->np;
+
+	if(!(m->flags & M_NORETBUF))
+		S_mexpandvp(S, mi);
+
+	for(int32_t i=0;i<m->p_return;i++,mce++){
+		fhk_edge e = m->returns[i];
+		S_vexpandvp(S, e.idx);
+		size_t sz = S->G->vars[e.idx].size;
+
+		mce->n = ni;
+
+		if(LIKELY(m->flags & M_NORETBUF)){
+			// write directly to the value buffer, or collect to scratch and scatter after the call
+			mce->p = contiguous ? (S->s_value[e.idx] + sz*first) : S_sbuf_alloc(S, sz*ni);
+		}else{
+			// return buffers, S_compute_value unpacks these per instance
+			mce->p = arena_alloc(S->arena, sz*ni, sz);
+			for(xinst k=0;k<ni;k++)
+				RBUF(mi, m, insts[k])[i] = mce->p + sz*k;
+		}
+	}
+
+	J_modcall(S, cm);
+
+	if(LIKELY(contiguous) || !(m->flags & M_NORETBUF))
+		return;
+
+	mce = cm->edges + cm->np;
+	for(int32_t i=0;i<m->p_return;i++,mce++){
+		fhk_edge e = m->returns[i];
+		size_t sz = S->G->vars[e.idx].size;
+		void *vp = S->s_value[e.idx];
+
+		for(xinst k=0;k<ni;k++)
+			memcpy(vp + sz*insts[k], mce->p + sz*k, sz);
+	}
+}
+
+// can instance `inst` of model `mi` be included in a batch? the model must be selected on the
+// chain of some return at `inst` (so it's going to be computed anyway), and none of its
+// returns may be solved yet.
+AINLINE static bool S_batch_ready(struct fhk_solver *S, xidx mi, struct fhk_model *m, ssp m_sp,
+		xinst inst){
+
+	if((m_sp.state & (SP_CHAIN|SP_VALUE)) != SP_CHAIN)
+		return false;
+
+	bool selected = false;
+
+	for(int32_t i=0;i<m->p_return;i++){
+		xidx xi = m->returns[i].idx;
+		ssp *sp = S->s_vstate[xi];
+		if(!sp)
+			continue;
+
+		ssp x_sp = sp[inst];
+
+		// don't overwrite values that are already solved (possibly by another model)
+		if(x_sp.state & SP_VALUE)
+			return false;
+
+		if((x_sp.state & SP_CHAIN)
+				&& S->G->vars[xi].models[SP_CHAIN_EI(x_sp)].idx == mi
+				&& SP_CHAIN_INSTANCE(x_sp) == inst)
+			selected = true;
+	}
+
+	return selected;
+}
+
 AINLINE static void S_get_computed_si(struct fhk_solver *S, ssiter it, xidx xi){
 	ssp *sp = S->s_vstate[xi];
 
@@ -1768,7 +2889,7 @@ AINLINE static opt_ssiter mapE_ssiter(struct fhk_solver *S, xmap map, xinst inst
 	if(LIKELY(!SS_ISCOMPLEX(ss)))
 		return OSI_V(!SS_ISEMPTY(ss), SS_IIVAL(ss));
 	else
-		return OSI_SIV(SI_CFIRST(map, inst, SS_CIVAL(ss, 0)));
+		return OSI_SIV(SI_CFIRST(map, inst, SS_CIVAL(ss, 0), SS_CNUMI(ss) != 0));
 }
 
 // note: this assumes `inst` is in the mapping.
@@ -1797,7 +2918,7 @@ AINLINE static xmap map_fromext(struct fhk_solver *S, xmap map){
 AINLINE static void si3_ss(fhk_subset ss, ssiter3p *sip, xinst *sinst, xinst *sinum){
 	assert(ss != SS_UNDEF);
 
-	uint32_t ival = UNLIKELY(SS_ISCOMPLEX(ss)) ? SS_CIVAL(ss, 0) : SS_IIVAL(ss);
+	ssival ival = UNLIKELY(SS_ISCOMPLEX(ss)) ? SS_CIVAL(ss, 0) : (ssival)ss;
 	*sip = UNLIKELY(SS_ISCOMPLEX(ss)) ? ss : 0;
 	*sinst = PK_FIRST(ival);
 	*sinum = PK_N1(ival);
@@ -1806,7 +2927,7 @@ AINLINE static void si3_ss(fhk_subset ss, ssiter3p *sip, xinst *sinst, xinst *si
 AINLINE static void si3_complex(fhk_subset ss, ssiter3p *sip, xinst *sinst, xinst *sinum){
 	assert(SS_ISCOMPLEX(ss));
 
-	uint32_t ival = SS_CIVAL(ss, 0);
+	ssival ival = SS_CIVAL(ss, 0);
 	*sip = ss;
 	*sinst = PK_FIRST(ival);
 	*sinum = PK_N1(ival);
@@ -1820,14 +2941,14 @@ NOINLINE static ssiter si_cnexti(struct fhk_solver *S, ssiter it){
 	uint32_t n = SS_CNUMI(ss);
 	uint32_t b = n >> SI_HINT_BITS;
 	uint32_t a = 0;
-	uint32_t *p = SS_CPTR(ss);
+	ssival *p = SS_CPTR(ss);
 	xinst prev = SI_INST(it);
 
 	while(a < b){
 		uint32_t i = a + ((b - a) >> 1);
 		xinst first = PK_FIRST(p[((i+1) << SI_HINT_BITS)-1]);
-		a = first < prev ? (i+1) : a;
-		b = first < prev ? b : i;
+		a = first <= prev ? (i+1) : a;
+		b = first <= prev ? b : i;
 	}
 
 	uint64_t ivl = (a << SI_HINT_BITS) | SI_HINT(it);
@@ -1836,7 +2957,7 @@ NOINLINE static ssiter si_cnexti(struct fhk_solver *S, ssiter it){
 
 AINLINE static void si3_cnexti(ssiter3p *p, xinst *inst, xinst *num){
 	*p += SI3P_IINCR;
-	uint32_t pk = *SS_CPTR(*p);
+	ssival pk = *SS_CPTR(*p);
 	*inst = PK_FIRST(pk);
 	*num = PK_N1(pk);
 }
@@ -1856,7 +2977,7 @@ AINLINE static void si3_collect_ne(void *dest, void *src, size_t sz, ssiter3p ip
 static xinst ss_cindexof(fhk_subset ss, xinst inst){
 	assert(SS_ISCOMPLEX(ss));
 
-	uint32_t *pk = SS_CPTR(ss);
+	ssival *pk = SS_CPTR(ss);
 	uint32_t off = 0;
 
 	for(;;){
@@ -1871,17 +2992,87 @@ static xinst ss_cindexof(fhk_subset ss, xinst inst){
 	}
 }
 
+static struct plan_ent *plan_find(struct fhk_plan *P, struct rootv *roots, uint32_t num){
+	for(uint32_t i=0;i<NUM_PLAN;i++){
+		struct plan_ent *e = &P->ent[i];
+
+		if(!e->roots || e->nroot != num)
+			continue;
+
+		for(uint32_t j=0;j<num;j++){
+			struct plan_root *r = &e->roots[j];
+			if(r->xi != roots[j].xi || r->inst != roots[j].inst || r->end != roots[j].end)
+				goto next;
+		}
+
+		return e;
+next:
+		;
+	}
+
+	return NULL;
+}
+
+static bool plan_record_map(struct plan_ent *e, xmap map, xinst inst, fhk_subset ss){
+	void *p;
+
+	if(!(p = plan_push(e->maps, e->nmap, sizeof(*e->maps))))
+		return false;
+
+	e->maps = p;
+	e->maps[e->nmap++] = (struct plan_map){ .ss=ss, .ival=e->nival, .inst=inst, .map=map };
+
+	if(LIKELY(!SS_ISCOMPLEX(ss)))
+		return true;
+
+	for(size_t i=0;i<=SS_CNUMI(ss);i++){
+		if(!(p = plan_push(e->ivals, e->nival, sizeof(*e->ivals))))
+			return false;
+
+		e->ivals = p;
+		e->ivals[e->nival++] = SS_CIVAL(ss, i);
+	}
+
+	return true;
+}
+
+static bool plan_sseq(struct plan_ent *e, struct plan_map *pm, fhk_subset ss){
+	if(LIKELY(!SS_ISCOMPLEX(pm->ss)))
+		return ss == pm->ss;
+
+	return SS_ISCOMPLEX(ss)
+		&& SS_CNUMI(ss) == SS_CNUMI(pm->ss)
+		&& !memcmp(SS_CPTR(ss), e->ivals+pm->ival, (SS_CNUMI(ss)+1)*sizeof(*e->ivals));
+}
+
+// grow a malloc'd array for the (n+1)th element. capacity is always the next power of 2.
+static void *plan_push(void *p, uint32_t n, size_t size){
+	if(n & (n-1))
+		return p;
+
+	return realloc(p, (n ? 2*n : 1) * size);
+}
+
+static void plan_clear(struct plan_ent *e){
+	free(e->roots);
+	free(e->maps);
+	free(e->sps);
+	free(e->guards);
+	free(e->ivals);
+	memset(e, 0, sizeof(*e));
+}
+
 static size_t ss_csize(fhk_subset ss){
 	assert(SS_ISCOMPLEX(ss));
 
-	uint32_t *pk = SS_CPTR(ss);
+	ssival *pk = SS_CPTR(ss);
 	size_t num = SS_CNUMI(ss);
 
 	// num+1 total intervals, each length is n(ival)+1
 	int64_t size = num+1;
 
 	do {
-		size -= (int16_t) (*pk >> 16);
+		size += PK_N(*pk);
 		pk++;
 	} while(num --> 0); // :)
 
@@ -2005,6 +3196,22 @@ AINLINE static bool bm_findi(bitmap *bm, xinst *inst, xinst end){
 	}
 }
 
+// first unset instance in [inst, end), or end if all are set
+AINLINE static xinst bm_findz(bitmap *bm, xinst inst, xinst end){
+	xinst offset = inst & ~0x3f;
+	bm += inst >> 6;
+	bitmap m = ~*bm & ((~0ull) << (inst & 0x3f));
+
+	while(!m){
+		offset += 64;
+		if(offset >= end)
+			return end;
+		m = ~*++bm;
+	}
+
+	return min(offset + __builtin_ctzl(m), end);
+}
+
 static ssp *ssp_alloc(struct fhk_solver *S, size_t n, ssp init){
 	ssp *sp = arena_alloc(S->arena, n * sizeof(*sp), alignof(*sp));
 
@@ -2014,11 +3221,10 @@ static ssp *ssp_alloc(struct fhk_solver *S, size_t n, ssp init){
 	return sp;
 }
 
-// for debugging use only -- same caveats as fhk_dsym, not suitable for multithreading,
-// can overrun buffers, etc.
+// for debugging use only -- same caveats as fhk_dsym, can overrun buffers, etc.
 __attribute__((unused))
 static const char *dstrvalue(struct fhk_solver *S, xidx xi, xinst inst){
-	static char buf[128];
+	static __thread char buf[128];
 
 	typedef union { int32_t i32; float f32; } v32;
 	typedef union { int64_t i64; double f64; } v64;
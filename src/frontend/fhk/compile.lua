@@ -43,9 +43,15 @@ local function setvalue_userfunc_offset(dispinfo, xi, f, offset, name)
 		{_f=f},
 		string.format([[
 			local inst = D.arg_ref.inst
-			local ptr = _f(inst, A)
-			C.fhkD_setvaluei_offset(S, %d, inst, 1, ptr, %d)
-		]], xi, offset or 0),
+			C.fhkD_setvaluei_offset(S, %d, inst, 1, _f(inst, A), %d)
+			-- the solver asks for a run of instances, but only the first one is required.
+			-- answer as many as the function gives, it may return nil to stop early.
+			for i=inst+1, inst+D.arg_vref.num-1 do
+				local ptr = _f(i, A)
+				if ptr == nil then break end
+				C.fhkD_setvaluei_offset(S, %d, i, 1, ptr, %d)
+			end
+		]], xi, offset or 0, xi, offset or 0),
 		string.format("%s->%s+%s", name or xi, f, offset)
 	)
 end
@@ -62,23 +68,37 @@ local function setvalue_array_userfunc(dispinfo, xi, f, name)
 	)
 end
 
-local function setvalue_soa_constptr(dispinfo, xi, ptr, band, name)
+local vec_ctp = ffi.typeof("struct vec *")
+
+-- lazily deleted rows would shift the instance numbering, the vector must be compacted
+-- before the solver sees it (soa_view does this when it computes the shape).
+local function deadrows(name)
+	error(string.format("%s: vector has dead rows, compact() it before solving", name))
+end
+
+local function setvalue_soa_constptr(dispinfo, xi, ptr, band, bandidx, name)
 	return dispatch_template(
 		dispinfo,
-		{_ptr=ptr},
-		string.format("C.fhkS_setvaluei(S, %d, 0, #_ptr, _ptr.%s)", xi, band),
+		{_ptr=ptr, _cast=ffi.cast, _vec_ctp=vec_ctp, _deadrows=deadrows},
+		string.format([[
+			local v = _cast(_vec_ctp, _ptr)
+			if v.n_dead > 0 then _deadrows(%q) end
+			C.fhkD_setvaluei_vec(S, %d, 0, v, %d)
+		]], name or xi, xi, bandidx),
 		string.format("%s->%p#%s", name or xi, ptr, band)
 	)
 end
 
-local function setvalue_soa_userfunc(dispinfo, xi, f, band, name)
+local function setvalue_soa_userfunc(dispinfo, xi, f, band, bandidx, name)
 	return dispatch_template(
 		dispinfo,
-		{_f=f},
+		{_f=f, _cast=ffi.cast, _vec_ctp=vec_ctp, _deadrows=deadrows},
 		string.format([[
 			local ptr, inst = _f(D.arg_ref.inst, A)
-			C.fhkS_setvaluei(S, %d, inst, #ptr, ptr.%s)
-		]], xi, band),
+			local v = _cast(_vec_ctp, ptr)
+			if v.n_dead > 0 then _deadrows(%q) end
+			C.fhkD_setvaluei_vec(S, %d, inst, v, %d)
+		]], name or xi, xi, bandidx),
 		string.format("%s->%s#%s", name or xi, f, band)
 	)
 end
@@ -141,10 +161,16 @@ local cedge_ct = setmetatable({}, {
 	end
 })
 
-local function signature_ctype(signature)
-	assert(ffi.offsetof(ctypes.modcall, "edges") == ffi.sizeof("uintptr_t"))
+-- the header size depends on the instance width (FHK_WIDEINST), take it from the solver's
+-- modcall type instead of assuming a layout.
+local modcall_ni = ffi.offsetof(ctypes.modcall, "ni")
+local modcall_edges = ffi.offsetof(ctypes.modcall, "edges")
 
-	local fields = { "uintptr_t ___header;" }
+local function signature_ctype(signature)
+	-- batched calls need the instance count, other calls don't care about the header
+	local fields = { signature.batch
+		and string.format("uint8_t ___header[%d]; fhk_inst ni;", modcall_ni)
+		or string.format("uint8_t ___header[%d];", modcall_edges) }
 	local ctypes = {}
 
 	for i,p in ipairs(signature.params) do
@@ -157,7 +183,15 @@ local function signature_ctype(signature)
 		table.insert(ctypes, cedge_ct[r.ctype].ctype)
 	end
 
-	return ffi.typeof(string.format("struct { %s }", table.concat(fields, "\n")), unpack(ctypes))
+	local ct = ffi.typeof(string.format("struct { %s }", table.concat(fields, "\n")), unpack(ctypes))
+
+	if #signature.params > 0 then
+		assert(ffi.offsetof(ct, "param1") == modcall_edges)
+	elseif #signature.returns > 0 then
+		assert(ffi.offsetof(ct, "return1") == modcall_edges)
+	end
+
+	return ct
 end
 
 local function modcall_lua() error("TODO") end
@@ -167,9 +201,13 @@ local function modcall_lua_ffi(dispinfo, signature, f, name)
 	
 	local params, returns = {}, {}
 
+	-- batched models only have identity edges, so every edge is scalar and we call
+	-- f once per instance
+	local idx = signature.batch and "j" or "0"
+
 	for i,p in ipairs(signature.params) do
 		if p.scalar then
-			table.insert(params, string.format("call.param%d[0]", i))
+			table.insert(params, string.format("call.param%d[%s]", i, idx))
 		else
 			table.insert(params, string.format("call.param%d", i))
 		end
@@ -177,12 +215,20 @@ local function modcall_lua_ffi(dispinfo, signature, f, name)
 
 	for i,r in ipairs(signature.returns) do
 		if r.scalar then
-			table.insert(returns, string.format("call.return%d[0]", i))
+			table.insert(returns, string.format("call.return%d[%s]", i, idx))
 		else
 			table.insert(params, string.format("call.return%d", i))
 		end
 	end
 
+	local callf = string.format("%s _f(%s)",
+		#returns > 0 and string.format("%s =", table.concat(returns, ", ")) or "",
+		table.concat(params, ", "))
+
+	if signature.batch then
+		callf = string.format("for j=0, call.ni-1 do %s end", callf)
+	end
+
 	return dispatch_template(
 		dispinfo,
 		{
@@ -192,10 +238,8 @@ local function modcall_lua_ffi(dispinfo, signature, f, name)
 		},
 		string.format([[
 			local call = cast(_signature_ctp, D.arg_ptr)
-			%s _f(%s)
-		]],
-		#returns > 0 and string.format("%s =", table.concat(returns, ", ")) or "",
-		table.concat(params, ", ")),
+			%s
+		]], callf),
 		string.format("modcall-lua-ffi@%s", name or f)
 	)
 end
@@ -241,17 +285,32 @@ local function modcall_const(dispinfo, signature, returns)
 			-- TODO: should support scalar cdata
 			upv.copy = ffi.copy
 			upv[string.format("return%d", i)] = r
-			src:emitf(
-				"copy(call.edges[%d].p, return%d, call.edges[%d].n*%d)",
-				np+i, i, np+i, ffi.sizeof(ctype)
-			)
+			if signature.batch then
+				upv.cast = ffi.cast
+				src:emitf(
+					"for j=0, call.ni-1 do copy(cast('char *', call.edges[%d].p)+j*%d, return%d, %d) end",
+					np+i, ffi.sizeof(ctype), i, ffi.sizeof(ctype)
+				)
+			else
+				src:emitf(
+					"copy(call.edges[%d].p, return%d, call.edges[%d].n*%d)",
+					np+i, i, np+i, ffi.sizeof(ctype)
+				)
+			end
 		elseif type(r) == "number" then
 			upv.cast = ffi.cast
 			upv[string.format("return%d_ctype", i)] = ffi.typeof("$*", ctype)
-			src:emitf(
-				"cast(return%d_ctype, call.edges[%d].p)[0] = %d",
-				i, np+i, r
-			)
+			if signature.batch then
+				src:emitf(
+					"for j=0, call.ni-1 do cast(return%d_ctype, call.edges[%d].p)[j] = %d end",
+					i, np+i, r
+				)
+			else
+				src:emitf(
+					"cast(return%d_ctype, call.edges[%d].p)[0] = %d",
+					i, np+i, r
+				)
+			end
 		else
 			error(string.format("unhandled constant: %s", r))
 		end
@@ -293,15 +352,20 @@ local function solver_trampoline(name)
 	return code.new()
 		:emit([[
 			local _solve, _pushstate, _popstate
-			local xpcall, traceback, error = xpcall, traceback, error
+			local C, xpcall, traceback, error = C, xpcall, traceback, error
 			return function(A, B)
-				local ok, x = xpcall(_solve, traceback, A, B, _pushstate(A))
+				local S, arena, shape = _pushstate(A)
+				local ok, x = xpcall(_solve, traceback, A, B, S, arena, shape)
 				_popstate()
-				if not ok then error(x) end
+				if not ok then
+					C.fhkD_abort(S)
+					error(x)
+				end
 				return x
 			end
 		]])
 		:compile({
+			C         = C,
 			xpcall    = xpcall,
 			traceback = debug.traceback,
 			error     = error
@@ -465,7 +529,11 @@ local function shapefunc(funs)
 	return out:compile({funs=funs, error=error}, string.format("=(groupshape@%p)", funs))()
 end
 
-local function pushstate_uncached(G, shapef, obtain)
+-- if `release` is given, solvers are kept in a pool (one per nesting depth) and reset with
+-- fhk_reset_solver instead of creating a new one for each solve. the pooled solvers live in
+-- their own arena, the arena from `obtain` only holds the per-solve state.
+-- this returns pushstate, popstate in that case, otherwise only pushstate.
+local function pushstate_uncached(G, shapef, obtain, release)
 	local src = code.new()
 
 	local i = 0
@@ -477,7 +545,8 @@ local function pushstate_uncached(G, shapef, obtain)
 	src:emitf([[
 		local C, G = C, G
 		local cast = cast
-		local _obtain = obtain
+		local _obtain, _release = obtain, release
+		local _pool, _depth, _sarena = {}, 0, sarena
 
 		return function(A)
 			local arena = _obtain()
@@ -488,7 +557,21 @@ local function pushstate_uncached(G, shapef, obtain)
 		src:emitf("shape[%d] = __shape_%d(A)", j, j)
 	end
 
-	src:emit("local S = C.fhk_create_solver(G, arena)")
+	if release then
+		src:emit([[
+			_depth = _depth+1
+			local S = _pool[_depth]
+			if not S then
+				S = C.fhk_create_solver(G, _sarena)
+				_pool[_depth] = S
+			end
+			if not C.fhk_reset_solver(S, arena) then
+				error("fhk_reset_solver: out of memory")
+			end
+		]])
+	else
+		src:emit("local S = C.fhk_create_solver(G, arena)")
+	end
 
 	for j=0, i-1 do
 		src:emitf("C.fhkS_setshape(S, %d, shape[%d])", j, j)
@@ -499,12 +582,23 @@ local function pushstate_uncached(G, shapef, obtain)
 		end
 	]])
 
+	if release then
+		src:emit([[
+			, function()
+				_depth = _depth-1
+				_release()
+			end
+		]])
+	end
+
 	return src:compile({
-		C      = C,
-		G      = G,
-		cast   = ffi.cast,
-		obtain = obtain,
-		shapef = shapef
+		C       = C,
+		G       = G,
+		cast    = ffi.cast,
+		obtain  = obtain,
+		release = release,
+		sarena  = release and ffi.gc(C.arena_create(2^17), C.arena_destroy),
+		shapef  = shapef
 	}, string.format("=(pushstate-uncached@%p)", shapef))()
 end
 
@@ -88,8 +88,8 @@ ffi.metatype("fhk_def", {
 			end
 			return g
 		end,
-		add_model  = function(self, group, k, c, cmin)
-			return check(C.fhk_def_add_model(self, group, k, c, cmin or k))
+		add_model  = function(self, group, k, c, cmin, flags)
+			return check(C.fhk_def_add_model(self, group, k, c, cmin or k, flags or 0))
 		end,
 		add_var    = function(self, group, size, cdiff)
 			return check(C.fhk_def_add_var(self, group, size, cdiff or 0))
@@ -112,10 +112,20 @@ ffi.metatype("fhk_def", {
 ffi.metatype("fhk_solver", {
 	__index = {
 		continue    = C.fhk_continue,
+		reset       = C.fhk_reset_solver,
 		setroot     = C.fhkS_setroot,
 		setshape    = C.fhkS_setshape,
 		setvaluei   = C.fhkS_setvaluei,
-		setmap      = C.fhkS_setmap
+		setmap      = C.fhkS_setmap,
+		setplan     = C.fhkS_setplan,
+		invalidate  = C.fhkS_invalidate
+	}
+})
+
+ffi.metatype("fhk_plan", {
+	__index = {
+		destroy = C.fhk_destroy_plan,
+		stats   = C.fhk_plan_stats
 	}
 })
 
@@ -158,6 +168,7 @@ ffi.metatype("fhk_prune", {
 -- note: all intervals are inclusive
 
 local emptyset = 0x00010000ull
+local ivalptr, ivalsize = "int32_t *", 4
 
 local function pkrangens(from, nsize1)
 	return bor(lshift(nsize1, 16), from)
@@ -220,7 +231,7 @@ local function ssfromidx_complex(idx, i, start, pos, alloc)
 
 	intervals[#intervals+1] = pkrange(start, pos)
 
-	local ip = ffi.cast("int32_t *", alloc(4*#intervals, 4))
+	local ip = ffi.cast(ivalptr, alloc(ivalsize*#intervals, ivalsize))
 
 	for i=1, #intervals do
 		ip[i-1] = intervals[i]
@@ -261,7 +272,7 @@ local function iscomplex(ss)
 end
 
 local function unpackcomplex(ss)
-	return ffi.cast("int32_t *", rshift(ss, 16)), tonumber(band(ss, 0xffff))
+	return ffi.cast(ivalptr, rshift(ss, 16)), tonumber(band(ss, 0xffff))
 end
 
 local function ss_size(ss)
@@ -303,6 +314,51 @@ local function ss_string(ss)
 	return table.concat(ranges, ", ")
 end
 
+-- FHK_WIDEINST: 32-bit instances, 64-bit complex intervals.
+if ffi.sizeof("fhk_inst") == 4 then
+	emptyset = 0x100000000ull
+	ivalptr, ivalsize = "int64_t *", 8
+
+	pkrangens = function(from, nsize1)
+		return bor(lshift(ffi.cast("int64_t", nsize1), 32), from)
+	end
+
+	ss1ns = function(from, nsize1)
+		return bor(0x8000000000000000ull, pkrangens(from, nsize1))
+	end
+
+	unit = function(inst)
+		return 0x8000000000000000ull + inst
+	end
+
+	space = function(n)
+		if n > 0 then
+			return ss1ns(0, 1-n)
+		else
+			return emptyset
+		end
+	end
+
+	ss_size = function(ss)
+		if not iscomplex(ss) then
+			return tonumber(band(1-rshift(ss, 32), 0x7fffffff))
+		else
+			local pp, n = unpackcomplex(ss)
+			local size = n+1
+			while n >= 0 do
+				size = size - arshift(pp[0], 32)
+				pp = pp+1
+				n = n-1
+			end
+			return tonumber(size)
+		end
+	end
+
+	unpackrange = function(pk)
+		return tonumber(band(pk, 0xffffffff)), tonumber(-arshift(lshift(pk, 1), 33))
+	end
+end
+
 ---- mapping ----------------------------------------
 local function map_user(map, inverse)
 	return bor(lshift(band(inverse, 0xff), 8), band(map, 0xff))
@@ -136,6 +136,11 @@ local function cost(kc)
 	end
 end
 
+-- call the model for multiple instances at once, see FHKM_BATCH
+local function batch(mod)
+	mod.batch = true
+end
+
 local function set(map)
 	return modifier({map=map})
 end
@@ -263,6 +268,7 @@ local function gdef_env(nodeset, impls)
 		returns = returns,
 		check   = check,
 		cost    = cost,
+		batch   = batch,
 		set     = set,
 		as      = as,
 		is      = function(set) return is(tomask(tonumset(set, labels))) end,
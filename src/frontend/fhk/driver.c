@@ -1,15 +1,70 @@
 #include "../../fhk/fhk.h"
 #include "../../def.h"
+#include "../../vec.h"
 #include "driver.h"
 
 #include <stdint.h>
 #include <stddef.h>
 #include <assert.h>
+#include <time.h>
 
 static_assert(FHKS_MAPCALL - FHKS_VREF == 1);
 static_assert(FHKS_MODCALL - FHKS_VREF == 2);
 
+static uint64_t prof_now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1000000000ull + t.tv_nsec;
+}
+
+// the model runs between returning a modcall and the next continue, so that's what
+// gets timed here. this also includes the dispatch overhead, which is small compared to
+// any real model.
+// a model can run a nested solve, so the calls being timed form a stack. the time of a
+// call is subtracted from the call below it, so a nested model isn't counted twice.
+// solves are only driven from the main thread, so there's one stack per process.
+#define PROF_MAXDEPTH 64
+
+static struct prof_call {
+	fhk_solver *S;             // solver that requested the call
+	fhkD_mprof *mp;
+	uint64_t start;
+	uint64_t nested;           // time of calls made on top of this one
+} prof_stack[PROF_MAXDEPTH];
+
+static uint32_t prof_top;
+
+// the solver is continued, so the model it called (if any) has returned.
+static void prof_enter(fhk_solver *S){
+	if(!prof_top || prof_stack[prof_top-1].S != S)
+		return;
+
+	struct prof_call *pc = &prof_stack[--prof_top];
+	uint64_t ns = prof_now() - pc->start;
+	pc->mp->ns += ns - pc->nested;
+
+	if(prof_top)
+		prof_stack[prof_top-1].nested += ns;
+}
+
+static void prof_modcall(fhk_solver *S, fhkD_profile *P, fhk_modcall *mc){
+	fhkD_mprof *mp = &P->models[mc->mref.idx];
+	mp->calls++;
+	mp->insts += mc->ni;
+
+	// too deep: count the call, its time goes to the call below
+	if(prof_top == PROF_MAXDEPTH)
+		return;
+
+	prof_stack[prof_top++] = (struct prof_call){ .S=S, .mp=mp, .start=prof_now() };
+}
+
 int32_t fhkD_continue(fhk_solver *S, fhkD_dispatch *D){
+	fhkD_profile *P = D->profile;
+
+	if(UNLIKELY(P))
+		prof_enter(S);
+
 	fhk_status status = fhk_continue(S);
 
 	fhk_sarg arg = FHK_ARG(status);
@@ -20,10 +75,28 @@ int32_t fhkD_continue(fhk_solver *S, fhkD_dispatch *D){
 		return !!code;
 
 	uint16_t *dispatch = D->jumptables[code - FHKS_VREF];
-	int32_t idx = (code == FHKS_MODCALL) ? ((fhk_eref *) (uintptr_t) arg.u64)->idx : arg.s_vref.idx;
+
+#ifdef FHK_WIDEINST
+	if(code == FHKS_VREF)
+		D->arg_vref = *arg.s_vref;
+	else if(code == FHKS_MAPCALL)
+		D->arg_ref = *arg.s_mapcall;
+#endif
+
+	if(UNLIKELY(P) && code == FHKS_MODCALL)
+		prof_modcall(S, P, arg.s_modcall);
+
+	int32_t idx = (code == FHKS_MODCALL) ? ((fhk_eref *) (uintptr_t) arg.u64)->idx : D->arg_ref.idx;
 	return dispatch[idx];
 }
 
+// the solve on `S` was abandoned (a handler raised an error), so the solver won't be
+// continued again. forget its model call, nested solves have already been abandoned.
+void fhkD_abort(fhk_solver *S){
+	if(prof_top && prof_stack[prof_top-1].S == S)
+		prof_top--;
+}
+
 void fhkD_setvaluei_u64(fhk_solver *S, fhk_idx xi, fhk_inst inst, uint32_t num, uintptr_t p){
 	fhkS_setvaluei(S, xi, inst, num, (void *) p);
 }
@@ -32,3 +105,19 @@ void fhkD_setvaluei_offset(fhk_solver *S, fhk_idx xi, fhk_inst inst, uint32_t nu
 		uint32_t offset){
 	fhkS_setvaluei(S, xi, inst, num, p+offset);
 }
+
+void fhkD_setvaluei_vec(fhk_solver *S, fhk_idx xi, fhk_inst inst, struct vec *v, uint16_t band){
+	assert(!v->n_dead);
+	void *p = v->bands[band];
+	uint32_t num = v->n_used;
+
+	if(!v->info || !VEC_TILED(v->info, band)){
+		fhkS_setvaluei(S, xi, inst, num, p);
+		return;
+	}
+
+	// interleaved band: each tile is a contiguous run of `tile` values
+	uint32_t tile = v->info->tile;
+	for(uint32_t i=0; i<num; i+=tile, p+=v->info->tile_size)
+		fhkS_setvaluei(S, xi, inst+i, (num-i) < tile ? (num-i) : tile, p);
+}
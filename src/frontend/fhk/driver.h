@@ -5,6 +5,20 @@
 #include <stdint.h>
 #include <stddef.h>
 
+struct vec;
+
+// per-model modcall profile, see fhkD_continue
+typedef struct fhkD_mprof {
+	uint64_t calls;            // number of modcalls
+	uint64_t insts;            // instances computed (batched calls compute many per call)
+	uint64_t ns;               // wall time spent in the model (from request to next continue),
+	                           // minus the time of profiled models in nested solves
+} fhkD_mprof;
+
+typedef struct fhkD_profile {
+	fhkD_mprof *models;        // indexed by model index (negative)
+} fhkD_profile;
+
 typedef struct fhkD_dispatch {
 	union {
 		struct {
@@ -16,16 +30,23 @@ typedef struct fhkD_dispatch {
 	};
 
 	// relevant part of fhk_sarg
+	// (with FHK_WIDEINST, vref and mapcall arguments are copied here)
 	union {
 		fhk_sarg arg;
 		fhk_eref arg_ref;
+		fhk_vref arg_vref;
 		void *arg_ptr;
 	};
+
+	// optional model profile, NULL when not profiling
+	fhkD_profile *profile;
 } fhkD_dispatch;
 
 int32_t fhkD_continue(fhk_solver *S, fhkD_dispatch *D);
+void fhkD_abort(fhk_solver *S);
 
 // wrappers to reduce type-cast ceremonies
 void fhkD_setvaluei_u64(fhk_solver *S, fhk_idx xi, fhk_inst inst, uint32_t num, uintptr_t p);
 void fhkD_setvaluei_offset(fhk_solver *S, fhk_idx xi, fhk_inst inst, uint32_t num, void *p,
 		uint32_t offset);
+void fhkD_setvaluei_vec(fhk_solver *S, fhk_idx xi, fhk_inst inst, struct vec *v, uint16_t band);
@@ -48,6 +48,7 @@ local function build(nodeset, alloc)
 	dispatch.vref     = alloc(givnum*u16, u16)
 	dispatch.mapcall  = inum + ffi.cast("uint16_t *", alloc((inum+knum)*u16, u16))
 	dispatch.modcall  = G.nm + ffi.cast("uint16_t *", alloc(G.nm*u16, u16))
+	dispatch.profile  = nil
 
 	local jumptable = { [0]=dispatch_ok, [1]=dispatch_err(dispatch, syms) }
 	local dispinfo = { dispatch = dispatch, jumptable = jumptable }
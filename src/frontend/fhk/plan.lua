@@ -93,7 +93,7 @@ local function compile_state(plan, view, G, shapef)
 		plan.shared_obtain, plan.shared_release = state.shared_arena()
 	end
 
-	return compile.pushstate_uncached(G, shapef, plan.shared_obtain), plan.shared_release
+	return compile.pushstate_uncached(G, shapef, plan.shared_obtain, plan.shared_release)
 end
 
 local function materialize(plan, nodeset)
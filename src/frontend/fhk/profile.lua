@@ -0,0 +1,142 @@
+local cli = require "cli"
+local ffi = require "ffi"
+
+-- model profiles by name. the same model may be in several subgraphs, each subgraph has
+-- its own counters (see fhkD_profile), they are summed when reading.
+--     [name] -> { k=k, c=c, counters={ fhkD_mprof *, ... } }
+local models = {}
+
+-- keeps the counter buffers alive, the dispatch only holds pointers.
+local anchor = {}
+
+---- collection ----------------------------------------
+
+-- `info` is the subgraph trace event, see plan.materialize
+local function attach(info)
+	local G = info.G
+	local buf = ffi.new("fhkD_mprof[?]", G.nm)
+	local P = ffi.new("fhkD_profile")
+	P.models = buf + G.nm
+	info.dispatch.profile = P
+	table.insert(anchor, { buf, P })
+
+	for name,node in pairs(info.nodeset.models) do
+		-- use the definition's costs, the materialized nodeset may have penalties merged in k.
+		local def = info.full_nodeset.models[name] or node
+		if not models[name] then
+			models[name] = { k=def.k, c=def.c, counters={} }
+		end
+		table.insert(models[name].counters, P.models + info.mapping.nodes[node])
+	end
+end
+
+local function reset()
+	for _,m in pairs(models) do
+		for _,mp in ipairs(m.counters) do
+			mp.calls, mp.insts, mp.ns = 0, 0, 0
+		end
+	end
+end
+
+-- summed counters of each called model, sorted by total time
+local function collect()
+	local out = {}
+
+	for name,m in pairs(models) do
+		local calls, insts, ns = 0, 0, 0
+		for _,mp in ipairs(m.counters) do
+			calls = calls + tonumber(mp.calls)
+			insts = insts + tonumber(mp.insts)
+			ns = ns + tonumber(mp.ns)
+		end
+
+		if calls > 0 then
+			table.insert(out, {
+				name  = name,
+				k     = m.k,
+				c     = m.c,
+				calls = calls,
+				insts = insts,
+				ns    = ns
+			})
+		end
+	end
+
+	table.sort(out, function(a, b) return a.ns > b.ns end)
+	return out
+end
+
+---- output ----------------------------------------
+
+local function report(out)
+	out = out or io.stderr
+	local prof = collect()
+
+	local total = 0
+	for _,p in ipairs(prof) do total = total + p.ns end
+
+	out:write(cli.bold(string.format("%-30s %10s %12s %10s %10s %10s %6s\n",
+		"model", "calls", "instances", "inst/call", "ns/inst", "total ms", "%")))
+
+	for _,p in ipairs(prof) do
+		out:write(
+			cli.blue(string.format("%-30s", p.name)),
+			string.format(" %10d %12d %10.1f %10.1f %10.3f %6.1f\n",
+				p.calls, p.insts, p.insts/p.calls, p.ns/p.insts, p.ns/1e6,
+				total > 0 and 100*p.ns/total or 0)
+		)
+	end
+end
+
+-- calibrated model costs in graph definition syntax.
+-- k becomes the measured time per instance, c is kept as defined (the profile only measures
+-- the models themselves, not how parameter costs should accumulate). a model that runs a
+-- nested solve isn't charged for the profiled models of that solve, see fhkD_mprof.
+-- `unit` is the number of nanoseconds per cost unit. the default scales the calibrated costs
+-- so that the profiled models keep their current total k, which keeps them comparable with
+-- penalties and the costs of models that were never called.
+local function calibrate(unit)
+	local prof = collect()
+
+	if not unit then
+		local ktot, ttot = 0, 0
+		for _,p in ipairs(prof) do
+			ktot = ktot + p.k
+			ttot = ttot + p.ns/p.insts
+		end
+		unit = (ktot > 0 and ttot > 0) and ttot/ktot or 1
+	end
+
+	local out = {
+		string.format("-- calibrated costs of %d models, 1 cost unit = %g ns", #prof, unit)
+	}
+
+	table.sort(prof, function(a, b) return a.name < b.name end)
+	for _,p in ipairs(prof) do
+		table.insert(out, string.format("model %q { cost { k=%.6g, c=%.6g } }",
+			p.name, p.ns/p.insts/unit, p.c))
+	end
+
+	return table.concat(out, "\n") .. "\n"
+end
+
+-- trace exit event: print the report, and write calibrated costs to $M2_FHK_COSTS if set.
+local function exit()
+	report()
+
+	local fname = os.getenv("M2_FHK_COSTS")
+	if fname then
+		local fp = assert(io.open(fname, "w"))
+		fp:write(calibrate(tonumber(os.getenv("M2_FHK_COSTUNIT"))))
+		fp:close()
+	end
+end
+
+return {
+	attach    = attach,
+	reset     = reset,
+	collect   = collect,
+	report    = report,
+	calibrate = calibrate,
+	exit      = exit
+}
@@ -64,7 +64,7 @@ local function inject(env, def)
 		group          = view.group,
 		struct_view    = view.struct_view,
 		array_view     = view.array_view,
-		soa_view       = view.soa_view,
+		soa_view       = function(ctype, source) return view.soa_view(ctype, source, sim) end,
 		size_view      = view.size_view,
 		fixed_size     = view.fixed_size,
 		edge_view      = view.edge_view,
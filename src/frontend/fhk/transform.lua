@@ -146,7 +146,8 @@ local function materialize(nodeset, view)
 			create = create,
 			k      = mod.k,
 			c      = mod.c,
-			cmin   = mod.cmin
+			cmin   = mod.cmin,
+			batch  = mod.batch
 		})
 
 		for i,edge in ipairs(mod.params) do 
@@ -317,7 +318,8 @@ local function build(nodeset, order, alloc)
 	end
 
 	for _,m in iter_order(order and order.models or nodeset.models) do
-		local obj = D:add_model(mapping.groups[graph.groupof(m.name)], m.k, m.c, m.cmin or m.k)
+		local obj = D:add_model(mapping.groups[graph.groupof(m.name)], m.k, m.c, m.cmin or m.k,
+			m.batch and C.FHKM_BATCH or 0)
 		objs[m] = obj
 
 		for _,e in ipairs(m.params) do
@@ -417,7 +419,8 @@ local function _prune(nodeset, retain, mapping, P)
 				shadows = m.shadows,
 				k       = m.k,
 				c       = m.c,
-				cmin    = bounds[mapping.nodes[m]][0]
+				cmin    = bounds[mapping.nodes[m]][0],
+				batch   = m.batch
 			})
 
 			-- TODO: the pruner should really just set flags for shadows as well..
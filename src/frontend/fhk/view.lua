@@ -205,10 +205,12 @@ end
 
 local soa_view_mt = { __index={} }
 
-local function soa_view(ctype, source)
+-- sim (optional) is used to compact lazily deleted source vectors before they are read
+local function soa_view(ctype, source, sim)
 	return setmetatable({
 		refct  = reflect.typeof(ctype),
-		source = source
+		source = source,
+		sim    = sim
 	}, soa_view_mt)
 end
 
@@ -217,11 +219,14 @@ function soa_view_mt.__index:var(var, name)
 	local field = self.refct:member(name)
 	if not field then return end
 
+	-- band index in struct vec, the driver uses this to handle interleaved bands
+	local bandidx = (field.offset - ffi.offsetof("struct vec", "bands")) / ffi.sizeof("void *")
+
 	return field.type.element_type, function(dispatch, idx)
 		if type(self.source) == "cdata" then
-			return compile.setvalue_soa_constptr(dispatch, idx, self.source, name, var.name)
+			return compile.setvalue_soa_constptr(dispatch, idx, self.source, name, bandidx, var.name)
 		else
-			return compile.setvalue_soa_userfunc(dispatch, idx, self.source, name, var.name)
+			return compile.setvalue_soa_userfunc(dispatch, idx, self.source, name, bandidx, var.name)
 		end
 	end
 end
@@ -231,7 +236,12 @@ function soa_view_mt.__index:shape(group)
 
 	if type(self.source) == "cdata" then
 		local inst = ffi.cast("struct vec *", self.source)
+		local sim = self.sim
+		-- the shape is read before any values, so this is where dead rows go away
 		return function()
+			if inst.n_dead > 0 and sim then
+				C.simF_vec_compact(sim, inst)
+			end
 			return inst.n_used
 		end
 	end
@@ -345,6 +355,8 @@ local function signature(name, nodeset)
 		}
 	end
 
+	signature.batch = model.batch
+
 	return signature
 end
 
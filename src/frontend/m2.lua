@@ -58,7 +58,8 @@ local function verbose_cmd(stream)
 	for flag in stream():sub(3):gmatch(".") do
 		local msg = tracemsg[flag] or error(string.format("invalid trace option: '%s'", flag))
 		for event,func in pairs(msg.attach) do
-			trace[event] = func
+			local prev = trace[event]
+			trace[event] = prev and function(...) prev(...) func(...) end or func
 		end
 	end
 end
@@ -121,6 +122,7 @@ local function main(args)
 	end
 
 	cmd.main(args)
+	require("trace")("exit")
 
 	return 0
 end
@@ -5,6 +5,7 @@ local misc = require "misc"
 local reflect = require "lib.reflect"
 local ffi = require "ffi"
 local C = ffi.C
+local rshift, band = bit.rshift, bit.band
 
 local vec_ctp = ffi.typeof("struct vec *")
 
@@ -20,16 +21,79 @@ local function ctbands(refct)
 	end)
 end
 
+-- accessor for an interleaved (AoSoA) band, see vec.h.
+-- indexing works like a plain pointer:
+--     local d = trees:band("d")
+--     d[i] = d[i] + 1
+local function tileview_ct(elemct, info, idx)
+	local tile, tile_size, stride = info.tile, info.tile_size, info.stride[idx]
+	local mask, shift = tile-1, 0
+	while bit.lshift(1, shift) < tile do shift = shift+1 end
+	local ptrct = ffi.typeof("$*", elemct)
+
+	local function ptr(self, i)
+		return ffi.cast(ptrct, self.p + rshift(i, shift)*tile_size + band(i, mask)*stride)
+	end
+
+	return ffi.metatype(ffi.typeof("struct { uint8_t *p; }"), {
+		__index    = function(self, i) return ptr(self, i)[0] end,
+		__newindex = function(self, i, v) ptr(self, i)[0] = v end
+	})
+end
+
+local function unpackslots(slots, i, n)
+	if i < n then
+		return tonumber(slots[i]), unpackslots(slots, i+1, n)
+	end
+end
+
+-- chunked iteration, see vec_chunked() in vec.c.
+-- f is either a C function pointer (vec_chunk_f), which runs on the openmp thread team,
+-- or a lua function f(vec, from, to, slot), which runs serially with the same chunk boundaries
+-- and summation order (luajit callbacks can't be run from other threads).
+-- returns the nslot reduction results.
+local function chunked(self, f, nslot, arg, chunk)
+	local vp = ffi.cast(vec_ctp, self)
+	nslot = nslot or 0
+	chunk = C.vec_chunk_size(vp, chunk or 0)
+	local n = vp.n_used
+	local nc = math.ceil(n / chunk)
+	local slots = ffi.new("double[?]", math.max(nc, 1)*nslot)
+
+	if type(f) == "function" then
+		for c=0, nc-1 do
+			f(self, c*chunk, math.min(n, (c+1)*chunk), slots+c*nslot)
+		end
+
+		for c=1, nc-1 do
+			for i=0, nslot-1 do
+				slots[i] = slots[i] + slots[c*nslot+i]
+			end
+		end
+	else
+		C.vec_chunked(vp, chunk, f, arg, slots, nslot, true)
+	end
+
+	return unpackslots(slots, 0, nslot)
+end
+
+local function istiled(info, idx)
+	return info.tile ~= 0 and info.offset[idx] ~= C.VEC_SOA
+end
+
 -- Note: by setting this metatype, you bind the ctype to the simulator, ie. you can't use
 -- the same ctype with another _sim instance (probably won't be a problem, I can't think why
 -- you would want more than one _sim instance.)
 local function refvec_mt(_sim, ctype, info, slicect)
 	local refct = reflect.typeof(ctype)
-	local band_stride = {}
+	local band_stride, tileview = {}, {}
 
 	-- skip info, n_alloc, n_used
 	for memb, idx in ctbands(refct) do
 		band_stride[memb.name] = info.stride[idx]
+		if istiled(info, idx) then
+			tileview[memb.name] = tileview_ct(memb.type.element_type, info, idx)
+		end
 	end
 
 	local ctp = ffi.typeof("$*", ctype)
@@ -46,18 +110,26 @@ local function refvec_mt(_sim, ctype, info, slicect)
 				return (tonumber(C.simF_vec_alloc(_sim, ffi.cast(vec_ctp, self), n)))
 			end,
 
+			-- for interleaved bands this replaces the whole tile, ie. all interleaved bands
+			-- get new pointers.
 			newband = function(self, name)
 				local old = self[name]
-				local vp = ffi.cast(vec_ctp, self)
-				self[name] = C.simF_vec_create_band_stride(
-					_sim,
-					ffi.cast(vec_ctp, self),
-					band_stride[name]
-				)
+				if tileview[name] then
+					C.simF_vec_create_tiles(_sim, ffi.cast(vec_ctp, self))
+				else
+					self[name] = C.simF_vec_create_band_stride(
+						_sim,
+						ffi.cast(vec_ctp, self),
+						band_stride[name]
+					)
+				end
 				return self[name], old
 			end,
 
 			xnewband = function(self, name)
+				if tileview[name] then
+					error(string.format("xnewband: band '%s' is interleaved", name))
+				end
 				return ffi.cast(ffi.typeof(self[name]), C.simF_vec_create_band_stride(
 					_sim,
 					ffi.cast(vec_ctp, self),
@@ -65,6 +137,66 @@ local function refvec_mt(_sim, ctype, info, slicect)
 				))
 			end,
 
+			-- indexable view of a band, use this instead of raw pointers if the vector
+			-- has interleaved bands.
+			band = function(self, name)
+				local tv = tileview[name]
+				if tv then
+					return tv(ffi.cast("uint8_t *", self[name]))
+				end
+				return self[name]
+			end,
+
+			-- dead rows are compacted away first, so the chunks only see live rows.
+			chunked = function(self, f, nslot, arg, chunk)
+				C.simF_vec_compact(_sim, ffi.cast(vec_ctp, self))
+				return chunked(self, f, nslot, arg, chunk)
+			end,
+
+			-- lazy deletion, see simV_vec_lazydel() in vec.c.
+			-- deleted rows are still counted in #vec, skip them with dead(i).
+			-- vmath kernels don't know about dead rows, compact() before passing them bands.
+			lazydel = function(self)
+				C.simV_vec_lazydel(_sim, ffi.cast(vec_ctp, self))
+			end,
+
+			compact = function(self)
+				C.simF_vec_compact(_sim, ffi.cast(vec_ctp, self))
+			end,
+
+			dead = function(self, i)
+				local tomb = ffi.cast(vec_ctp, self).tomb
+				return tomb ~= nil and band(rshift(tomb[rshift(i, 6)], band(i, 63)), 1) ~= 0
+			end,
+
+			live = function(self)
+				local vp = ffi.cast(vec_ctp, self)
+				return tonumber(vp.n_used - vp.n_dead)
+			end,
+
+			-- change tracking, see vec_changed() in vec.c.
+			-- newband() and xnewband() mark every row. other writes through raw band pointers
+			-- aren't seen, use set() or touch() for those.
+			track = function(self)
+				C.simF_vec_track(_sim, ffi.cast(vec_ctp, self))
+			end,
+
+			touch = function(self, from, n)
+				C.simF_vec_touch(_sim, ffi.cast(vec_ctp, self), from, n or 1)
+			end,
+
+			set = function(self, name, i, x)
+				self:band(name)[i] = x
+				C.simF_vec_touch(_sim, ffi.cast(vec_ctp, self), i, 1)
+			end,
+
+			-- returns bitmap, number of changed rows
+			changed = function(self, fid)
+				local vp = ffi.cast(vec_ctp, self)
+				local bits = ffi.new("uint64_t[?]", math.ceil(vp.n_used/64))
+				return bits, tonumber(C.vec_changed(vp, fid or 0, bits))
+			end,
+
 			delete = function(self, idx, n)
 				if type(idx) == "table" then
 					-- TODO: alloc this on sim ephemeral region when
@@ -95,28 +227,42 @@ local function refvec_mt(_sim, ctype, info, slicect)
 	}
 end
 
-local function refproto(alloc, ctype)
+-- layout (optional): { tile=8, interleave={"band1", "band2", ...} }
+local function refproto(_sim, ctype, layout)
 	local refct = reflect.typeof(ctype)
-	local stride = {}
+	local stride, index = {}, {}
 	local nb = 0
 
 	for memb, idx in ctbands(refct) do
 		stride[idx] = memb.type.element_type.size
+		index[memb.name] = idx
 		nb = nb+1
 	end
 
-	-- TODO: probably would be cleaner to make a vec_info_size(...) function in C
-	local proto = ffi.cast("struct vec_info *", alloc(
-		ffi.sizeof("struct vec_info") + nb*ffi.sizeof("uint16_t"),
-		ffi.alignof("struct vec_info")
-	))
-
-	proto.n_bands = nb
+	local strides = ffi.new("uint16_t[?]", nb)
 	for i=0, nb-1 do
-		proto.stride[i] = stride[i]
+		strides[i] = stride[i]
+	end
+
+	if not (layout and layout.tile) then
+		return C.simS_vec_create_info(_sim, nb, strides)
 	end
 
-	return proto
+	local interleave = layout.interleave or {}
+	local tiled = ffi.new("uint16_t[?]", #interleave)
+	for i,name in ipairs(interleave) do
+		if not index[name] then
+			error(string.format("interleaved band doesn't exist: %s", name))
+		end
+		tiled[i-1] = index[name]
+	end
+
+	local info = C.simS_vec_create_info_tiled(_sim, nb, strides, layout.tile, #interleave, tiled)
+	if info == nil then
+		error(string.format("invalid tile layout (tile=%d)", layout.tile))
+	end
+
+	return info
 end
 
 -- use this on a customized slice type, ie.
@@ -164,22 +310,27 @@ end
 -- vec_loop(band1, band2, ..., bandN)
 -- for use with vmath.loop()
 local function vec_loop(...)
-	local bandidx = {}
+	local bandvar, bandidx = {}, {}
 	for i,v in ipairs({...}) do
-		bandidx[i] = string.format("vec['%s'][___i]", v)
+		bandvar[i] = string.format("local ___b%d = vec:band('%s')", i, v)
+		bandidx[i] = string.format("___b%d[___i]", i)
 	end
+	bandvar = table.concat(bandvar, "\n")
 	bandidx = table.concat(bandidx, ", ")
 
 	return function(loop)
 		return string.format([[
 		function(vec, ___state)
+			%s
 			%s
 			for ___i=0, #vec-1 do
-				%s
+				if not vec:dead(___i) then
+					%s
+				end
 			end
 			%s
 		end
-		]], loop.preloop(), loop.body(bandidx .. ", ___state"), loop.postloop())
+		]], bandvar, loop.preloop(), loop.body(bandidx .. ", ___state"), loop.postloop())
 	end
 end
 
@@ -210,10 +361,9 @@ end
 local function inject(env)
 	local _sim = env.m2.sim
 
-	local function reflct(ctype, info, slicect)
+	local function reflct(ctype, info, slicect, layout)
 		if not info then
-			-- TODO: sim allocator
-			info = refproto(_sim:allocator("static"), ctype)
+			info = refproto(_sim, ctype, layout)
 		end
 
 		if not slicect then
@@ -228,9 +378,10 @@ local function inject(env)
 		loop        = vec_loop,
 		reflect     = reflct,
 
-		from_bands  = function(bands, meta)
+		-- layout: see refproto
+		from_bands  = function(bands, meta, layout)
 			local ct = ctfrombands(bands)
-			local mt, info, slicect = reflct(ct)
+			local mt, info, slicect = reflct(ct, nil, nil, layout)
 			if meta then mt = mt_merge(meta, mt) end
 			ffi.metatype(ct, mt)
 			return ct, info, slicect
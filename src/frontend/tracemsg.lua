@@ -55,6 +55,14 @@ local function solvertrace(info)
 	require("fhk.debug").trace(info)
 end
 
+local function profile(info)
+	require("fhk.profile").attach(info)
+end
+
+local function profilereport()
+	require("fhk.profile").exit()
+end
+
 local function subgraphinfo(info)
 	local vars, models, shadows, ufuncs = {}, {}, {}, {}
 	for name,_ in pairs(info.full_nodeset.vars) do table.insert(vars, name) end
@@ -150,5 +158,7 @@ return {
 	e = { attach={emit=emit}, help="emitted code" },
 	s = { attach={subgraph=subgraphinfo}, help="fhk subgraph information" },
 	S = { attach={subgraph=solvertrace}, help="fhk solver events (very slow)" },
+	P = { attach={subgraph=profile, exit=profilereport},
+		help="fhk model profile at exit (M2_FHK_COSTS=<file>: write calibrated costs)" },
 	p = { attach={ioinfo=ioinfo}, help="simulation progress" }
 }
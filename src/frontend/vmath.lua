@@ -22,8 +22,13 @@ ffi.cdef [[ int memcmp ( const void *, const void *, size_t); ]]
 --     local ba = vmath.real(trees.ba, #trees)
 --     ba:mul(trees.f)
 --     ba:mul(1/10000)
+--
+-- procedural-style functions dispatch on the ctype of the first vector, so float bands use
+-- the single precision kernels. sums, dot products and averages of float vectors are accumulated
+-- in double precision unless the `float` table is used directly.
 
 local sizeof_double = ffi.sizeof("double")
+local sizeof_float = ffi.sizeof("float")
 
 --------------------------------------------------------------------------------
 
@@ -54,26 +59,148 @@ end
 
 local function vdsubc(d, x, c, n) C.vdaddc(d, x, -c, n) end
 local function vdsubv(d, x, y, n) C.vdaddsv(d, x, -1, y, n) end
+-- scratch space for vdquantw, grown as needed
+local scratch, scratch_n = nil, 0
+
+local function getscratch(n)
+	if n > scratch_n then
+		scratch = alloc.malloc("double", n)
+		scratch_n = n
+	end
+	return scratch
+end
+
+-- reduction modes, by name or VMATH_RED_* constant
+local redmodes = {
+	fast     = C.VMATH_RED_FAST,
+	pairwise = C.VMATH_RED_PAIRWISE,
+	kahan    = C.VMATH_RED_KAHAN,
+	repro    = C.VMATH_RED_REPRO
+}
+
+local function toredmode(mode)
+	if type(mode) == "string" then
+		local m = redmodes[mode]
+		if not m then
+			error(string.format("invalid reduction mode: %s", mode))
+		end
+		return m
+	end
+	return mode
+end
+
+-- set the process-wide reduction mode of sum, dot and avgw, returns the previous mode
+local function setredmode(mode)
+	return ffi.string(C.vmath_redmode_name(C.vmath_set_redmode(toredmode(mode))))
+end
+
+local function vdquantw(x, w, q, n) return (C.vdquantw(x, w, q, n, getscratch(2*n))) end
+
+local function vdpowc(d, x, c, n) C.vdspow(d, 1, x, c, n) end
+local function vfsubc(d, x, c, n) C.vfaddc(d, x, -c, n) end
+local function vfsubv(d, x, y, n) C.vfaddsv(d, x, -1, y, n) end
 
 local vmath_f = {
 	double = {
 		set      = C.vdsetc,
 		add      = overload2(C.vdaddc, C.vdaddv),
 		sub      = overload2(vdsubc, vdsubv),
-		saddc    = function(x, a, b, n, d) C.vdaddsc(d or x, a, x, b, n) end,
+		saddc    = function(x, a, b, n, d) C.vdsaddc(d or x, a, x, b, n) end,
 		adds     = function(x, a, y, n, d) C.vdaddsv(d or x, x, a, y, n) end,
 		mul      = overload2(C.vdscale, C.vdmulv),
 		refl     = function(x, a, y, n, d) C.vdrefl(d or x, a, x, y, n) end,
-		area     = function(x, n, d) C.vdaread(d, x, n) end,
+		area     = function(x, n, d) C.vdaread(d or x, x, n) end,
 		sum      = C.vdsum,
 		summ8    = C.vdsumm8,
 		dot      = C.vddot,
 		avgw     = C.vdavgw,
+		sumr     = function(x, n, mode) return (C.vdsumr(x, n, toredmode(mode))) end,
+		dotr     = function(x, y, n, mode) return (C.vddotr(x, y, n, toredmode(mode))) end,
+		avgwr    = function(x, w, n, mode) return (C.vdavgwr(x, w, n, toredmode(mode))) end,
+		sumg8    = C.vdsumg8,
+		sumwg8   = C.vdsumwg8,
+		cntg8    = C.vdcntg8,
+		quantw   = vdquantw,
+		cdfw     = function(x, w, t, nt, n, d) C.vdcdfw(d, t, nt, x, w, n) end,
+		histw    = function(x, w, lo, width, nbin, n, h) C.vdhistw(h, nbin, lo, width, x, w, n) end,
+		exp      = function(x, n, d) C.vdexp(d or x, x, n) end,
+		sexp     = function(x, a, b, n, d) C.vdsexp(d or x, a, b, x, n) end,
+		log      = function(x, n, d) C.vdlog(d or x, x, n) end,
+		pow      = overload2(vdpowc, C.vdpow),
+		spow     = function(x, a, b, n, d) C.vdspow(d or x, a, x, b, n) end,
+		sqrt     = function(x, n, d) C.vdsqrt(d or x, x, n) end,
 		copy     = function(dest, src, n) ffi.copy(dest, src, n*sizeof_double) end,
 		tostring = vecstr,
+	},
+
+	float = {
+		set      = C.vfsetc,
+		add      = overload2(C.vfaddc, C.vfaddv),
+		sub      = overload2(vfsubc, vfsubv),
+		saddc    = function(x, a, b, n, d) C.vfsaddc(d or x, a, x, b, n) end,
+		adds     = function(x, a, y, n, d) C.vfaddsv(d or x, x, a, y, n) end,
+		mul      = overload2(C.vfscale, C.vfmulv),
+		refl     = function(x, a, y, n, d) C.vfrefl(d or x, a, x, y, n) end,
+		area     = function(x, n, d) C.vfaread(d or x, x, n) end,
+		sum      = C.vfsum,
+		summ8    = C.vfsumm8,
+		dot      = C.vfdot,
+		avgw     = C.vfavgw,
+		copy     = function(dest, src, n) ffi.copy(dest, src, n*sizeof_float) end,
+		tostring = vecstr,
+	},
+
+	-- f32 inputs, f64 accumulators
+	mixed = {
+		sum      = C.vfsumd,
+		summ8    = C.vfsumm8d,
+		dot      = function(x, y, n)
+			if ffi.istype("double *", y) then
+				return (C.vfddot(x, y, n))
+			end
+			return (C.vfdotd(x, y, n))
+		end,
+		avgw     = function(x, w, n)
+			if ffi.istype("double *", w) then
+				return (C.vfdavgw(x, w, n))
+			end
+			return (C.vfavgwd(x, w, n))
+		end
 	}
 }
 
+-- procedural-style entry points: pick the kernel family by the ctype of the first argument.
+-- only the first argument is checked, mixing float and double vectors (other than in the
+-- mixed reductions) is undefined.
+local float_ptr = ffi.typeof("float *")
+
+local function dispatch(name, ff)
+	local fd = vmath_f.double[name]
+	ff = ff or vmath_f.float[name]
+	return function(x, ...)
+		if ffi.istype(float_ptr, x) then
+			return ff(x, ...)
+		end
+		return fd(x, ...)
+	end
+end
+
+for _,name in ipairs({"set", "add", "sub", "saddc", "adds", "mul", "refl", "area", "copy"}) do
+	vmath_f[name] = dispatch(name)
+end
+
+for _,name in ipairs({"sum", "summ8", "dot", "avgw"}) do
+	vmath_f[name] = dispatch(name, vmath_f.mixed[name])
+end
+
+-- grouped reductions, distributions and transcendental functions only have double kernels
+for _,name in ipairs({"sumr", "dotr", "avgwr", "sumg8", "sumwg8", "cntg8", "quantw", "cdfw", "histw",
+	"exp", "sexp", "log", "pow", "spow", "sqrt"}) do
+	vmath_f[name] = vmath_f.double[name]
+end
+
+vmath_f.tostring = vecstr
+
 --------------------------------------------------------------------------------
 
 local function todatad(x)
@@ -87,11 +214,15 @@ local function overload2vd(scalarf, vectorf)
 		if isscalar(p) then
 			scalarf(d, self.data, p, self.n)
 		else
-			vectorf(d, self.data, todata(p), self.n)
+			vectorf(d, self.data, todatad(p), self.n)
 		end
 	end
 end
 
+-- masked vectors: operations only apply to the selected elements, unselected elements of
+-- the destination get the source value.
+
+-- selected by class: k[i] in mask
 local vecm8d_ct = ffi.metatype([[
 	struct {
 		double *data;
@@ -99,10 +230,90 @@ local vecm8d_ct = ffi.metatype([[
 		uint64_t mask;
 		size_t n;
 	}]], {
-	
+
 	__index = {
-		sum   = function(self) return (C.vsumm8(self.data, self.k, self.mask, self.n)) end
-	}
+		add   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdaddcm8(d, self.data, p, self.k, self.mask, self.n)
+			else
+				C.vdaddsvm8(d, self.data, 1, todatad(p), self.k, self.mask, self.n)
+			end
+		end,
+		sub   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdaddcm8(d, self.data, -p, self.k, self.mask, self.n)
+			else
+				C.vdaddsvm8(d, self.data, -1, todatad(p), self.k, self.mask, self.n)
+			end
+		end,
+		adds  = function(self, a, y, d)
+			C.vdaddsvm8(d and todatad(d) or self.data, self.data, a, todatad(y), self.k, self.mask,
+				self.n)
+		end,
+		mul   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdscalem8(d, self.data, p, self.k, self.mask, self.n)
+			else
+				C.vdmulvm8(d, self.data, todatad(p), self.k, self.mask, self.n)
+			end
+		end,
+		sum   = function(self) return (C.vdsumm8(self.data, self.k, self.mask, self.n)) end,
+		dot   = function(self, y)
+			return (C.vddotm8(self.data, todatad(y), self.k, self.mask, self.n))
+		end,
+		avgw  = function(self, w)
+			return (C.vdavgwm8(self.data, todatad(w), self.k, self.mask, self.n))
+		end
+	},
+
+	__len = function(self) return tonumber(self.n) end
+})
+
+-- selected by bitmap: bit i of bm set
+local vecmbd_ct = ffi.metatype([[
+	struct {
+		double *data;
+		uint64_t *bm;
+		size_t n;
+	}]], {
+
+	__index = {
+		add   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdaddcmb(d, self.data, p, self.bm, self.n)
+			else
+				C.vdaddsvmb(d, self.data, 1, todatad(p), self.bm, self.n)
+			end
+		end,
+		sub   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdaddcmb(d, self.data, -p, self.bm, self.n)
+			else
+				C.vdaddsvmb(d, self.data, -1, todatad(p), self.bm, self.n)
+			end
+		end,
+		adds  = function(self, a, y, d)
+			C.vdaddsvmb(d and todatad(d) or self.data, self.data, a, todatad(y), self.bm, self.n)
+		end,
+		mul   = function(self, p, d)
+			d = d and todatad(d) or self.data
+			if isscalar(p) then
+				C.vdscalemb(d, self.data, p, self.bm, self.n)
+			else
+				C.vdmulvmb(d, self.data, todatad(p), self.bm, self.n)
+			end
+		end,
+		sum   = function(self) return (C.vdsummb(self.data, self.bm, self.n)) end,
+		dot   = function(self, y) return (C.vddotmb(self.data, todatad(y), self.bm, self.n)) end,
+		avgw  = function(self, w) return (C.vdavgwmb(self.data, todatad(w), self.bm, self.n)) end
+	},
+
+	__len = function(self) return tonumber(self.n) end
 })
 
 local vecd_ct = ffi.metatype([[
@@ -129,18 +340,48 @@ local vecd_ct = ffi.metatype([[
 		sum   = function(self) return (C.vdsum(self.data, self.n)) end,
 		dot   = function(self, y) return (C.vddot(self.data, todatad(y), self.n)) end,
 		avgw  = function(self, w) return (C.vdavgw(self.data, todatad(w), self.n)) end,
-		mask  = function(self, mask, m) return (vecm_ct(self.data, mask, m, self.n)) end
+		sumr  = function(self, mode) return (C.vdsumr(self.data, self.n, toredmode(mode))) end,
+		dotr  = function(self, y, mode)
+			return (C.vddotr(self.data, todatad(y), self.n, toredmode(mode)))
+		end,
+		avgwr = function(self, w, mode)
+			return (C.vdavgwr(self.data, todatad(w), self.n, toredmode(mode)))
+		end,
+		exp   = function(self, d) C.vdexp(d and todatad(d) or self.data, self.data, self.n) end,
+		sexp  = function(self, a, b, d)
+			C.vdsexp(d and todatad(d) or self.data, a, b, self.data, self.n)
+		end,
+		log   = function(self, d) C.vdlog(d and todatad(d) or self.data, self.data, self.n) end,
+		pow   = overload2vd(vdpowc, C.vdpow),
+		spow  = function(self, a, b, d)
+			C.vdspow(d and todatad(d) or self.data, a, self.data, b, self.n)
+		end,
+		sqrt  = function(self, d) C.vdsqrt(d and todatad(d) or self.data, self.data, self.n) end,
+		sumg8 = function(self, out, nclass, k) C.vdsumg8(todatad(out), nclass, self.data, k, self.n) end,
+		sumwg8 = function(self, out, nclass, w, k)
+			C.vdsumwg8(todatad(out), nclass, self.data, todatad(w), k, self.n)
+		end,
+		quantw = function(self, w, q) return vdquantw(self.data, todatad(w), q, self.n) end,
+		cdfw  = function(self, w, t, nt, d)
+			C.vdcdfw(todatad(d), todatad(t), nt, self.data, todatad(w), self.n)
+		end,
+		histw = function(self, w, lo, width, nbin, h)
+			C.vdhistw(todatad(h), nbin, lo, width, self.data, todatad(w), self.n)
+		end,
+		mask  = function(self, k, mask) return (vecm8d_ct(self.data, k, mask, self.n)) end,
+		maskb = function(self, bm) return (vecmbd_ct(self.data, bm, self.n)) end
 	},
 
 	__tostring = function(self) return vecstr(self.data, self.n) end,
 	__len = function(self) return tonumber(self.n) end,
 	__eq = function(self, other)
-		return C.memcmp(self.data, todata(other), self.n*sizeof_double) ~= 0
+		return C.memcmp(self.data, todatad(other), self.n*sizeof_double) == 0
 	end
 })
 
-vmath_f.double.vec = vec_ct
-vmath_f.double.vecm8 = vecm_ct
+vmath_f.double.vec = vecd_ct
+vmath_f.double.vecm8 = vecm8d_ct
+vmath_f.double.vecmb = vecmbd_ct
 
 --------------------------------------------------------------------------------
 
@@ -260,11 +501,155 @@ end
 
 --------------------------------------------------------------------------------
 
+-- fused expressions: a chain of element-wise operations on the first argument vector,
+-- compiled into one loop so the arrays are only read (and written) once.
+--
+--     local grow = vmath.fuse(2)            -- function(v1, v2, n)
+--         :mul(vmath.arg(2))                -- v1[i] * v2[i]
+--         :mul(1/10000)
+--         :add(vmath.sarg(3))               -- scalar argument: function(v1, v2, c, n)
+--         :store()                          -- v1[i] <- ..., or store(k) to write into vk
+--     grow(trees.ba, trees.f, 0.5, #trees)
+--
+--     local ba = vmath.fuse(2):mul(vmath.arg(2)):sum()
+--
+-- terminals (store, sum, dot, reduce) compile and return the function, build these once
+-- and reuse them.
+
+local fuse_mt = { __index={} }
+
+local argref_mt = {}
+local sargref_mt = {}
+
+local function arg(i) return setmetatable({i=i}, argref_mt) end
+local function sarg(i) return setmetatable({i=i}, sargref_mt) end
+
+local function fuse(nargs)
+	return setmetatable({
+		nargs     = nargs or 1,
+		value     = "___a1[___i]",
+		code      = code.new(),
+		upvalues  = {},
+	}, fuse_mt)
+end
+
+function fuse_mt.__index:upvalue(v)
+	local name = "___c"..#self.code
+	self.code:emitf("local %s = %s", name, name)
+	self.upvalues[name] = v
+	return name
+end
+
+function fuse_mt.__index:operand(x)
+	local mt = getmetatable(x)
+	if mt == argref_mt then
+		self.nargs = math.max(self.nargs, x.i)
+		return string.format("___a%d[___i]", x.i)
+	elseif mt == sargref_mt then
+		self.nargs = math.max(self.nargs, x.i)
+		return string.format("___a%d", x.i)
+	elseif type(x) == "number" then
+		if x ~= x or x == math.huge or x == -math.huge then
+			return self:upvalue(x)
+		end
+		-- embedding the constant lets the trace compiler fold it
+		return string.format("%.17g", x)
+	end
+	error(string.format("invalid operand: %s", x))
+end
+
+local function binop(op)
+	return function(self, x)
+		self.value = string.format("(%s %s %s)", self.value, op, self:operand(x))
+		return self
+	end
+end
+
+local function unop(f)
+	return function(self)
+		self.value = string.format("%s(%s)", self:upvalue(f), self.value)
+		return self
+	end
+end
+
+fuse_mt.__index.add = binop("+")
+fuse_mt.__index.sub = binop("-")
+fuse_mt.__index.mul = binop("*")
+fuse_mt.__index.div = binop("/")
+fuse_mt.__index.pow = binop("^")
+fuse_mt.__index.exp = unop(math.exp)
+fuse_mt.__index.log = unop(math.log)
+fuse_mt.__index.sqrt = unop(math.sqrt)
+
+-- a*x + b
+function fuse_mt.__index:saddc(a, b)
+	return self:mul(a):add(b)
+end
+
+-- x + a*y
+function fuse_mt.__index:adds(a, y)
+	self.value = string.format("(%s + %s*%s)", self.value, self:operand(a), self:operand(y))
+	return self
+end
+
+function fuse_mt.__index:map(f)
+	return unop(f)(self)
+end
+
+function fuse_mt.__index:emitloop(init, body, ret)
+	local args = {}
+	for i=1, self.nargs do
+		args[i] = "___a"..i
+	end
+
+	self.code:emitf([[
+		return function(%s, ___n)
+			%s
+			for ___i=0, ___n-1 do
+				%s
+			end
+			%s
+		end
+	]], table.concat(args, ", "), init, body, ret)
+
+	return self.code:compile(self.upvalues, string.format("=(fuse@%p)", self))()
+end
+
+function fuse_mt.__index:store(k)
+	local dest = k and self:operand(arg(k)) or "___a1[___i]"
+	return self:emitloop("", string.format("%s = %s", dest, self.value), "")
+end
+
+function fuse_mt.__index:reduce(f, init)
+	local name = self:upvalue(f)
+	return self:emitloop(
+		string.format("local ___r = %s", self:upvalue(init)),
+		string.format("___r = %s(___r, %s)", name, self.value),
+		"return ___r"
+	)
+end
+
+function fuse_mt.__index:sum()
+	return self:emitloop("local ___r = 0", string.format("___r = ___r + %s", self.value),
+		"return ___r")
+end
+
+function fuse_mt.__index:dot(y)
+	return self:mul(y):sum()
+end
+
+--------------------------------------------------------------------------------
+
 local function inject(env)
 	local _sim = env.m2.sim
 
 	env.m2.vmath = setmetatable({
 		loop    = loop,
+		fuse    = fuse,
+		redmode = setredmode,
+		threads = C.vmath_set_threads,
+		arg     = arg,
+		sarg    = sarg,
 
 		-- Note: maybe add a function to alloc from sim pool instead if malloc is too slow
 		allocvd = allocvecd
@@ -274,6 +659,10 @@ end
 
 return {
 	vmath_f   = vmath_f,
+	fuse      = fuse,
+	redmode   = setredmode,
+	arg       = arg,
+	sarg      = sarg,
 	allocvec  = allocvec,
 	inject    = inject
 }
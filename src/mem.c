@@ -4,6 +4,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdalign.h>
 #include <assert.h>
@@ -83,10 +84,25 @@ void *reg_alloc(struct region *r, size_t sz, size_t align){
 	return bump(&r->ptr, sz, align, r->end);
 }
 
+/* grow the allocation at p from oldsz to newsz bytes without moving it.
+ * this only works if p is the most recent allocation in the region. */
+bool reg_try_extend(struct region *r, void *p, size_t oldsz, size_t newsz){
+	uintptr_t u = (uintptr_t) p;
+
+	if(u < r->mem || u+oldsz != r->ptr || u+newsz >= r->end)
+		return false;
+
+	r->ptr = u + newsz;
+	return true;
+}
+
 struct arena *arena_create(size_t size){
 	static_assert(sizeof(struct arena) % alignof(struct chunk) == 0);
 
 	void *p = malloc(sizeof(struct arena) + sizeof(struct chunk) + size);
+	if(!p)
+		return NULL;
+
 	struct arena *arena = p;
 	arena->chunk = p + sizeof(struct arena);
 	arena->chunk->prev = NULL;
@@ -146,6 +162,9 @@ void *arena_alloc(struct arena *arena, size_t size, size_t align){
 		newsz *= 2;
 
 	struct chunk *c = malloc(sizeof(*c) + newsz);
+	if(!c)
+		return NULL;
+
 	c->end = (uintptr_t)c->mem + newsz;
 	c->prev = arena->chunk;
 	arena->chunk->next = c;
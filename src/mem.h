@@ -4,6 +4,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct region {
 	uintptr_t ptr;
@@ -28,6 +29,7 @@ void vm_unmap(void *p, size_t size);
 #define REG_RESET(r) do { (r)->ptr = (r)->mem; } while(0)
 void reg_init(region *r, void *mem, size_t size);
 void *reg_alloc(region *r, size_t sz, size_t align) __attribute__((malloc));
+bool reg_try_extend(region *r, void *p, size_t oldsz, size_t newsz);
 void reg_ro(region *r);
 void reg_rw(region *r);
 
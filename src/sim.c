@@ -29,6 +29,9 @@ struct frame {
 struct sim {
 	region stat;
 	region vstack;
+	void **roots;
+	sim_hook sp_hook[SIM_MAXHOOK];
+	uint32_t nhook;
 	void *mapping;
 	uint32_t nframe;
 	uint32_t rsize;
@@ -40,6 +43,10 @@ struct sim {
 #define TOP(sim) (&((sim)->fstack[(sim)->fp]))
 static void f_enter(struct sim *sim, struct frame *f);
 static void blockcpy(void *restrict dst, void *restrict src, size_t size);
+static region *lifetime_region(struct sim *sim, int lifetime);
+#ifdef DEBUG
+static void fill_garbage(void *p, size_t sz);
+#endif
 
 struct sim *sim_create(uint32_t nframe, uint32_t rsize){
 	// rsize must be a power of 2
@@ -65,6 +72,10 @@ struct sim *sim_create(uint32_t nframe, uint32_t rsize){
 	reg_alloc(&sim->stat, sizeof(*sim) + nframe*sizeof(*sim->fstack), alignof(*sim));
 
 	reg_init(&sim->vstack, mem_align + (size_t)rsize*(nframe+1), rsize);
+	sim->roots = reg_alloc(&sim->vstack, SIM_NROOT*sizeof(*sim->roots), alignof(*sim->roots));
+	for(int i=0;i<SIM_NROOT;i++)
+		sim->roots[i] = NULL;
+	sim->nhook = 0;
 
 	for(uint32_t i=0;i<nframe;i++)
 		reg_init(&sim->fstack[i].mem, mem_align + (size_t)rsize*(i+1), rsize);
@@ -83,34 +94,37 @@ void sim_destroy(struct sim *sim){
 }
 
 void *sim_alloc(struct sim *sim, size_t sz, size_t align, int lifetime){
-	region *mem;
-
-	switch(lifetime){
-		case SIM_STATIC: mem = &sim->stat; break;
-		case SIM_FRAME:  mem = &TOP(sim)->mem; break;
-		case SIM_VSTACK: mem = &sim->vstack; break;
-		// TODO: SIM_SCRATCH
-		default: return NULL;
-	}
+	region *mem = lifetime_region(sim, lifetime);
+	if(UNLIKELY(!mem))
+		return NULL;
 
 	void *p = reg_alloc(mem, sz, align);
 
 #ifdef DEBUG
-	// Fill it with garbage (NaNs) to help the user detect if they are doing something stupid.
-	// It doesn't actually need to be a double array, since garbage is garbage, but NaNs are
-	// probably the most useful garbage value since most allocations in simulation code will
-	// be double arrays.
-	// Notes:
-	// (1) this is the only NaN that work for this, other NaNs are used by luajit for tagging
-	// (2) this is undefined behavior and breaks strict aliasing, but it's just for debugging
 	if(p)
-		for(uintptr_t px=ALIGN((uintptr_t)p, 8); px<((uintptr_t)p)+sz; px+=8)
-			*((uint64_t *) px) = 0xfff8000000000000;
+		fill_garbage(p, sz);
 #endif
 
 	return p;
 }
 
+bool sim_try_extend(struct sim *sim, void *p, size_t oldsz, size_t newsz, int lifetime){
+	region *mem = lifetime_region(sim, lifetime);
+	if(UNLIKELY(!mem))
+		return false;
+
+	if(!reg_try_extend(mem, p, oldsz, newsz))
+		return false;
+
+#ifdef DEBUG
+	if(newsz > oldsz)
+		fill_garbage(p+oldsz, newsz-oldsz);
+#endif
+
+	dv("extend %p: %zu -> %zu bytes\n", p, oldsz, newsz);
+	return true;
+}
+
 uint32_t sim_fp(struct sim *sim){
 	return sim->fp;
 }
@@ -119,15 +133,39 @@ uint32_t sim_frame_id(struct sim *sim){
 	return TOP(sim)->fid;
 }
 
+void **sim_root(struct sim *sim, int root){
+	return &sim->roots[root];
+}
+
+/* register a function to run before each savepoint (eg. to compact data structures so that
+ * all branches don't have to do it). adding the same function twice is a no-op. */
+int sim_savepoint_hook(struct sim *sim, sim_hook f){
+	for(uint32_t i=0;i<sim->nhook;i++){
+		if(sim->sp_hook[i] == f)
+			return SIM_OK;
+	}
+
+	if(UNLIKELY(sim->nhook >= SIM_MAXHOOK))
+		return SIM_EALLOC;
+
+	sim->sp_hook[sim->nhook++] = f;
+	return SIM_OK;
+}
+
 int sim_savepoint(struct sim *sim){
 	struct frame *f = TOP(sim);
-	size_t size = sim->vstack.ptr - sim->vstack.mem;
 
 	if(UNLIKELY(f->has_savepoint)){
 		dv("[%u] @ %u ERR -- double save point\n", sim->fp, f->fid);
 		return SIM_ESAVE;
 	}
 
+	// hooks may allocate on the vstack, so compute size after them
+	for(uint32_t i=0;i<sim->nhook;i++)
+		sim->sp_hook[i](sim);
+
+	size_t size = sim->vstack.ptr - sim->vstack.mem;
+
 	f->sp_data = reg_alloc(&f->mem, size, SIM_SAVEPOINT_BLOCKSIZE);
 	f->sp_ptr = (void*)sim->vstack.ptr;
 	if(UNLIKELY(!f->sp_data))
@@ -255,3 +293,27 @@ static void blockcpy(void *restrict dst, void *restrict src, size_t size){
 	for(size_t i=0;i<size;i+=SIM_SAVEPOINT_BLOCKSIZE)
 		*a++ = *b++;
 }
+
+static region *lifetime_region(struct sim *sim, int lifetime){
+	switch(lifetime){
+		case SIM_STATIC: return &sim->stat;
+		case SIM_FRAME:  return &TOP(sim)->mem;
+		case SIM_VSTACK: return &sim->vstack;
+		// TODO: SIM_SCRATCH
+		default: return NULL;
+	}
+}
+
+#ifdef DEBUG
+static void fill_garbage(void *p, size_t sz){
+	// Fill it with garbage (NaNs) to help the user detect if they are doing something stupid.
+	// It doesn't actually need to be a double array, since garbage is garbage, but NaNs are
+	// probably the most useful garbage value since most allocations in simulation code will
+	// be double arrays.
+	// Notes:
+	// (1) this is the only NaN that work for this, other NaNs are used by luajit for tagging
+	// (2) this is undefined behavior and breaks strict aliasing, but it's just for debugging
+	for(uintptr_t px=ALIGN((uintptr_t)p, 8); px<((uintptr_t)p)+sz; px+=8)
+		*((uint64_t *) px) = 0xfff8000000000000;
+}
+#endif
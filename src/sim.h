@@ -22,13 +22,26 @@ enum {
 	SIM_EBRANCH    // invalid branch point
 };
 
+// vstack roots: pointer slots at the bottom of the vstack, so they are saved and restored
+// with savepoints like everything else on the vstack
+enum {
+	SIM_ROOT_VEC,  // lazily compacted vectors (vec.c)
+	SIM_NROOT
+};
+
+typedef void (*sim_hook)(sim *sim);
+
 sim *sim_create(uint32_t nframe, uint32_t rsize);
 void sim_destroy(sim *sim);
 
 void *sim_alloc(sim *sim, size_t sz, size_t align, int lifetime);
+bool sim_try_extend(sim *sim, void *p, size_t oldsz, size_t newsz, int lifetime);
 uint32_t sim_fp(sim *sim);
 uint32_t sim_frame_id(sim *sim);
 
+void **sim_root(sim *sim, int root);
+int sim_savepoint_hook(sim *sim, sim_hook f);
+
 int sim_savepoint(sim *sim);
 int sim_load(sim *sim, uint32_t fp);
 int sim_up(sim *sim, uint32_t fp);
@@ -9,6 +9,8 @@
 #include <string.h>
 #include <assert.h>
 
+#define TILES_SIZE(info, n) (((n)/(info)->tile) * (info)->tile_size)
+
 struct cpy_interval {
 	uint32_t dst;
 	uint32_t src;
@@ -19,19 +21,56 @@ static uint32_t calc_intervals_s(struct cpy_interval *cpy, uint32_t *ncpy, uint3
 		uint32_t *skip, uint32_t tail);
 static void copy_intervals(struct cpy_interval *cpy, uint32_t ncpy, void *restrict dst,
 		void *restrict src, uint32_t size);
+static void copy_intervals_tiled(struct cpy_interval *cpy, uint32_t ncpy, void *restrict dst,
+		void *restrict src, uint32_t size, uint32_t tile, uint32_t tile_size);
+static void *tiles_base(struct vec *v);
+static void set_tiles(const struct vec_info *info, void **bands, void *tiles);
+static void *F_alloc_band(sim *sim, struct vec *v, uint16_t stride);
+static void *F_alloc_tiles(sim *sim, struct vec *v);
 static int cmp_idx(const void *a, const void *b);
+static void compact_lazy(sim *sim);
+static void F_tombstone(sim *sim, struct vec *v, uint32_t n, uint32_t *idx);
+static void F_delete_s(sim *sim, struct vec *v, uint32_t n, uint32_t *idx);
+static void bm_setrange(uint64_t *bits, uint32_t from, uint32_t n);
+static uint64_t *F_dirty(sim *sim, struct vec *v);
 static void F_ensure_capacity(sim *sim, struct vec *v, uint32_t n);
+static void F_move_band(sim *sim, struct vec *v, size_t band, void *ext);
 
 void vec_clear(struct vec *v){
 	v->n_alloc = 0;
 	v->n_used = 0;
+	// no rows survive, so the old log doesn't mean anything (new rows are logged on alloc)
+	v->dirty = NULL;
+	v->tomb = NULL;
+	v->n_dead = 0;
 	for(size_t i=0;i<v->info->n_bands;i++)
 		v->bands[i] = NULL;
 }
 
+/* clear bands idx[0..n) (no duplicates).
+ * interleaved bands can only be cleared together, idx contains either all of them or none. */
 void vec_clear_bands(struct vec *v, uint16_t n, uint16_t *idx){
-	for(size_t i=0;i<n;i++)
-		v->bands[idx[i]] = NULL;
+	const struct vec_info *info = v->info;
+	uint32_t ntiled = 0;
+
+	for(size_t i=0;i<n;i++){
+		if(VEC_TILED(info, idx[i]))
+			ntiled++;
+		else
+			v->bands[idx[i]] = NULL;
+	}
+
+	if(!ntiled)
+		return;
+
+	uint32_t total = 0;
+	for(size_t i=0;i<info->n_bands;i++)
+		total += VEC_TILED(info, i);
+
+	// clearing only some of them would take the others' data with them, keep the tiles then
+	assert(ntiled == total);
+	if(ntiled == total)
+		set_tiles(info, v->bands, NULL);
 }
 
 uint32_t vec_copy_skip(struct vec *v, void **dst, uint32_t n, uint32_t *skip){
@@ -43,28 +82,178 @@ uint32_t vec_copy_skip_s(struct vec *v, void **dst, uint32_t n, uint32_t *skip){
 	struct cpy_interval cpy[n + 1];
 	uint32_t ncpy;
 	uint32_t tail = calc_intervals_s(cpy, &ncpy, n, skip, v->n_used);
-	for(uint32_t i=0;i<v->info->n_bands;i++){
-		if(v->bands[i])
-			copy_intervals(cpy, ncpy, dst[i], v->bands[i], v->info->stride[i]);
+	const struct vec_info *info = v->info;
+	for(uint32_t i=0;i<info->n_bands;i++){
+		if(!v->bands[i])
+			continue;
+
+		if(VEC_TILED(info, i))
+			copy_intervals_tiled(cpy, ncpy, dst[i], v->bands[i], info->stride[i], info->tile,
+					info->tile_size);
+		else
+			copy_intervals(cpy, ncpy, dst[i], v->bands[i], info->stride[i]);
 	}
 	return tail;
 }
 
+void *vec_row(struct vec *v, uint16_t band, uint32_t row){
+	return VEC_ROW(v->info, v->bands[band], band, row);
+}
+
+/* rows changed in frames after fid (not including fid itself) on the current branch.
+ * bits must have room for n_used bits, and is overwritten with the changed rows.
+ * this is conservative: rows may be reported as changed even if they weren't, eg. deleting a row
+ * marks all following rows since they were renumbered, and creating a band marks every row.
+ * writes through existing band pointers are only seen if they are marked (simF_vec_touch). if tracking isn't enabled on v, or it was
+ * enabled after fid, all rows are reported.
+ * returns the number of changed rows. */
+uint32_t vec_changed(struct vec *v, uint32_t fid, uint64_t *bits){
+	uint32_t n = v->n_used;
+	uint32_t nw = (n + 63) / 64;
+
+	if(!(v->flags & VEC_TRACK) || fid < v->since){
+		memset(bits, 0, nw*sizeof(*bits));
+		bm_setrange(bits, 0, n);
+		return n;
+	}
+
+	memset(bits, 0, nw*sizeof(*bits));
+
+	for(struct vec_dirty *d=v->dirty; d && d->fid > fid; d=d->prev){
+		uint32_t dw = (d->n < n ? d->n : n) / 64;
+		for(uint32_t i=0;i<dw;i++)
+			bits[i] |= d->bits[i];
+		if(dw < nw && dw*64 < d->n)
+			bits[dw] |= d->bits[dw];
+	}
+
+	uint32_t num = 0;
+	if(n % 64)
+		bits[nw-1] &= (1ULL << (n % 64)) - 1;
+	for(uint32_t i=0;i<nw;i++)
+		num += __builtin_popcountll(bits[i]);
+
+	return num;
+}
+
+/* chunk size actually used for v: 0 selects the default, and chunks are rounded to whole tiles */
+uint32_t vec_chunk_size(struct vec *v, uint32_t chunk){
+	if(!chunk)
+		chunk = VEC_CHUNK_SIZE;
+
+	if(v->info->tile)
+		chunk = ALIGN(chunk, v->info->tile);
+
+	return chunk;
+}
+
+uint32_t vec_num_chunks(struct vec *v, uint32_t chunk){
+	chunk = vec_chunk_size(v, chunk);
+	return (v->n_used + chunk - 1) / chunk;
+}
+
+/* run f over [0, n_used) in chunks.
+ * slots must have room for nslot doubles per chunk (see vec_num_chunks). each chunk gets its own
+ * zeroed slots, and on return slots[0..nslot) hold the per-slot sums over chunks.
+ * the chunk boundaries and the summation order only depend on the chunk size, not on the
+ * number of threads, so the results are reproducible.
+ * if par is set, chunks are run on the openmp thread team. f must be thread-safe then
+ * (in particular, don't pass a luajit callback).
+ * v must not have dead rows, compact it first (simF_vec_compact). */
+void vec_chunked(struct vec *v, uint32_t chunk, vec_chunk_f f, void *arg, double *slots,
+		uint32_t nslot, bool par){
+
+	assert(!v->n_dead);
+
+	chunk = vec_chunk_size(v, chunk);
+	uint32_t n = v->n_used;
+	uint32_t nc = (n + chunk - 1) / chunk;
+
+	(void)par;
+
+	if(nslot)
+		memset(slots, 0, (size_t)(nc ? nc : 1) * nslot * sizeof(*slots));
+
+	#pragma omp parallel for schedule(static) if(par && nc > 1)
+	for(uint32_t c=0;c<nc;c++){
+		uint32_t from = c*chunk;
+		uint32_t to = (n - from) < chunk ? n : from+chunk;
+		f(v, from, to, arg, slots + (size_t)c*nslot);
+	}
+
+	for(uint32_t c=1;c<nc;c++){
+		for(uint32_t i=0;i<nslot;i++)
+			slots[i] += slots[(size_t)c*nslot + i];
+	}
+
+	dv("chunked %u rows on vector %p (%u chunks of %u, %u slots, par=%d)\n",
+			n, v, nc, chunk, nslot, par);
+}
+
 struct vec_info *simS_vec_create_info(sim *sim, uint16_t n_bands, uint16_t *strides){
 	struct vec_info *info = sim_alloc(sim, sizeof(*info) + n_bands*sizeof(*info->stride),
 			alignof(*info), SIM_STATIC);
 
 	info->n_bands = n_bands;
+	info->tile = 0;
+	info->tile_size = 0;
+	info->offset = NULL;
 	memcpy(info->stride, strides, n_bands * sizeof(*info->stride));
 
 	dv("vec_info<%p>: %u bands\n", info, n_bands);
 	return info;
 }
 
+struct vec_info *simS_vec_create_info_tiled(sim *sim, uint16_t n_bands, uint16_t *strides,
+		uint16_t tile, uint16_t n_tiled, uint16_t *tiled){
+
+	if(!tile || (tile & (tile-1)) || VEC_MIN_ALLOC % tile)
+		return NULL;
+
+	struct vec_info *info = simS_vec_create_info(sim, n_bands, strides);
+	uint16_t *offset = sim_alloc(sim, n_bands*sizeof(*offset), alignof(*offset), SIM_STATIC);
+	if(!info || !offset)
+		return NULL;
+
+	for(size_t i=0;i<n_bands;i++)
+		offset[i] = VEC_SOA;
+
+	// place each band at its natural alignment inside the tile, and align the tile itself
+	// for vector loads.
+	uint32_t pos = 0;
+	for(size_t i=0;i<n_tiled;i++){
+		uint16_t b = tiled[i];
+		if(b >= n_bands || offset[b] != VEC_SOA)
+			return NULL;
+
+		uint32_t align = strides[b] & -strides[b];
+		if(align > SIMD_ALIGN_HINT)
+			align = SIMD_ALIGN_HINT;
+
+		pos = ALIGN(pos, align);
+		if(pos >= VEC_SOA)
+			return NULL;
+
+		offset[b] = pos;
+		pos += tile * strides[b];
+	}
+
+	info->tile = tile;
+	info->tile_size = ALIGN(pos, SIMD_ALIGN_HINT);
+	info->offset = offset;
+
+	dv("vec_info<%p>: %u bands, %u interleaved (tile: %u rows, %u bytes)\n",
+			info, n_bands, n_tiled, tile, info->tile_size);
+	return info;
+}
+
 struct vec *simL_vec_create(sim *sim, struct vec_info *info, int lifetime){
 	struct vec *v = sim_alloc(sim, VEC_HEADER_SIZE(info), alignof(*v), lifetime);
 
 	v->info = info;
+	v->flags = 0;
+	v->since = 0;
+	v->next_lazy = NULL;
 	vec_clear(v);
 
 	dv("vec<%p>: info<%p> life=%#x\n", v, info, lifetime);
@@ -72,17 +261,75 @@ struct vec *simL_vec_create(sim *sim, struct vec_info *info, int lifetime){
 }
 
 void *simF_vec_create_band(sim *sim, struct vec *v, uint16_t band){
+	// interleaved bands can't be replaced one at a time, this replaces the whole tile block
+	// (and updates all interleaved band pointers)
+	if(VEC_TILED(v->info, band)){
+		simF_vec_create_tiles(sim, v);
+		return v->bands[band];
+	}
+
 	return simF_vec_create_band_stride(sim, v, v->info->stride[band]);
 }
 
+/* a new band is created to be filled, so all rows of a tracked vector count as changed. */
 void *simF_vec_create_band_stride(sim *sim, struct vec *v, uint16_t stride){
-	return sim_alloc(sim, v->n_alloc * stride, SIMD_ALIGN_HINT, SIM_FRAME);
+	simF_vec_touch(sim, v, 0, v->n_used);
+	return F_alloc_band(sim, v, stride);
+}
+
+/* replace the tile block with a fresh copy in the current frame.
+ * existing rows of the interleaved bands are copied, the old block is left untouched.
+ * like a new band, all rows of a tracked vector count as changed. */
+void *simF_vec_create_tiles(sim *sim, struct vec *v){
+	if(!v->info->tile)
+		return NULL;
+
+	// log first, so that the new block is the one on top of the frame
+	simF_vec_touch(sim, v, 0, v->n_used);
+
+	void *old = tiles_base(v);
+	void *tiles = F_alloc_tiles(sim, v);
+
+	if(old && tiles){
+		uint32_t nt = ALIGN(v->n_used, v->info->tile) / v->info->tile;
+		memcpy(tiles, old, nt * v->info->tile_size);
+	}
+
+	set_tiles(v->info, v->bands, tiles);
+	return tiles;
+}
+
+/* start logging changed rows. changes before this frame are unknown */
+void simF_vec_track(sim *sim, struct vec *v){
+	if(v->flags & VEC_TRACK)
+		return;
+
+	v->flags |= VEC_TRACK;
+	v->since = sim_frame_id(sim);
+	v->dirty = NULL;
+}
+
+/* mark rows [from, from+n) as changed in this frame */
+void simF_vec_touch(sim *sim, struct vec *v, uint32_t from, uint32_t n){
+	if(!(v->flags & VEC_TRACK) || !n)
+		return;
+
+	assert(from < v->n_alloc && n <= v->n_alloc - from);
+	if(UNLIKELY(from >= v->n_alloc))
+		return;
+	if(UNLIKELY(n > v->n_alloc - from))
+		n = v->n_alloc - from;
+
+	uint64_t *bits = F_dirty(sim, v);
+	if(LIKELY(bits))
+		bm_setrange(bits, from, n);
 }
 
 uint32_t simF_vec_alloc(sim *sim, struct vec *v, uint32_t n){
 	F_ensure_capacity(sim, v, n);
 	uint32_t ret = v->n_used;
 	v->n_used += n;
+	simF_vec_touch(sim, v, ret, n);
 	dv("alloc %u entries [%u-%u] on vector %p (%u/%u used)\n",
 			n, ret, v->n_used, v, v->n_used, v->n_alloc);
 	return ret;
@@ -92,18 +339,108 @@ void simF_vec_delete(sim *sim, struct vec *v, uint32_t n, uint32_t *idx){
 	if(!n)
 		return;
 
-	// TODO: maybe compact the vector if deleting a lot?
+	if(v->flags & VEC_LAZYDEL){
+		F_tombstone(sim, v, n, idx);
+		return;
+	}
+
+	qsort(idx, n, sizeof(*idx), cmp_idx); // XXX
+	F_delete_s(sim, v, n, idx);
+}
+
+/* lazy deletion mode: deleted rows stay in the bands and are only marked in a tombstone
+ * bitmap. iterators must skip them (VEC_DEAD), anything that reads the bands as plain arrays
+ * (vmath kernels, vec_chunked(), fhk views) needs the vector compacted first. the vector is
+ * compacted when enough rows are dead (VEC_TOMB_DIV), or before each savepoint so that child
+ * branches don't each repeat the compaction. */
+void simV_vec_lazydel(sim *sim, struct vec *v){
+	if(v->flags & VEC_LAZYDEL)
+		return;
+
+	v->flags |= VEC_LAZYDEL;
+	void **root = sim_root(sim, SIM_ROOT_VEC);
+	v->next_lazy = *root;
+	*root = v;
+
+	sim_savepoint_hook(sim, compact_lazy);
+}
+
+/* physically remove tombstoned rows */
+void simF_vec_compact(sim *sim, struct vec *v){
+	if(!v->n_dead)
+		return;
+
+	// this runs from the savepoint hook, so don't leave anything outside the sim to free.
+	// if the frame is out of memory the rows just stay tombstoned.
+	uint32_t *idx = sim_alloc(sim, v->n_dead * sizeof(*idx), alignof(*idx), SIM_FRAME);
+	if(UNLIKELY(!idx))
+		return;
+
+	uint32_t n = 0;
+	for(uint32_t i=0;i<v->n_used;i++){
+		if(VEC_DEAD(v, i))
+			idx[n++] = i;
+	}
+
+	assert(n == v->n_dead);
+	dv("compact vector %p: %u/%u dead\n", v, n, v->n_used);
+
+	v->tomb = NULL;
+	v->n_dead = 0;
+	F_delete_s(sim, v, n, idx);
+}
+
+static void compact_lazy(sim *sim){
+	for(struct vec *v=*sim_root(sim, SIM_ROOT_VEC); v; v=v->next_lazy)
+		simF_vec_compact(sim, v);
+}
+
+static void F_tombstone(sim *sim, struct vec *v, uint32_t n, uint32_t *idx){
+	// the bitmap is copy-on-write: an older frame's bitmap belongs to its savepoint state
+	uint32_t fid = sim_frame_id(sim);
+	if(!v->tomb || v->tomb_fid != fid){
+		size_t nw = ALIGN(v->n_alloc, 64) / 64;
+		uint64_t *tomb = sim_alloc(sim, nw*sizeof(*tomb), alignof(*tomb), SIM_FRAME);
+		if(v->tomb)
+			memcpy(tomb, v->tomb, nw*sizeof(*tomb));
+		else
+			memset(tomb, 0, nw*sizeof(*tomb));
+		v->tomb = tomb;
+		v->tomb_fid = fid;
+	}
+
+	for(uint32_t i=0;i<n;i++){
+		uint32_t j = idx[i];
+		if(!VEC_DEAD(v, j)){
+			v->tomb[j/64] |= 1ULL << (j%64);
+			v->n_dead++;
+			simF_vec_touch(sim, v, j, 1);
+		}
+	}
+
+	if(v->n_dead >= v->n_used/VEC_TOMB_DIV)
+		simF_vec_compact(sim, v);
+}
+
+static void F_delete_s(sim *sim, struct vec *v, uint32_t n, uint32_t *idx){
 	// TODO: special case: if deleting everything just null the pointers
 	void *newbands[v->info->n_bands];
-	for(size_t i=0;i<v->info->n_bands;i++)
-		newbands[i] = v->bands[i] ? simF_vec_create_band(sim, v, i) : NULL;
+	for(size_t i=0;i<v->info->n_bands;i++){
+		newbands[i] = (v->bands[i] && !VEC_TILED(v->info, i))
+			? F_alloc_band(sim, v, v->info->stride[i]) : NULL;
+	}
 
-	uint32_t tail = vec_copy_skip(v, newbands, n, idx);
+	if(tiles_base(v))
+		set_tiles(v->info, newbands, F_alloc_tiles(sim, v));
+
+	uint32_t tail = vec_copy_skip_s(v, newbands, n, idx);
 	assert(tail == v->n_used - n);
-	(void)tail;
 
 	memcpy(v->bands, newbands, v->info->n_bands * sizeof(*v->bands));
 	v->n_used = tail;
+
+	// everything after the first deleted row was renumbered
+	simF_vec_touch(sim, v, idx[0], tail-idx[0]);
 }
 
 static uint32_t calc_intervals_s(struct cpy_interval *cpy, uint32_t *ncpy, uint32_t n,
@@ -153,17 +490,137 @@ static void copy_intervals(struct cpy_interval *cpy, uint32_t ncpy, void *restri
 	}
 }
 
+static void copy_intervals_tiled(struct cpy_interval *cpy, uint32_t ncpy, void *restrict dst,
+		void *restrict src, uint32_t size, uint32_t tile, uint32_t tile_size){
+
+	char *cd = dst;
+	char *cs = src;
+
+	// copy runs that don't cross a tile boundary on either side
+	for(size_t i=0;i<ncpy;i++){
+		uint32_t d = cpy[i].dst, s = cpy[i].src, num = cpy[i].num;
+		while(num){
+			uint32_t run = num;
+			if(run > tile - (d & (tile-1))) run = tile - (d & (tile-1));
+			if(run > tile - (s & (tile-1))) run = tile - (s & (tile-1));
+			memcpy(
+				cd + (d/tile)*tile_size + (d & (tile-1))*size,
+				cs + (s/tile)*tile_size + (s & (tile-1))*size,
+				run*size
+			);
+			d += run;
+			s += run;
+			num -= run;
+		}
+	}
+}
+
+static void *tiles_base(struct vec *v){
+	const struct vec_info *info = v->info;
+	if(!info->tile)
+		return NULL;
+
+	// all interleaved bands are either set or null, so it's enough to check the first one
+	for(size_t i=0;i<info->n_bands;i++){
+		if(info->offset[i] != VEC_SOA)
+			return v->bands[i] ? v->bands[i] - info->offset[i] : NULL;
+	}
+
+	return NULL;
+}
+
+static void set_tiles(const struct vec_info *info, void **bands, void *tiles){
+	for(size_t i=0;i<info->n_bands;i++){
+		if(VEC_TILED(info, i))
+			bands[i] = tiles ? tiles + info->offset[i] : NULL;
+	}
+}
+
+// internal reallocations copy the rows, they don't change them
+static void *F_alloc_band(sim *sim, struct vec *v, uint16_t stride){
+	return sim_alloc(sim, v->n_alloc * stride, SIMD_ALIGN_HINT, SIM_FRAME);
+}
+
+static void *F_alloc_tiles(sim *sim, struct vec *v){
+	return sim_alloc(sim, TILES_SIZE(v->info, v->n_alloc), SIMD_ALIGN_HINT, SIM_FRAME);
+}
+
 static int cmp_idx(const void *a, const void *b){
 	return *((int *) a) - *((int *) b);
 }
 
+static void bm_setrange(uint64_t *bits, uint32_t from, uint32_t n){
+	if(!n)
+		return;
+
+	uint32_t last = from + n - 1;
+	uint64_t fm = ~0ULL << (from%64);
+	uint64_t lm = ~0ULL >> (63 - last%64);
+
+	if(from/64 == last/64){
+		bits[from/64] |= fm & lm;
+		return;
+	}
+
+	bits[from/64] |= fm;
+	for(uint32_t i=from/64+1;i<last/64;i++)
+		bits[i] = ~0ULL;
+	bits[last/64] |= lm;
+}
+
+/* bitmap for the current frame, with room for n_alloc rows */
+static uint64_t *F_dirty(sim *sim, struct vec *v){
+	uint32_t fid = sim_frame_id(sim);
+	struct vec_dirty *d = v->dirty;
+
+	if(d && d->fid == fid && d->n >= v->n_alloc)
+		return d->bits;
+
+	uint32_t na = ALIGN(v->n_alloc, 64);
+	size_t oldsz = d ? sizeof(*d) + d->n/8 : 0;
+	size_t newsz = sizeof(*d) + na/8;
+
+	if(d && d->fid == fid){
+		// this frame's log is too small. grow it in place if possible, otherwise copy it
+		if(sim_try_extend(sim, d, oldsz, newsz, SIM_FRAME)){
+			memset((char *)d + oldsz, 0, newsz - oldsz);
+			d->n = na;
+			return d->bits;
+		}
+
+		struct vec_dirty *nd = sim_alloc(sim, newsz, alignof(*nd), SIM_FRAME);
+		if(UNLIKELY(!nd))
+			return NULL;
+
+		memcpy(nd, d, oldsz);
+		memset((char *)nd + oldsz, 0, newsz - oldsz);
+		nd->n = na;
+		v->dirty = nd;
+		return nd->bits;
+	}
+
+	// first change in this frame
+	struct vec_dirty *nd = sim_alloc(sim, newsz, alignof(*nd), SIM_FRAME);
+	if(UNLIKELY(!nd))
+		return NULL;
+
+	nd->prev = d;
+	nd->fid = fid;
+	nd->n = na;
+	memset(nd->bits, 0, na/8);
+	v->dirty = nd;
+
+	dv("vec %p: new change log for frame %u (%u rows)\n", v, fid, na);
+	return nd->bits;
+}
+
 static void F_ensure_capacity(sim *sim, struct vec *v, uint32_t n){
 	if(v->n_used + n <= v->n_alloc)
 		return;
 
 	uint32_t na = v->n_alloc;
 	if(!na)
-		na = 32;
+		na = VEC_MIN_ALLOC;
 
 	while(na < n+v->n_used)
 		na <<= 1;
@@ -171,15 +628,68 @@ static void F_ensure_capacity(sim *sim, struct vec *v, uint32_t n){
 	dv("realloc vector %p grow %u -> %u\n", v, v->n_alloc, na);
 
 	assert(na == ALIGN(na, SIMD_ALIGN_HINT));
+	const struct vec_info *info = v->info;
+	uint32_t oa = v->n_alloc;
 	v->n_alloc = na;
 
-	// frame-alloc new bands, no need to free old ones since they were frame-alloced as well
-	// NOTE: this will not work if we some day do interleaved bands!
-	for(size_t i=0;i<v->info->n_bands;i++){
-		void *old = v->bands[i];
-		if(old){
-			v->bands[i] = simF_vec_create_band(sim, v, i);
-			memcpy(v->bands[i], old, v->n_used*v->info->stride[i]);
-		}
+	// if a band (or the tile block) is the most recent allocation in the frame it can be grown
+	// in place. at most one allocation can be on top of the region, so only that one band
+	// avoids the copy, the rest are reallocated below. look for it before allocating anything.
+	// (old bands from a previous frame are never extended since they live in another region.)
+	void *tiles = tiles_base(v);
+	void *ext = NULL;
+
+	if(tiles && sim_try_extend(sim, tiles, TILES_SIZE(info, oa), TILES_SIZE(info, na),
+				SIM_FRAME))
+		ext = tiles;
+
+	for(size_t i=0;i<info->n_bands && !ext;i++){
+		if(v->bands[i] && !VEC_TILED(info, i) && sim_try_extend(sim, v->bands[i],
+					oa*info->stride[i], na*info->stride[i], SIM_FRAME))
+			ext = v->bands[i];
+	}
+
+	// tiles are laid out linearly, so growing the tile block is a plain copy as well
+	if(tiles && tiles != ext){
+		void *new = F_alloc_tiles(sim, v);
+		memcpy(new, tiles, TILES_SIZE(info, ALIGN(v->n_used, info->tile)));
+		set_tiles(info, v->bands, new);
+	}
+
+	// tombstones need room for the new rows as well (they are all alive)
+	if(v->tomb){
+		size_t ow = ALIGN(oa, 64) / 64, nw = ALIGN(na, 64) / 64;
+		uint64_t *tomb = sim_alloc(sim, nw*sizeof(*tomb), alignof(*tomb), SIM_FRAME);
+		memcpy(tomb, v->tomb, ow*sizeof(*tomb));
+		memset(tomb+ow, 0, (nw-ow)*sizeof(*tomb));
+		v->tomb = tomb;
+		v->tomb_fid = sim_frame_id(sim);
+	}
+
+	// frame-alloc new bands, no need to free old ones since they were frame-alloced as well.
+	// the widest band goes last so it's on top of the region, and it's the one extended in
+	// place next time.
+	size_t top = info->n_bands;
+	for(size_t i=0;i<info->n_bands;i++){
+		if(v->bands[i] && !VEC_TILED(info, i) && v->bands[i] != ext
+				&& (top == info->n_bands || info->stride[i] > info->stride[top]))
+			top = i;
+	}
+
+	for(size_t i=0;i<info->n_bands;i++){
+		if(i != top)
+			F_move_band(sim, v, i, ext);
+	}
+
+	if(top != info->n_bands)
+		F_move_band(sim, v, top, ext);
+}
+
+static void F_move_band(sim *sim, struct vec *v, size_t band, void *ext){
+	const struct vec_info *info = v->info;
+	void *old = v->bands[band];
+	if(old && !VEC_TILED(info, band) && old != ext){
+		v->bands[band] = F_alloc_band(sim, v, info->stride[band]);
+		memcpy(v->bands[band], old, v->n_used*info->stride[band]);
 	}
 }
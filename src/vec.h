@@ -5,11 +5,46 @@
 
 #include "sim.h"
 
+enum {
+	VEC_SOA = 0xffff // band is stored as a separate array
+};
+
+// vec flags
+enum {
+	VEC_TRACK   = 0x1, // keep a per-frame log of changed rows (see vec_changed)
+	VEC_LAZYDEL = 0x2  // deleted rows are only marked in the tombstone bitmap, see vec.c
+};
+
+// band layout.
+// by default each band is a separate array (SoA). optionally a subset of the bands can be
+// interleaved in fixed-width tiles (AoSoA):
+//
+//     +----------------+----------------+-----+----------------+-----
+//     | b1[0..tile)    | b2[0..tile)    | ... | b1[tile..2tile)| ...
+//     +----------------+----------------+-----+----------------+-----
+//     |<----------------- tile_size ---------->|
+//
+// bands[b] of an interleaved band points to its first row in the first tile,
+// use VEC_ROW (or vec_row) to address rows of interleaved bands.
+// interleaved bands share one allocation, so they are created and cleared together:
+// vec_clear_bands() must be given either every interleaved band or none of them.
 struct vec_info {
 	uint16_t n_bands;
+	uint16_t tile;         // rows per tile (power of 2 dividing VEC_MIN_ALLOC), 0 if pure SoA
+	uint32_t tile_size;    // bytes per tile
+	uint16_t *offset;      // tile offset for each band, VEC_SOA for separate bands
 	uint16_t stride[];
 };
 
+// changed rows of one frame. the logs form a chain through the frames on the current
+// branch (newest first), since the vector header itself is saved/restored with the vstack.
+struct vec_dirty {
+	struct vec_dirty *prev;
+	uint32_t fid;            // frame id
+	uint32_t n;              // bitmap capacity (rows)
+	uint64_t bits[];
+};
+
 // usage:
 //
 //     struct my_vec {
@@ -20,10 +55,18 @@ struct vec_info {
 //         int *bandN;
 //     }
 //
+
 struct vec {
 	const struct vec_info *info;
 	uint32_t n_alloc;
 	uint32_t n_used;
+	uint32_t flags;
+	uint32_t since;          // frame id when tracking was enabled
+	struct vec_dirty *dirty; // log of the newest frame that changed something (VEC_TRACK)
+	uint64_t *tomb;          // deleted rows (VEC_LAZYDEL), NULL if none
+	uint32_t tomb_fid;       // frame that owns the tombstone bitmap
+	uint32_t n_dead;         // number of rows in the tombstone bitmap
+	struct vec *next_lazy;   // next vector in the lazy deletion list (VEC_LAZYDEL)
 	void *bands[];
 };
 
@@ -33,16 +76,37 @@ struct vec_slice {
 	uint32_t to;
 };
 
+// chunk kernel: process rows [from, to), reduction results go in slot[0..nslot)
+typedef void (*vec_chunk_f)(struct vec *v, uint32_t from, uint32_t to, void *arg, double *slot);
+
 #define VEC_HEADER_SIZE(info) (sizeof(struct vec) + (info)->n_bands * sizeof(void *))
+#define VEC_DEAD(v, i)        ((v)->tomb && (((v)->tomb[(i)/64] >> ((i)%64)) & 1))
+#define VEC_TILED(info, b)    ((info)->tile && (info)->offset[(b)] != VEC_SOA)
+#define VEC_ROW(info, p, b, i) ((void *) (p) + (VEC_TILED((info), (b))\
+			? ((i)/(info)->tile)*(info)->tile_size + ((i)%(info)->tile)*(info)->stride[(b)]\
+			: (i)*(info)->stride[(b)]))
 
 void vec_clear(struct vec *v);
 void vec_clear_bands(struct vec *v, uint16_t n, uint16_t *idx);
 uint32_t vec_copy_skip(struct vec *v, void **dst, uint32_t n, uint32_t *skip);
 uint32_t vec_copy_skip_s(struct vec *v, void **dst, uint32_t n, uint32_t *skip);
+void *vec_row(struct vec *v, uint16_t band, uint32_t row);
+uint32_t vec_chunk_size(struct vec *v, uint32_t chunk);
+uint32_t vec_num_chunks(struct vec *v, uint32_t chunk);
+void vec_chunked(struct vec *v, uint32_t chunk, vec_chunk_f f, void *arg, double *slots,
+		uint32_t nslot, bool par);
+uint32_t vec_changed(struct vec *v, uint32_t fid, uint64_t *bits);
 
 struct vec_info *simS_vec_create_info(sim *sim, uint16_t n_bands, uint16_t *strides);
+struct vec_info *simS_vec_create_info_tiled(sim *sim, uint16_t n_bands, uint16_t *strides,
+		uint16_t tile, uint16_t n_tiled, uint16_t *tiled);
 struct vec *simL_vec_create(sim *sim, struct vec_info *info, int lifetime);
 void *simF_vec_create_band(sim *sim, struct vec *v, uint16_t band);
 void *simF_vec_create_band_stride(sim *sim, struct vec *v, uint16_t stride);
+void *simF_vec_create_tiles(sim *sim, struct vec *v);
+void simF_vec_track(sim *sim, struct vec *v);
+void simF_vec_touch(sim *sim, struct vec *v, uint32_t from, uint32_t n);
 uint32_t simF_vec_alloc(sim *sim, struct vec *v, uint32_t n);
 void simF_vec_delete(sim *sim, struct vec *v, uint32_t n, uint32_t *idx);
+void simV_vec_lazydel(sim *sim, struct vec *v);
+void simF_vec_compact(sim *sim, struct vec *v);
@@ -1,12 +1,39 @@
 /* Vectorized math operations. This should probably be replaced by an actual math library,
- * currently it just trusts GCC to auto-vectorize the loops */
+ * currently it just trusts GCC to auto-vectorize the loops.
+ *
+ * The kernels (vmath_kernels.h) are compiled once per supported ISA level and the best
+ * one for the running CPU is selected at startup, so the binary itself can be built for
+ * a baseline target. Set M2_VMATH_ISA (generic/sse2/avx2/avx512) to override.
+ *
+ * vdsum, vddot and vdavgw use the process-wide reduction mode (vmath_set_redmode or
+ * M2_VMATH_RED=fast/pairwise/kahan/repro), the *r variants take the mode per call.
+ *
+ * Element-wise kernels and sums run multithreaded on large arrays, see "parallel path" below
+ * (M2_VMATH_THREADS, M2_VMATH_PAR_MIN).
+ *
+ * Kernels don't assume alignment. Sim-allocated bands are aligned to SIMD_ALIGN_HINT,
+ * which is a full AVX-512 vector, so for them the vectorizer's peel loop is empty. */
 
 #include "vmath.h"
+#include "def.h"
+#include "conf.h"
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <math.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VMATH_X86 1
+#else
+#define VMATH_X86 0
+#endif
+
 #define V(n, step)\
 	do {\
 		_Pragma("omp simd")\
@@ -18,88 +45,546 @@
 		for(size_t i=0;i<n;i++){ step; }\
 	} while(0)
 
-/* set constant
- * d <- c */
-void vdsetc(double *d, double c, size_t n){
-	V(n, d[i] = c);
-}
+// grouped reduction: out[c] <- sum of `val` over rows i with k[i] = c, for c < nclass <= 256.
+// rows with k[i] >= nclass are ignored.
+// up to 4 classes are kept in registers, one accumulator per class and a compare-select per
+// row, which vectorizes. with more classes the selects cost more than they save, so those go
+// to a histogram replicated 4 ways by row index (runs of rows with the same class then don't
+// serialize on one store-to-load chain). ignored rows go to a discard slot.
+#define G(out, nclass, k, n, val)\
+	do {\
+		if(nclass <= 4){\
+			double _a0 = 0, _a1 = 0, _a2 = 0, _a3 = 0;\
+			_Pragma("omp simd reduction(+:_a0,_a1,_a2,_a3)")\
+			for(size_t i=0;i<n;i++){\
+				double _v = (val);\
+				uint8_t _k = k[i];\
+				_a0 += _k == 0 ? _v : 0;\
+				_a1 += _k == 1 ? _v : 0;\
+				_a2 += _k == 2 ? _v : 0;\
+				_a3 += _k == 3 ? _v : 0;\
+			}\
+			double _acc[4] = { _a0, _a1, _a2, _a3 };\
+			for(uint32_t _c=0;_c<nclass;_c++)\
+				out[_c] = _acc[_c];\
+		} else {\
+			uint32_t _nc = nclass > 256 ? 256 : nclass;\
+			double _h[4][257];\
+			for(uint32_t _j=0;_j<4;_j++)\
+				for(uint32_t _c=0;_c<=_nc;_c++)\
+					_h[_j][_c] = 0;\
+			for(size_t i=0;i<n;i++){\
+				uint32_t _c = k[i] < _nc ? k[i] : _nc;\
+				_h[i&3][_c] += (val);\
+			}\
+			for(uint32_t _c=0;_c<_nc;_c++)\
+				out[_c] = (_h[0][_c] + _h[1][_c]) + (_h[2][_c] + _h[3][_c]);\
+		}\
+	} while(0)
+
+// reductions with a fixed evaluation order, see "reduction modes" in vmath_kernels.h.
+// these expand to code that relies on -fno-associative-math.
+// `term` is an expression of i, the result is stored in `out`.
+
+// 8 lanes, lane j sums the terms i = j mod 8 in order, lanes are added in a fixed tree.
+// 8 is the widest vector (AVX-512), so the lane loop maps onto it without reordering.
+#define RED_LANES 8
+#define RED_TREE(s) (((s[0]+s[1]) + (s[2]+s[3])) + ((s[4]+s[5]) + (s[6]+s[7])))
+
+#define RED_REPRO(n, term, out)\
+	do {\
+		double _s[RED_LANES] = {0};\
+		size_t _m = (n) & ~(size_t)(RED_LANES-1);\
+		for(size_t _b=0;_b<_m;_b+=RED_LANES){\
+			for(size_t _j=0;_j<RED_LANES;_j++){\
+				size_t i = _b + _j;\
+				_s[_j] += (term);\
+			}\
+		}\
+		for(size_t i=_m;i<(n);i++)\
+			_s[i-_m] += (term);\
+		out = RED_TREE(_s);\
+	} while(0)
+
+// same lanes as RED_REPRO, each with a Kahan compensation term
+#define RED_KAHAN(n, term, out)\
+	do {\
+		double _s[RED_LANES] = {0}, _c[RED_LANES] = {0};\
+		for(size_t _b=0;_b<(n);_b+=RED_LANES){\
+			size_t _e = (n) - _b < RED_LANES ? (n) - _b : RED_LANES;\
+			for(size_t _j=0;_j<_e;_j++){\
+				size_t i = _b + _j;\
+				double _y = (term) - _c[_j];\
+				double _t = _s[_j] + _y;\
+				_c[_j] = (_t - _s[_j]) - _y;\
+				_s[_j] = _t;\
+			}\
+		}\
+		for(size_t _j=0;_j<RED_LANES;_j++)\
+			_s[_j] -= _c[_j];\
+		out = RED_TREE(_s);\
+	} while(0)
+
+// blocks of RED_PWBLOCK terms are summed with the fast loop, then the block sums are added
+// pairwise (merging equal-sized subtrees, like a binary counter), so the error grows with
+// log(n/RED_PWBLOCK) instead of n. the block sums depend on vector width.
+#define RED_PWBLOCK 128
+#define RED_PAIRWISE(n, term, out)\
+	do {\
+		double _st[64];\
+		size_t _sp = 0, _nb = 0;\
+		for(size_t _b=0;_b<(n);_b+=RED_PWBLOCK){\
+			size_t _e = (n) - _b < RED_PWBLOCK ? (n) : _b + RED_PWBLOCK;\
+			double _p = 0;\
+			_Pragma("omp simd reduction(+:_p)")\
+			for(size_t i=_b;i<_e;i++)\
+				_p += (term);\
+			for(size_t _k=++_nb;!(_k&1);_k>>=1)\
+				_p = _st[--_sp] + _p;\
+			_st[_sp++] = _p;\
+		}\
+		out = 0;\
+		while(_sp > 0)\
+			out += _st[--_sp];\
+	} while(0)
+
+// selection predicates of the masked kernels
+#define M8(k, mask, i) (((1ULL << (k)[i]) & (mask)) != 0)
+#define MB(bm, i)      ((((bm)[(i) >> 6] >> ((i) & 63)) & 1) != 0)
+
+// kernel lists, see the wrappers at the end of the file.
+// _(return type, name, (params), (args))             : serial
+// _(return type, name, (params), (args), (range args)) : element-wise or sum, parallel
+// range args are the args for elements [o, o+m).
+#define VMATH_KERNELS_EW(_)\
+	_(void,   vdsetc,   (double *d, double c, size_t n), (d, c, n), (d + o, c, m))\
+	_(void,   vdsaddc,  (double *d, double a, double *x, double b, size_t n),\
+			(d, a, x, b, n), (d + o, a, x + o, b, m))\
+	_(void,   vdaddc,   (double *d, double *x, double c, size_t n),\
+			(d, x, c, n), (d + o, x + o, c, m))\
+	_(void,   vdaddsv,  (double *d, double *x, double a, const double *restrict y, size_t n),\
+			(d, x, a, y, n), (d + o, x + o, a, y + o, m))\
+	_(void,   vdaddv,   (double *d, double *x, const double *restrict y, size_t n),\
+			(d, x, y, n), (d + o, x + o, y + o, m))\
+	_(void,   vdscale,  (double *d, double *x, double a, size_t n),\
+			(d, x, a, n), (d + o, x + o, a, m))\
+	_(void,   vdmulv,   (double *d, double *x, const double *restrict y, size_t n),\
+			(d, x, y, n), (d + o, x + o, y + o, m))\
+	_(void,   vdrefl,   (double *d, double a, double *x, const double *restrict y, size_t n),\
+			(d, a, x, y, n), (d + o, a, x + o, y + o, m))\
+	_(void,   vdaread,  (double *d, double *x, size_t n), (d, x, n), (d + o, x + o, m))\
+	_(void,   vdaddcm8, (double *d, double *x, double c, uint8_t *k, uint64_t mask, size_t n),\
+			(d, x, c, k, mask, n), (d + o, x + o, c, k + o, mask, m))\
+	_(void,   vdscalem8, (double *d, double *x, double a, uint8_t *k, uint64_t mask, size_t n),\
+			(d, x, a, k, mask, n), (d + o, x + o, a, k + o, mask, m))\
+	_(void,   vdaddsvm8, (double *d, double *x, double a, const double *restrict y, uint8_t *k,\
+				uint64_t mask, size_t n),\
+			(d, x, a, y, k, mask, n), (d + o, x + o, a, y + o, k + o, mask, m))\
+	_(void,   vdmulvm8, (double *d, double *x, const double *restrict y, uint8_t *k,\
+				uint64_t mask, size_t n),\
+			(d, x, y, k, mask, n), (d + o, x + o, y + o, k + o, mask, m))\
+	_(void,   vdaddcmb, (double *d, double *x, double c, const uint64_t *bm, size_t n),\
+			(d, x, c, bm, n), (d + o, x + o, c, bm + o/64, m))\
+	_(void,   vdscalemb, (double *d, double *x, double a, const uint64_t *bm, size_t n),\
+			(d, x, a, bm, n), (d + o, x + o, a, bm + o/64, m))\
+	_(void,   vdaddsvmb, (double *d, double *x, double a, const double *restrict y,\
+				const uint64_t *bm, size_t n),\
+			(d, x, a, y, bm, n), (d + o, x + o, a, y + o, bm + o/64, m))\
+	_(void,   vdmulvmb, (double *d, double *x, const double *restrict y, const uint64_t *bm,\
+				size_t n),\
+			(d, x, y, bm, n), (d + o, x + o, y + o, bm + o/64, m))\
+	_(void,   vdexp,    (double *d, double *x, size_t n), (d, x, n), (d + o, x + o, m))\
+	_(void,   vdsexp,   (double *d, double a, double b, double *x, size_t n),\
+			(d, a, b, x, n), (d + o, a, b, x + o, m))\
+	_(void,   vdlog,    (double *d, double *x, size_t n), (d, x, n), (d + o, x + o, m))\
+	_(void,   vdpow,    (double *d, double *x, const double *restrict y, size_t n),\
+			(d, x, y, n), (d + o, x + o, y + o, m))\
+	_(void,   vdspow,   (double *d, double a, double *x, double b, size_t n),\
+			(d, a, x, b, n), (d + o, a, x + o, b, m))\
+	_(void,   vdsqrt,   (double *d, double *x, size_t n), (d, x, n), (d + o, x + o, m))\
+	_(void,   vfsetc,   (float *d, float c, size_t n), (d, c, n), (d + o, c, m))\
+	_(void,   vfsaddc,  (float *d, float a, float *x, float b, size_t n),\
+			(d, a, x, b, n), (d + o, a, x + o, b, m))\
+	_(void,   vfaddc,   (float *d, float *x, float c, size_t n),\
+			(d, x, c, n), (d + o, x + o, c, m))\
+	_(void,   vfaddsv,  (float *d, float *x, float a, const float *restrict y, size_t n),\
+			(d, x, a, y, n), (d + o, x + o, a, y + o, m))\
+	_(void,   vfaddv,   (float *d, float *x, const float *restrict y, size_t n),\
+			(d, x, y, n), (d + o, x + o, y + o, m))\
+	_(void,   vfscale,  (float *d, float *x, float a, size_t n),\
+			(d, x, a, n), (d + o, x + o, a, m))\
+	_(void,   vfmulv,   (float *d, float *x, const float *restrict y, size_t n),\
+			(d, x, y, n), (d + o, x + o, y + o, m))\
+	_(void,   vfrefl,   (float *d, float a, float *x, const float *restrict y, size_t n),\
+			(d, a, x, y, n), (d + o, a, x + o, y + o, m))\
+	_(void,   vfaread,  (float *d, float *x, size_t n), (d, x, n), (d + o, x + o, m))
+
+#define VMATH_KERNELS_RED(_)\
+	_(double, vdsum,    (double *x, size_t n), (x, n), (x + o, m))\
+	_(double, vdsumm8,  (double *x, uint8_t *k, uint64_t mask, size_t n),\
+			(x, k, mask, n), (x + o, k + o, mask, m))\
+	_(double, vddot,    (double *x, double *y, size_t n), (x, y, n), (x + o, y + o, m))\
+	_(double, vdsumr,   (double *x, size_t n, int mode), (x, n, mode), (x + o, m, mode))\
+	_(double, vddotr,   (double *x, double *y, size_t n, int mode),\
+			(x, y, n, mode), (x + o, y + o, m, mode))\
+	_(double, vddotm8,  (double *x, double *y, uint8_t *k, uint64_t mask, size_t n),\
+			(x, y, k, mask, n), (x + o, y + o, k + o, mask, m))\
+	_(double, vdsummb,  (double *x, const uint64_t *bm, size_t n),\
+			(x, bm, n), (x + o, bm + o/64, m))\
+	_(double, vddotmb,  (double *x, double *y, const uint64_t *bm, size_t n),\
+			(x, y, bm, n), (x + o, y + o, bm + o/64, m))\
+	_(double, vfsumd,   (float *x, size_t n), (x, n), (x + o, m))\
+	_(double, vfsumm8d, (float *x, uint8_t *k, uint64_t mask, size_t n),\
+			(x, k, mask, n), (x + o, k + o, mask, m))\
+	_(double, vfdotd,   (float *x, float *y, size_t n), (x, y, n), (x + o, y + o, m))\
+	_(double, vfddot,   (float *x, double *y, size_t n), (x, y, n), (x + o, y + o, m))
+
+// weighted averages: _(return type, name, (params), (args), (chunk args))
+// the kernels take an extra `double *sw`: they return sum(x*w) and store sum(w) in *sw,
+// so that both sums of a chunk come from one pass. the wrapper divides.
+#define VMATH_KERNELS_AVG(_)\
+	_(double, vdavgw,   (const double *restrict x, const double *restrict w, size_t n), (x, w, n),\
+			(x + o, w + o, m))\
+	_(double, vdavgwr,  (const double *restrict x, const double *restrict w, size_t n, int mode),\
+			(x, w, n, mode), (x + o, w + o, m, mode))\
+	_(double, vdavgwm8, (const double *restrict x, const double *restrict w, uint8_t *k,\
+				uint64_t mask, size_t n),\
+			(x, w, k, mask, n), (x + o, w + o, k + o, mask, m))\
+	_(double, vdavgwmb, (const double *restrict x, const double *restrict w,\
+				const uint64_t *bm, size_t n),\
+			(x, w, bm, n), (x + o, w + o, bm + o/64, m))\
+	_(double, vfavgwd,  (const float *restrict x, const float *restrict w, size_t n), (x, w, n),\
+			(x + o, w + o, m))\
+	_(double, vfdavgw,  (const float *restrict x, const double *restrict w, size_t n), (x, w, n),\
+			(x + o, w + o, m))
+
+#define AVG_PARAMS(...) (__VA_ARGS__, double *sw)
+#define AVG_ARGS(...)   (__VA_ARGS__, sw)
+
+#define VMATH_KERNELS_SERIAL(_)\
+	_(void,   vdsumg8,  (double *out, uint32_t nclass, double *x, uint8_t *k, size_t n),\
+			(out, nclass, x, k, n))\
+	_(void,   vdsumwg8, (double *out, uint32_t nclass, const double *restrict x,\
+				const double *restrict w, uint8_t *k, size_t n),\
+			(out, nclass, x, w, k, n))\
+	_(void,   vdcntg8,  (double *out, uint32_t nclass, uint8_t *k, size_t n), (out, nclass, k, n))\
+	_(double, vdquantw, (const double *restrict x, const double *restrict w, double q,\
+				size_t n, double *tmp),\
+			(x, w, q, n, tmp))\
+	_(void,   vdcdfw,   (double *d, const double *t, size_t nt, const double *restrict x,\
+				const double *restrict w, size_t n),\
+			(d, t, nt, x, w, n))\
+	_(void,   vdhistw,  (double *h, uint32_t nbin, double lo, double width,\
+				const double *restrict x, const double *restrict w, size_t n),\
+			(h, nbin, lo, width, x, w, n))\
+	_(float,  vfsum,    (float *x, size_t n), (x, n))\
+	_(float,  vfsumm8,  (float *x, uint8_t *k, uint64_t mask, size_t n), (x, k, mask, n))\
+	_(float,  vfdot,    (float *x, float *y, size_t n), (x, y, n))\
+	_(float,  vfavgw,   (const float *restrict x, const float *restrict w, size_t n), (x, w, n))
+
+#define VMATH_KERNELS(_)\
+	VMATH_KERNELS_EW(_)\
+	VMATH_KERNELS_RED(_)\
+	VMATH_KERNELS_AVG(_)\
+	VMATH_KERNELS_SERIAL(_)
+
+struct vmath_kernels {
+#define KFIELD(ret, name, params, ...) ret (*name) params;
+#define KFIELD_AVG(ret, name, params, ...) ret (*name) AVG_PARAMS params;
+	VMATH_KERNELS_EW(KFIELD)
+	VMATH_KERNELS_RED(KFIELD)
+	VMATH_KERNELS_AVG(KFIELD_AVG)
+	VMATH_KERNELS_SERIAL(KFIELD)
+#undef KFIELD_AVG
+#undef KFIELD
+};
+
+// process-wide reduction mode for vdsum, vddot and vdavgw
+static int redmode = VMATH_RED_FAST;
+
+#define VK(name) name##_generic
+#include "vmath_kernels.h"
+#undef VK
+
+#if VMATH_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define VK(name) name##_sse2
+#include "vmath_kernels.h"
+#undef VK
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define VK(name) name##_avx2
+#include "vmath_kernels.h"
+#undef VK
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512vl,avx512bw,avx512dq,fma,prefer-vector-width=512")
+#define VK(name) name##_avx512
+#include "vmath_kernels.h"
+#undef VK
+#pragma GCC pop_options
+
+#endif
 
-/* scale and add constant
- * d <- ax + b */
-void vdsaddc(double *d, double a, double *x, double b, size_t n){
-	V(n, d[i] = a*x[i] + b);
+static const struct vmath_kernels *isa_kernels[VMATH_NISA] = {
+	[VMATH_GENERIC] = &kernels_generic,
+#if VMATH_X86
+	[VMATH_SSE2]    = &kernels_sse2,
+	[VMATH_AVX2]    = &kernels_avx2,
+	[VMATH_AVX512]  = &kernels_avx512
+#endif
+};
+
+static const char *isa_names[VMATH_NISA] = {
+	[VMATH_GENERIC] = "generic",
+	[VMATH_SSE2]    = "sse2",
+	[VMATH_AVX2]    = "avx2",
+	[VMATH_AVX512]  = "avx512"
+};
+
+static const struct vmath_kernels *K = &kernels_generic;
+static int K_isa = VMATH_GENERIC;
+
+/* best ISA level supported by both the build and the running CPU */
+int vmath_isa_max(){
+#if VMATH_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+			&& __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq"))
+		return VMATH_AVX512;
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return VMATH_AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return VMATH_SSE2;
+#endif
+	return VMATH_GENERIC;
 }
 
-/* add constant
- * d <- x + c */
-void vdaddc(double *d, double *x, double c, size_t n){
-	vdsaddc(d, 1, x, c, n);
+int vmath_isa(){
+	return K_isa;
 }
 
-/* add scaled vector
- * d <- x + ay */
-void vdaddsv(double *d, double *x, double a, const double *restrict y, size_t n){
-	V(n, d[i] = x[i] + a*y[i]);
+const char *vmath_isa_name(int isa){
+	return (isa >= 0 && isa < VMATH_NISA) ? isa_names[isa] : NULL;
 }
 
-/* add vector
- * d <- x + y */
-void vdaddv(double *d, double *x, const double *restrict y, size_t n){
-	vdaddsv(d, x, 1, y, n);
+/* select kernels for isa, or the best supported level below it.
+ * returns the selected level. */
+int vmath_set_isa(int isa){
+	int max = vmath_isa_max();
+	if(isa > max)
+		isa = max;
+
+	while(isa > VMATH_GENERIC && !isa_kernels[isa])
+		isa--;
+
+	if(isa < VMATH_GENERIC)
+		isa = VMATH_GENERIC;
+
+	K = isa_kernels[isa];
+	K_isa = isa;
+	dv("vmath isa: %s\n", isa_names[isa]);
+	return isa;
 }
 
-/* scale vector
- * d <- ax */
-void vdscale(double *d, double *x, double a, size_t n){
-	V(n, d[i] = a*x[i]);
+static const char *red_names[VMATH_RED_N] = {
+	[VMATH_RED_FAST]     = "fast",
+	[VMATH_RED_PAIRWISE] = "pairwise",
+	[VMATH_RED_KAHAN]    = "kahan",
+	[VMATH_RED_REPRO]    = "repro"
+};
+
+int vmath_redmode(){
+	return redmode;
 }
 
-/* multiply element-wise
- * d <- x * y */
-void vdmulv(double *d, double *x, const double *restrict y, size_t n){
-	V(n, d[i] = x[i] * y[i]);
+/* set the reduction mode used by vdsum, vddot and vdavgw.
+ * returns the previous mode. */
+int vmath_set_redmode(int mode){
+	int old = redmode;
+	if(mode >= 0 && mode < VMATH_RED_N)
+		redmode = mode;
+	return old;
 }
 
-/* generalized reflection of x around y
- * d <- y + a*(y - x) */
-void vdrefl(double *d, double a, double *x, const double *restrict y, size_t n){
-	V(n, d[i] = y[i] + a*(y[i] - x[i]));
+const char *vmath_redmode_name(int mode){
+	return (mode >= 0 && mode < VMATH_RED_N) ? red_names[mode] : NULL;
 }
 
-/* area from diameter
- * d <- (pi/4)*x^2 */
-void vdaread(double *d, double *x, size_t n){
-	V(n, d[i] = (M_PI/4) * x[i] * x[i]);
+static void par_init();
+
+__attribute__((constructor))
+static void vmath_init(){
+	int isa = VMATH_NISA-1;
+	const char *env = getenv("M2_VMATH_ISA");
+
+	if(env){
+		for(int i=0;i<VMATH_NISA;i++){
+			if(!strcasecmp(env, isa_names[i]))
+				isa = i;
+		}
+	}
+
+	vmath_set_isa(isa);
+	par_init();
+
+	if((env = getenv("M2_VMATH_RED"))){
+		for(int i=0;i<VMATH_RED_N;i++){
+			if(!strcasecmp(env, red_names[i]))
+				redmode = i;
+		}
+	}
 }
 
-/* sum elements
- * sum(x[i] : i=1..n) */
-double vdsum(double *x, size_t n){
-	double ret = 0;
-	V(n, ret += x[i]);
-	return ret;
+/* ---- parallel path ----------------------------------------
+ * calls of at least par_min elements are split into VMATH_PAR_CHUNK sized chunks, which are
+ * run on an OpenMP team of par_threads. libgomp keeps the team's threads alive between
+ * parallel regions, so a parallel call costs a wakeup, not a thread creation, and calls
+ * below par_min (or with a single thread) never touch OpenMP at all.
+ *
+ * reductions over more than one chunk always sum per chunk, and add the chunk sums in order
+ * on the calling thread, whether or not they run in parallel. so the result depends only on
+ * n (and the reduction mode), not on the thread count or par_min. */
+
+static int par_threads = 1;
+static size_t par_min = VMATH_PAR_MIN;
+
+int vmath_threads(){
+	return par_threads;
 }
 
-/* sum elements selected by mask
- * sum(x[i] : (1<<k[i])&mask, i=1..n)*/
-double vdsumm8(double *x, uint8_t *k, uint64_t mask, size_t n){
-	double ret = 0;
-	V(n, if((1ULL << k[i]) & mask) ret += x[i]);
-	return ret;
+/* returns the previous thread count */
+int vmath_set_threads(int n){
+	int old = par_threads;
+	par_threads = n > 0 ? n : 1;
+	return old;
 }
 
-/* dot product
- * sum(x*y) */
-double vddot(double *x, double *y, size_t n){
-	double ret = 0;
-	V(n, ret += x[i]*y[i]);
-	return ret;
+/* returns the previous threshold */
+size_t vmath_set_par_min(size_t n){
+	size_t old = par_min;
+	par_min = n;
+	return old;
 }
 
-/* weighted average
- * sum(x*w) / sum(w) */
-double vdavgw(const double *restrict x, const double *restrict w, size_t n){
-	double sxw = 0, sw = 0;
-	V(n, sxw += x[i]*w[i]; sw += w[i]);
-	return sxw / sw;
+static void par_init(){
+	const char *env;
+
+#ifdef _OPENMP
+	par_threads = omp_get_max_threads();
+#endif
+
+	if((env = getenv("M2_VMATH_THREADS")))
+		vmath_set_threads(atoi(env));
+
+	if((env = getenv("M2_VMATH_PAR_MIN")))
+		par_min = strtoull(env, NULL, 10);
 }
+
+// run `call` for each chunk [o, o+m) of n elements
+#define PAR_CHUNKS(n, call)\
+	do {\
+		size_t _nc = ((n) + VMATH_PAR_CHUNK - 1) / VMATH_PAR_CHUNK;\
+		_Pragma("omp parallel for schedule(static) num_threads(par_threads)")\
+		for(size_t _c=0;_c<_nc;_c++){\
+			size_t o = _c * VMATH_PAR_CHUNK;\
+			size_t m = (n) - o < VMATH_PAR_CHUNK ? (n) - o : VMATH_PAR_CHUNK;\
+			call;\
+		}\
+	} while(0)
+
+// out <- sum of `call` over chunks, in chunk order.
+// the chunks run in blocks so that the partial sums fit on the stack.
+#define PAR_SUM_BLOCK 256
+#define PAR_SUM(n, out, call)\
+	do {\
+		size_t _nc = ((n) + VMATH_PAR_CHUNK - 1) / VMATH_PAR_CHUNK;\
+		double _p[PAR_SUM_BLOCK];\
+		out = 0;\
+		for(size_t _c0=0;_c0<_nc;_c0+=PAR_SUM_BLOCK){\
+			size_t _nb = _nc - _c0 < PAR_SUM_BLOCK ? _nc - _c0 : PAR_SUM_BLOCK;\
+			_Pragma("omp parallel for schedule(static) num_threads(par_threads)\
+					if((n) >= par_min && par_threads > 1)")\
+			for(size_t _c=0;_c<_nb;_c++){\
+				size_t o = (_c0 + _c) * VMATH_PAR_CHUNK;\
+				size_t m = (n) - o < VMATH_PAR_CHUNK ? (n) - o : VMATH_PAR_CHUNK;\
+				_p[_c] = call;\
+			}\
+			for(size_t _c=0;_c<_nb;_c++)\
+				out += _p[_c];\
+		}\
+	} while(0)
+
+// same as PAR_SUM, and out2 <- sum of what `call` stores in *sw
+#define PAR_SUM2(n, out, out2, call)\
+	do {\
+		size_t _nc = ((n) + VMATH_PAR_CHUNK - 1) / VMATH_PAR_CHUNK;\
+		double _p[PAR_SUM_BLOCK], _q[PAR_SUM_BLOCK];\
+		out = 0;\
+		out2 = 0;\
+		for(size_t _c0=0;_c0<_nc;_c0+=PAR_SUM_BLOCK){\
+			size_t _nb = _nc - _c0 < PAR_SUM_BLOCK ? _nc - _c0 : PAR_SUM_BLOCK;\
+			_Pragma("omp parallel for schedule(static) num_threads(par_threads)\
+					if((n) >= par_min && par_threads > 1)")\
+			for(size_t _c=0;_c<_nb;_c++){\
+				size_t o = (_c0 + _c) * VMATH_PAR_CHUNK;\
+				size_t m = (n) - o < VMATH_PAR_CHUNK ? (n) - o : VMATH_PAR_CHUNK;\
+				double *sw = &_q[_c];\
+				_p[_c] = call;\
+			}\
+			for(size_t _c=0;_c<_nb;_c++){\
+				out += _p[_c];\
+				out2 += _q[_c];\
+			}\
+		}\
+	} while(0)
+
+#define SWRAP(ret, name, params, args, ...)\
+	ret name params {\
+		return (ret) K->name args;\
+	}
+
+#define EWRAP(ret, name, params, args, pargs)\
+	ret name params {\
+		if(n < par_min || par_threads <= 1){\
+			K->name args;\
+			return;\
+		}\
+		PAR_CHUNKS(n, K->name pargs);\
+	}
+
+#define RWRAP(ret, name, params, args, pargs)\
+	ret name params {\
+		if(n <= VMATH_PAR_CHUNK)\
+			return K->name args;\
+		ret s;\
+		PAR_SUM(n, s, K->name pargs);\
+		return s;\
+	}
+
+#define AWRAP(ret, name, params, args, pargs)\
+	ret name params {\
+		double sxw, _sw;\
+		if(n <= VMATH_PAR_CHUNK){\
+			double *sw = &_sw;\
+			sxw = K->name AVG_ARGS args;\
+		}else{\
+			PAR_SUM2(n, sxw, _sw, K->name AVG_ARGS pargs);\
+		}\
+		return sxw / _sw;\
+	}
+
+VMATH_KERNELS_EW(EWRAP)
+VMATH_KERNELS_RED(RWRAP)
+VMATH_KERNELS_AVG(AWRAP)
+VMATH_KERNELS_SERIAL(SWRAP)
+
+#undef SWRAP
+#undef EWRAP
+#undef RWRAP
+#undef AWRAP
@@ -7,6 +7,35 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// kernel ISA levels, see vmath.c
+enum {
+	VMATH_GENERIC,
+	VMATH_SSE2,
+	VMATH_AVX2,
+	VMATH_AVX512,
+	VMATH_NISA
+};
+
+// reduction modes for vdsum, vddot, vdavgw, see vmath.c
+enum {
+	VMATH_RED_FAST,      // vectorized, result depends on ISA and alignment
+	VMATH_RED_PAIRWISE,  // pairwise summation of vectorized blocks, error O(log n)
+	VMATH_RED_KAHAN,     // compensated, reproducible across ISA levels
+	VMATH_RED_REPRO,     // fixed 8-lane blocking, reproducible across ISA levels
+	VMATH_RED_N
+};
+
+int vmath_isa_max();
+int vmath_isa();
+int vmath_set_isa(int isa);
+const char *vmath_isa_name(int isa);
+int vmath_redmode();
+int vmath_set_redmode(int mode);
+const char *vmath_redmode_name(int mode);
+int vmath_threads();
+int vmath_set_threads(int n);
+size_t vmath_set_par_min(size_t n);
+
 void vdsetc(double *d, double c, size_t n);
 void vdsaddc(double *d, double a, double *x, double b, size_t n);
 void vdaddc(double *d, double *x, double c, size_t n);
@@ -20,3 +49,63 @@ double vdsum(double *x, size_t n);
 double vdsumm8(double *x, uint8_t *k, uint64_t mask, size_t n);
 double vddot(double *x, double *y, size_t n);
 double vdavgw(const double *restrict x, const double *restrict w, size_t n);
+double vdsumr(double *x, size_t n, int mode);
+double vddotr(double *x, double *y, size_t n, int mode);
+double vdavgwr(const double *restrict x, const double *restrict w, size_t n, int mode);
+void vdsumg8(double *out, uint32_t nclass, double *x, uint8_t *k, size_t n);
+void vdsumwg8(double *out, uint32_t nclass, const double *restrict x, const double *restrict w,
+		uint8_t *k, size_t n);
+void vdcntg8(double *out, uint32_t nclass, uint8_t *k, size_t n);
+// masked: m8 = class k[i] in mask, mb = bit i set in bitmap
+void vdaddcm8(double *d, double *x, double c, uint8_t *k, uint64_t mask, size_t n);
+void vdscalem8(double *d, double *x, double a, uint8_t *k, uint64_t mask, size_t n);
+void vdaddsvm8(double *d, double *x, double a, const double *restrict y, uint8_t *k,
+		uint64_t mask, size_t n);
+void vdmulvm8(double *d, double *x, const double *restrict y, uint8_t *k, uint64_t mask, size_t n);
+double vddotm8(double *x, double *y, uint8_t *k, uint64_t mask, size_t n);
+double vdavgwm8(const double *restrict x, const double *restrict w, uint8_t *k,
+		uint64_t mask, size_t n);
+double vdsummb(double *x, const uint64_t *bm, size_t n);
+void vdaddcmb(double *d, double *x, double c, const uint64_t *bm, size_t n);
+void vdscalemb(double *d, double *x, double a, const uint64_t *bm, size_t n);
+void vdaddsvmb(double *d, double *x, double a, const double *restrict y, const uint64_t *bm,
+		size_t n);
+void vdmulvmb(double *d, double *x, const double *restrict y, const uint64_t *bm, size_t n);
+double vddotmb(double *x, double *y, const uint64_t *bm, size_t n);
+double vdavgwmb(const double *restrict x, const double *restrict w, const uint64_t *bm, size_t n);
+
+double vdquantw(const double *restrict x, const double *restrict w, double q, size_t n,
+		double *tmp);
+void vdcdfw(double *d, const double *t, size_t nt, const double *restrict x,
+		const double *restrict w, size_t n);
+void vdhistw(double *h, uint32_t nbin, double lo, double width, const double *restrict x,
+		const double *restrict w, size_t n);
+
+void vdexp(double *d, double *x, size_t n);
+void vdsexp(double *d, double a, double b, double *x, size_t n);
+void vdlog(double *d, double *x, size_t n);
+void vdpow(double *d, double *x, const double *restrict y, size_t n);
+void vdspow(double *d, double a, double *x, double b, size_t n);
+void vdsqrt(double *d, double *x, size_t n);
+
+void vfsetc(float *d, float c, size_t n);
+void vfsaddc(float *d, float a, float *x, float b, size_t n);
+void vfaddc(float *d, float *x, float c, size_t n);
+void vfaddsv(float *d, float *x, float a, const float *restrict y, size_t n);
+void vfaddv(float *d, float *x, const float *restrict y, size_t n);
+void vfscale(float *d, float *x, float a, size_t n);
+void vfmulv(float *d, float *x, const float *restrict y, size_t n);
+void vfrefl(float *d, float a, float *x, const float *restrict y, size_t n);
+void vfaread(float *d, float *x, size_t n);
+float vfsum(float *x, size_t n);
+float vfsumm8(float *x, uint8_t *k, uint64_t mask, size_t n);
+float vfdot(float *x, float *y, size_t n);
+float vfavgw(const float *restrict x, const float *restrict w, size_t n);
+
+// mixed precision (f32 inputs, f64 accumulation)
+double vfsumd(float *x, size_t n);
+double vfsumm8d(float *x, uint8_t *k, uint64_t mask, size_t n);
+double vfdotd(float *x, float *y, size_t n);
+double vfddot(float *x, double *y, size_t n);
+double vfavgwd(const float *restrict x, const float *restrict w, size_t n);
+double vfdavgw(const float *restrict x, const double *restrict w, size_t n);
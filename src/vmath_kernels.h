@@ -0,0 +1,666 @@
+/* vmath kernel bodies.
+ * this file is included by vmath.c once per target ISA, with VK(name) defined to give the
+ * ISA-specific name (eg. VK(vdsum) -> vdsum_avx2) and the matching `#pragma GCC target`.
+ * the loops are the same for each ISA, GCC vectorizes them at the width of the target. */
+
+/* set constant
+ * d <- c */
+static void VK(vdsetc)(double *d, double c, size_t n){
+	V(n, d[i] = c);
+}
+
+/* scale and add constant
+ * d <- ax + b */
+static void VK(vdsaddc)(double *d, double a, double *x, double b, size_t n){
+	V(n, d[i] = a*x[i] + b);
+}
+
+/* add constant
+ * d <- x + c */
+static void VK(vdaddc)(double *d, double *x, double c, size_t n){
+	VK(vdsaddc)(d, 1, x, c, n);
+}
+
+/* add scaled vector
+ * d <- x + ay */
+static void VK(vdaddsv)(double *d, double *x, double a, const double *restrict y, size_t n){
+	V(n, d[i] = x[i] + a*y[i]);
+}
+
+/* add vector
+ * d <- x + y */
+static void VK(vdaddv)(double *d, double *x, const double *restrict y, size_t n){
+	VK(vdaddsv)(d, x, 1, y, n);
+}
+
+/* scale vector
+ * d <- ax */
+static void VK(vdscale)(double *d, double *x, double a, size_t n){
+	V(n, d[i] = a*x[i]);
+}
+
+/* multiply element-wise
+ * d <- x * y */
+static void VK(vdmulv)(double *d, double *x, const double *restrict y, size_t n){
+	V(n, d[i] = x[i] * y[i]);
+}
+
+/* generalized reflection of x around y
+ * d <- y + a*(y - x) */
+static void VK(vdrefl)(double *d, double a, double *x, const double *restrict y, size_t n){
+	V(n, d[i] = y[i] + a*(y[i] - x[i]));
+}
+
+/* area from diameter
+ * d <- (pi/4)*x^2 */
+static void VK(vdaread)(double *d, double *x, size_t n){
+	V(n, d[i] = (M_PI/4) * x[i] * x[i]);
+}
+
+/* ---- reduction modes ----------------------------------------
+ * sums in a selectable mode (see VMATH_RED_* in vmath.h). the modes other than fast depend
+ * on evaluation order, so this section is compiled without reassociation or fma contraction.
+ * the lane-blocked modes (kahan, repro) fix the order of every addition independent of
+ * vector width and alignment, and give bit-identical results on every ISA level. */
+
+#pragma GCC push_options
+#pragma GCC optimize("no-associative-math", "fp-contract=off")
+
+static double VK(redsum)(const double *x, const double *y, size_t n, int mode){
+#define TERM (y ? x[i]*y[i] : x[i])
+	double out;
+	switch(mode){
+		case VMATH_RED_PAIRWISE: RED_PAIRWISE(n, TERM, out); break;
+		case VMATH_RED_KAHAN:    RED_KAHAN(n, TERM, out); break;
+		case VMATH_RED_REPRO:    RED_REPRO(n, TERM, out); break;
+		default:
+			out = 0;
+			#pragma omp simd reduction(+:out)
+			for(size_t i=0;i<n;i++)
+				out += TERM;
+	}
+	return out;
+#undef TERM
+}
+
+/* sum with reduction mode */
+static double VK(vdsumr)(double *x, size_t n, int mode){
+	return VK(redsum)(x, NULL, n, mode);
+}
+
+/* dot product with reduction mode */
+static double VK(vddotr)(double *x, double *y, size_t n, int mode){
+	return VK(redsum)(x, y, n, mode);
+}
+
+/* weighted average with reduction mode.
+ * the averages return sum(x*w) and store sum(w) in *sw, see VMATH_KERNELS_AVG in vmath.c.
+ * the modes other than fast sum in a fixed order, so these are two passes. the wrapper
+ * calls them a cache-sized chunk at a time on large arrays. */
+static double VK(vdavgwr)(const double *restrict x, const double *restrict w, size_t n,
+		int mode, double *sw){
+	*sw = VK(redsum)(w, NULL, n, mode);
+	return VK(redsum)(x, w, n, mode);
+}
+
+#pragma GCC pop_options
+
+/* sum elements
+ * sum(x[i] : i=1..n) */
+static double VK(vdsum)(double *x, size_t n){
+	if(UNLIKELY(redmode != VMATH_RED_FAST))
+		return VK(vdsumr)(x, n, redmode);
+	double ret = 0;
+	V(n, ret += x[i]);
+	return ret;
+}
+
+/* sum elements selected by mask
+ * sum(x[i] : (1<<k[i])&mask, i=1..n)*/
+static double VK(vdsumm8)(double *x, uint8_t *k, uint64_t mask, size_t n){
+	double ret = 0;
+	V(n, if((1ULL << k[i]) & mask) ret += x[i]);
+	return ret;
+}
+
+/* dot product
+ * sum(x*y) */
+static double VK(vddot)(double *x, double *y, size_t n){
+	if(UNLIKELY(redmode != VMATH_RED_FAST))
+		return VK(vddotr)(x, y, n, redmode);
+	double ret = 0;
+	V(n, ret += x[i]*y[i]);
+	return ret;
+}
+
+/* weighted average
+ * sum(x*w) / sum(w) */
+static double VK(vdavgw)(const double *restrict x, const double *restrict w, size_t n,
+		double *sw){
+	if(UNLIKELY(redmode != VMATH_RED_FAST))
+		return VK(vdavgwr)(x, w, n, redmode, sw);
+	double sxw = 0, s = 0;
+	V(n, sxw += x[i]*w[i]; s += w[i]);
+	*sw = s;
+	return sxw;
+}
+
+/* grouped sum
+ * out[c] <- sum x[i] where k[i] = c, for c < nclass */
+static void VK(vdsumg8)(double *out, uint32_t nclass, double *x, uint8_t *k, size_t n){
+	G(out, nclass, k, n, x[i]);
+}
+
+/* grouped weighted sum
+ * out[c] <- sum x[i]w[i] where k[i] = c, for c < nclass */
+static void VK(vdsumwg8)(double *out, uint32_t nclass, const double *restrict x,
+		const double *restrict w, uint8_t *k, size_t n){
+	G(out, nclass, k, n, x[i]*w[i]);
+}
+
+/* grouped count
+ * out[c] <- #{i : k[i] = c}, for c < nclass */
+static void VK(vdcntg8)(double *out, uint32_t nclass, uint8_t *k, size_t n){
+	G(out, nclass, k, n, 1.0);
+}
+
+/* ---- masked ----------------------------------------
+ * m8: element i is selected if its class k[i] is in the 64-bit mask (like vdsumm8).
+ * mb: element i is selected if bit i of the bitmap is set (eg. from vec_changed).
+ * element-wise kernels write every element of d, unselected ones get x unchanged, so the
+ * loops are blends rather than branches. */
+
+/* add constant to selected elements
+ * d <- x + c, or x where not selected (class mask: k[i] in mask) */
+static void VK(vdaddcm8)(double *d, double *x, double c, uint8_t *k, uint64_t mask, size_t n){
+	V(n, d[i] = x[i] + (M8(k, mask, i) ? c : 0));
+}
+
+/* scale selected elements
+ * d <- ax, or x where not selected (class mask: k[i] in mask) */
+static void VK(vdscalem8)(double *d, double *x, double a, uint8_t *k, uint64_t mask, size_t n){
+	V(n, d[i] = M8(k, mask, i) ? a*x[i] : x[i]);
+}
+
+/* add scaled vector to selected elements
+ * d <- x + ay, or x where not selected (class mask: k[i] in mask) */
+static void VK(vdaddsvm8)(double *d, double *x, double a, const double *restrict y,
+		uint8_t *k, uint64_t mask, size_t n){
+	V(n, d[i] = x[i] + (M8(k, mask, i) ? a*y[i] : 0));
+}
+
+/* multiply selected elements
+ * d <- xy, or x where not selected (class mask: k[i] in mask) */
+static void VK(vdmulvm8)(double *d, double *x, const double *restrict y, uint8_t *k,
+		uint64_t mask, size_t n){
+	V(n, d[i] = M8(k, mask, i) ? x[i]*y[i] : x[i]);
+}
+
+/* dot product over selected elements (class mask: k[i] in mask) */
+static double VK(vddotm8)(double *x, double *y, uint8_t *k, uint64_t mask, size_t n){
+	double ret = 0;
+	V(n, ret += M8(k, mask, i) ? x[i]*y[i] : 0);
+	return ret;
+}
+
+/* weighted average over selected elements (class mask: k[i] in mask) */
+static double VK(vdavgwm8)(const double *restrict x, const double *restrict w, uint8_t *k,
+		uint64_t mask, size_t n, double *sw){
+	double sxw = 0, s = 0;
+	V(n, sxw += M8(k, mask, i) ? x[i]*w[i] : 0; s += M8(k, mask, i) ? w[i] : 0);
+	*sw = s;
+	return sxw;
+}
+
+/* sum over selected elements (bitmap: bit i of bm set) */
+static double VK(vdsummb)(double *x, const uint64_t *bm, size_t n){
+	double ret = 0;
+	V(n, ret += MB(bm, i) ? x[i] : 0);
+	return ret;
+}
+
+/* add constant to selected elements
+ * d <- x + c, or x where not selected (bitmap: bit i of bm set) */
+static void VK(vdaddcmb)(double *d, double *x, double c, const uint64_t *bm, size_t n){
+	V(n, d[i] = x[i] + (MB(bm, i) ? c : 0));
+}
+
+/* scale selected elements
+ * d <- ax, or x where not selected (bitmap: bit i of bm set) */
+static void VK(vdscalemb)(double *d, double *x, double a, const uint64_t *bm, size_t n){
+	V(n, d[i] = MB(bm, i) ? a*x[i] : x[i]);
+}
+
+/* add scaled vector to selected elements
+ * d <- x + ay, or x where not selected (bitmap: bit i of bm set) */
+static void VK(vdaddsvmb)(double *d, double *x, double a, const double *restrict y,
+		const uint64_t *bm, size_t n){
+	V(n, d[i] = x[i] + (MB(bm, i) ? a*y[i] : 0));
+}
+
+/* multiply selected elements
+ * d <- xy, or x where not selected (bitmap: bit i of bm set) */
+static void VK(vdmulvmb)(double *d, double *x, const double *restrict y, const uint64_t *bm,
+		size_t n){
+	V(n, d[i] = MB(bm, i) ? x[i]*y[i] : x[i]);
+}
+
+/* dot product over selected elements (bitmap: bit i of bm set) */
+static double VK(vddotmb)(double *x, double *y, const uint64_t *bm, size_t n){
+	double ret = 0;
+	V(n, ret += MB(bm, i) ? x[i]*y[i] : 0);
+	return ret;
+}
+
+/* weighted average over selected elements (bitmap: bit i of bm set) */
+static double VK(vdavgwmb)(const double *restrict x, const double *restrict w,
+		const uint64_t *bm, size_t n, double *sw){
+	double sxw = 0, s = 0;
+	V(n, sxw += MB(bm, i) ? x[i]*w[i] : 0; s += MB(bm, i) ? w[i] : 0);
+	*sw = s;
+	return sxw;
+}
+
+/* ---- distributions ---------------------------------------- */
+
+static inline void VK(swapxw)(double *x, double *w, size_t i, size_t j){
+	double t = x[i]; x[i] = x[j]; x[j] = t;
+	t = w[i]; w[i] = w[j]; w[j] = t;
+}
+
+/* weighted quantile, 0 < q <= 1: the smallest x[j] such that the elements <= x[j] have at
+ * least q times the total weight.
+ * this is quickselect with the rank replaced by cumulative weight, so expected O(n).
+ * x and w are copied to tmp (2n doubles), the inputs are not modified. */
+static double VK(vdquantw)(const double *restrict x, const double *restrict w, double q,
+		size_t n, double *tmp){
+	if(!n)
+		return NAN;
+
+	double *tx = tmp, *tw = tmp + n;
+	double sw = 0;
+	V(n, tx[i] = x[i]; tw[i] = w[i]; sw += w[i]);
+
+	double target = q * sw;
+	size_t lo = 0, hi = n;
+
+	for(;;){
+		// median of 3 pivot
+		double a = tx[lo], b = tx[lo + (hi-lo)/2], c = tx[hi-1];
+		double p = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+		// 3-way partition: [lo,lt) < p, [lt,gt) = p, [gt,hi) > p
+		size_t lt = lo, i = lo, gt = hi;
+		double wl = 0, we = 0;
+		while(i < gt){
+			if(tx[i] < p){
+				wl += tw[i];
+				VK(swapxw)(tx, tw, lt++, i++);
+			}else if(tx[i] > p){
+				VK(swapxw)(tx, tw, i, --gt);
+			}else{
+				we += tw[i++];
+			}
+		}
+
+		if(lt > lo && target <= wl){
+			hi = lt;
+			continue;
+		}
+
+		// gt == hi: only possible with rounding in the weight sums, the pivot is the max
+		if(target <= wl + we || gt == hi)
+			return p;
+
+		target -= wl + we;
+		lo = gt;
+	}
+}
+
+/* weighted cumulative distribution at points t[0] <= ... <= t[nt-1]
+ * d[j] <- (sum of w[i] where x[i] <= t[j]) / (sum of w)
+ * each element is binned with a branch-free binary search over t, then the bins are
+ * prefix-summed, so this is O(n log nt) in one pass over x. */
+static void VK(vdcdfw)(double *d, const double *t, size_t nt, const double *restrict x,
+		const double *restrict w, size_t n){
+	for(size_t j=0;j<nt;j++)
+		d[j] = 0;
+
+	double sw = 0;
+	for(size_t i=0;i<n;i++){
+		// first j with t[j] >= x[i]
+		size_t j = 0, len = nt;
+		while(len > 0){
+			size_t half = len / 2;
+			int right = t[j+half] < x[i];
+			j = right ? j+half+1 : j;
+			len = right ? len-half-1 : half;
+		}
+
+		if(j < nt)
+			d[j] += w[i];
+		sw += w[i];
+	}
+
+	double s = 0;
+	for(size_t j=0;j<nt;j++){
+		s += d[j];
+		d[j] = s / sw;
+	}
+}
+
+/* weighted histogram with nbin bins of the given width starting at lo, values outside the
+ * range go to the first or last bin, NaNs are skipped.
+ * h[b] <- sum of w[i] where lo + b*width <= x[i] < lo + (b+1)*width
+ * bin indices are computed a block at a time in a vectorized loop, only the scatter-add
+ * is scalar. */
+#define HIST_BLOCK 256
+#pragma GCC push_options
+#pragma GCC optimize("no-finite-math-only") // keeps x == x as the NaN test
+static void VK(vdhistw)(double *h, uint32_t nbin, double lo, double width,
+		const double *restrict x, const double *restrict w, size_t n){
+	uint32_t bin[HIST_BLOCK];
+	double inv = 1 / width;
+	double top = nbin - 1;
+
+	if(UNLIKELY(!nbin))
+		return;
+
+	for(uint32_t b=0;b<nbin;b++)
+		h[b] = 0;
+
+	for(size_t i0=0;i0<n;i0+=HIST_BLOCK){
+		size_t m = n-i0 < HIST_BLOCK ? n-i0 : HIST_BLOCK;
+		const double *xb = x + i0;
+		V(m,
+			double b = (xb[i] - lo) * inv;
+			b = b >= 0 ? b : 0;
+			b = b > top ? top : b;
+			// nbin marks NaN x as skipped
+			bin[i] = xb[i] == xb[i] ? (uint32_t) b : nbin;
+		);
+		for(size_t i=0;i<m;i++){
+			if(LIKELY(bin[i] < nbin))
+				h[bin[i]] += w[i0+i];
+		}
+	}
+}
+#pragma GCC pop_options
+#undef HIST_BLOCK
+
+/* ---- transcendental functions ----------------------------------------
+ * polynomial approximations written so that the loops calling them vectorize (no libm calls,
+ * no branches). error bounds below are measured against glibc libm (see tests/vmath.t) for
+ * arguments in the stated domains. special values (nan, inf, x <= 0 for log) are not handled.
+ *
+ * the range reductions depend on the order of floating point operations, so this section
+ * is compiled without -fassociative-math (the rest of -ffast-math is fine). */
+
+#pragma GCC push_options
+#pragma GCC optimize("no-associative-math")
+
+static inline double VK(bits2d)(uint64_t u){
+	double x;
+	memcpy(&x, &u, sizeof(x));
+	return x;
+}
+
+static inline uint64_t VK(d2bits)(double x){
+	uint64_t u;
+	memcpy(&u, &x, sizeof(u));
+	return u;
+}
+
+/* exact product: a*b = p + *e */
+static inline double VK(twoprod)(double a, double b, double *e){
+	double p = a*b;
+#ifdef __FMA__
+	*e = __builtin_fma(a, b, -p);
+#else
+	// no fma instruction, so the compiler can't contract these either
+	double ca = 134217729.0*a, cb = 134217729.0*b;
+	double ah = ca - (ca - a), bh = cb - (cb - b);
+	double al = a - ah, bl = b - bh;
+	*e = ((ah*bh - p) + ah*bl + al*bh) + al*bl;
+#endif
+	return p;
+}
+
+/* exp(x) * (1 + xl), |error| <= 1 ulp for x in [-708, 709], |xl| <= 2^-40.
+ * x = k ln2 + r, |r| <= ln2/2, with ln2 split in two so that k*ln2hi is exact.
+ * exp(r) is a degree 13 Taylor polynomial (truncation error < 2^-57 on the interval).
+ * 2^k is applied in two steps so that subnormal results and overflow to inf come out right;
+ * x is clamped to keep k in range. */
+static inline double VK(exp2p)(double x, double xl){
+	x = x < -746.0 ? -746.0 : x;
+	x = x > 710.0 ? 710.0 : x;
+	double t = x * 0x1.71547652b82fep0;
+	int32_t k = (int32_t) (t + (t < 0 ? -0.5 : 0.5));
+	double r = x - k*0x1.62e42fee00000p-1;
+	r = r - k*0x1.a39ef35793c76p-33;
+	double p = 1.0/6227020800;
+	p = 1.0/479001600 + r*p;
+	p = 1.0/39916800 + r*p;
+	p = 1.0/3628800 + r*p;
+	p = 1.0/362880 + r*p;
+	p = 1.0/40320 + r*p;
+	p = 1.0/5040 + r*p;
+	p = 1.0/720 + r*p;
+	p = 1.0/120 + r*p;
+	p = 1.0/24 + r*p;
+	p = 1.0/6 + r*p;
+	p = 0.5 + r*p;
+	p = 1.0 + (r + (r*r*p + xl*(1.0 + r)));
+	int32_t k1 = k >> 1;
+	int32_t k2 = k - k1;
+	return p * VK(bits2d)((uint64_t)(int64_t)(k1+1023) << 52)
+		* VK(bits2d)((uint64_t)(int64_t)(k2+1023) << 52);
+}
+
+/* log(x) = hi + *lo, |error of hi| <= 1 ulp, hi+lo good to ~2^-68 relative,
+ * for positive finite x (including subnormals).
+ * this is the fdlibm algorithm: x = 2^k m, sqrt(2)/2 <= m < sqrt(2), f = m-1, s = f/(2+f),
+ * log(m) = f - (f^2/2 - s(f^2/2 + R(s^2))) with R a degree 14 minimax polynomial.
+ * the low part tracks the rounding errors of k*ln2 + f - f^2/2, which dominate when the
+ * result is multiplied by a large exponent in pow. */
+static inline double VK(log2p)(double x, double *lo){
+	int sub = x < 0x1p-1022;
+	x = sub ? x*0x1p54 : x;
+	uint64_t u = VK(d2bits)(x);
+	int32_t k = (int32_t)(u >> 52) - 1023 - (sub ? 54 : 0);
+	double m = VK(bits2d)((u & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+	int big = m > 0x1.6a09e667f3bcdp0;
+	m = big ? 0.5*m : m;
+	k += big;
+	double f = m - 1.0;
+	double s = f / (2.0 + f);
+	double z = s*s;
+	double R = 1.479819860511658591e-01;
+	R = 1.531383769920937332e-01 + z*R;
+	R = 1.818357216161805012e-01 + z*R;
+	R = 2.222219843214978396e-01 + z*R;
+	R = 2.857142874366239149e-01 + z*R;
+	R = 3.999999999940941908e-01 + z*R;
+	R = 6.666666666666735130e-01 + z*R;
+	R = z*R;
+	double hfe;
+	double hfsq = VK(twoprod)(0.5*f, f, &hfe);
+	double a = k*0x1.62e42fee00000p-1;
+	double b = f - hfsq;
+	double be = ((f - b) - hfsq) - hfe;
+	double h = a + b;
+	double hb = h - a;
+	double l = ((a - (h - hb)) + (b - hb)) + be + (s*(hfsq+R) + k*0x1.a39ef35793c76p-33);
+	double hi = h + l;
+	*lo = l - (hi - h);
+	return hi;
+}
+
+static inline double VK(exp1)(double x){
+	return VK(exp2p)(x, 0);
+}
+
+static inline double VK(log1)(double x){
+	double lo;
+	double hi = VK(log2p)(x, &lo);
+	return hi + lo;
+}
+
+static inline double VK(pow1)(double x, double y){
+	double lo, e;
+	double hi = VK(log2p)(x, &lo);
+	double t = VK(twoprod)(y, hi, &e);
+	return VK(exp2p)(t, e + y*lo);
+}
+
+/* exp, max error 1 ulp on [-708, 709]
+ * d <- exp(x) */
+static void VK(vdexp)(double *d, double *x, size_t n){
+	V(n, d[i] = VK(exp1)(x[i]));
+}
+
+/* scaled exp, max error 1 ulp + error of bx
+ * d <- a exp(bx) */
+static void VK(vdsexp)(double *d, double a, double b, double *x, size_t n){
+	V(n, d[i] = a * VK(exp1)(b*x[i]));
+}
+
+/* natural logarithm, max error 1 ulp for x > 0
+ * d <- log(x) */
+static void VK(vdlog)(double *d, double *x, size_t n){
+	V(n, d[i] = VK(log1)(x[i]));
+}
+
+/* power, for x > 0, |y log x| < 708.
+ * max error 2 ulp for |y| <= 4. the error of log(x) is scaled by y, so it grows to
+ * about |y|/2 ulp for larger exponents.
+ * d <- x^y */
+static void VK(vdpow)(double *d, double *x, const double *restrict y, size_t n){
+	V(n, d[i] = VK(pow1)(x[i], y[i]));
+}
+
+/* scaled power, x^b has the error of vdpow
+ * d <- a x^b */
+static void VK(vdspow)(double *d, double a, double *x, double b, size_t n){
+	V(n, d[i] = a * VK(pow1)(x[i], b));
+}
+
+#pragma GCC pop_options
+
+/* square root, correctly rounded (compiles to the hardware instruction)
+ * d <- sqrt(x) */
+static void VK(vdsqrt)(double *d, double *x, size_t n){
+	V(n, d[i] = sqrt(x[i]));
+}
+
+/* ---- single precision ---------------------------------------- */
+
+static void VK(vfsetc)(float *d, float c, size_t n){
+	V(n, d[i] = c);
+}
+
+static void VK(vfsaddc)(float *d, float a, float *x, float b, size_t n){
+	V(n, d[i] = a*x[i] + b);
+}
+
+static void VK(vfaddc)(float *d, float *x, float c, size_t n){
+	VK(vfsaddc)(d, 1, x, c, n);
+}
+
+static void VK(vfaddsv)(float *d, float *x, float a, const float *restrict y, size_t n){
+	V(n, d[i] = x[i] + a*y[i]);
+}
+
+static void VK(vfaddv)(float *d, float *x, const float *restrict y, size_t n){
+	VK(vfaddsv)(d, x, 1, y, n);
+}
+
+static void VK(vfscale)(float *d, float *x, float a, size_t n){
+	V(n, d[i] = a*x[i]);
+}
+
+static void VK(vfmulv)(float *d, float *x, const float *restrict y, size_t n){
+	V(n, d[i] = x[i] * y[i]);
+}
+
+static void VK(vfrefl)(float *d, float a, float *x, const float *restrict y, size_t n){
+	V(n, d[i] = y[i] + a*(y[i] - x[i]));
+}
+
+static void VK(vfaread)(float *d, float *x, size_t n){
+	V(n, d[i] = (float)(M_PI/4) * x[i] * x[i]);
+}
+
+static float VK(vfsum)(float *x, size_t n){
+	float ret = 0;
+	V(n, ret += x[i]);
+	return ret;
+}
+
+static float VK(vfsumm8)(float *x, uint8_t *k, uint64_t mask, size_t n){
+	float ret = 0;
+	V(n, if((1ULL << k[i]) & mask) ret += x[i]);
+	return ret;
+}
+
+static float VK(vfdot)(float *x, float *y, size_t n){
+	float ret = 0;
+	V(n, ret += x[i]*y[i]);
+	return ret;
+}
+
+static float VK(vfavgw)(const float *restrict x, const float *restrict w, size_t n){
+	float sxw = 0, sw = 0;
+	V(n, sxw += x[i]*w[i]; sw += w[i]);
+	return sxw / sw;
+}
+
+/* ---- mixed precision: f32 inputs, f64 accumulation ---------------------------------------- */
+
+static double VK(vfsumd)(float *x, size_t n){
+	double ret = 0;
+	V(n, ret += x[i]);
+	return ret;
+}
+
+static double VK(vfsumm8d)(float *x, uint8_t *k, uint64_t mask, size_t n){
+	double ret = 0;
+	V(n, if((1ULL << k[i]) & mask) ret += x[i]);
+	return ret;
+}
+
+static double VK(vfdotd)(float *x, float *y, size_t n){
+	double ret = 0;
+	V(n, ret += (double)x[i]*y[i]);
+	return ret;
+}
+
+/* dot product of f32 and f64 vectors, eg. float diameters weighted by double stem counts */
+static double VK(vfddot)(float *x, double *y, size_t n){
+	double ret = 0;
+	V(n, ret += x[i]*y[i]);
+	return ret;
+}
+
+static double VK(vfavgwd)(const float *restrict x, const float *restrict w, size_t n,
+		double *sw){
+	double sxw = 0, s = 0;
+	V(n, sxw += (double)x[i]*w[i]; s += w[i]);
+	*sw = s;
+	return sxw;
+}
+
+/* weighted average of f32 values with f64 weights */
+static double VK(vfdavgw)(const float *restrict x, const double *restrict w, size_t n,
+		double *sw){
+	double sxw = 0, s = 0;
+	V(n, sxw += x[i]*w[i]; s += w[i]);
+	*sw = s;
+	return sxw;
+}
+
+static const struct vmath_kernels VK(kernels) = {
+#define KINIT(_, name, ...) .name = VK(name),
+	VMATH_KERNELS(KINIT)
+#undef KINIT
+};
@@ -79,6 +79,31 @@ test_solver_complex_parameter = _(function()
 	solution { ["g#x"] = {1+3} }
 end)
 
+test_solver_complex_computed_parameter = _(function()
+	-- runs of 3 out of every 5 instances: more intervals than the iterator's interval hint
+	-- can address, each longer than one instance.
+	local as, idx, sum = {}, {}, 0
+	for i=0, 999 do
+		as[i+1] = i
+		if i%5 < 3 then
+			table.insert(idx, i)
+			sum = sum + i
+		end
+	end
+
+	graph {
+		u { "runs",
+			ufunc(cf(idx), "k"),
+			ufunc(function(inst) return (inst%5 < 3) and {0} or {} end, "i")
+		},
+		m { "a -> x", id },
+		m { "g# x:runs -> g#y", dot }
+	}
+
+	given { a = as }
+	solution { ["g#y"] = {sum} }
+end)
+
 test_solver_chain = _(function()
 	graph {
 		m { "a -> x", id },
@@ -374,6 +399,28 @@ test_solver_checkall_over64 = _(function()
 	solution { x = xs }
 end)
 
+test_solver_checkscan_over64 = _(function()
+	local as, bs, xs, ys = {}, {}, {}, {}
+
+	for i=1, 100 do
+		as[i] = (i*37) % 100
+		bs[i] = (i*53) % 100
+		xs[i] = as[i] >= 50 and 1 or 2
+		ys[i] = bs[i] <= 50 and 1 or 2
+	end
+
+	graph {
+		v { "b", ctype="float" },
+		m { "->x [a>=50+inf]", 1 },
+		m { "->x", k=100,      2 },
+		m { "->y [b<=50+inf]", 1 },
+		m { "->y", k=100,      2 }
+	}
+
+	given { a = as, b = bs }
+	solution { x = xs, y = ys }
+end)
+
 test_solver_umap_association = _(function()
 	local G = {}
 	local data = {}
@@ -433,6 +480,142 @@ test_usermap_complex_retbuf = _(function()
 	solution { x = {123, na, 456} }
 end)
 
+test_solver_batch_modcall = _(function()
+	local calls = 0
+
+	graph {
+		m { "g# g#a -> g#x", function(a)
+			calls = calls+1
+			local x = {}
+			for i,v in ipairs(a) do x[i] = 2*v end
+			return x
+		end, batch=true }
+	}
+
+	given { ["g#a"] = {1, 2, 3, 4} }
+	solution { ["g#x"] = {2, 4, 6, 8} }
+	assert(calls == 1)
+
+	solution { ["g#x"] = {2, na, 6, 8} }
+	assert(calls == 2)
+end)
+
+test_solver_batch_computed_parameter = _(function()
+	local calls, bcalls = 0, 0
+
+	graph {
+		m { "g# g#a -> g#b", function(a) calls = calls+1 return {a[1]+1} end },
+		m { "g# g#a g#b -> g#x", function(a, b)
+			bcalls = bcalls+1
+			local x = {}
+			for i,v in ipairs(a) do x[i] = v*b[i] end
+			return x
+		end, batch=true }
+	}
+
+	given { ["g#a"] = {1, 2, 3, 4} }
+	solution { ["g#x"] = {2, 6, 12, 20} }
+	assert(calls == 4 and bcalls == 1)
+end)
+
+test_solver_batch_nonident = _(function()
+	assert(not pcall(function()
+		graph {
+			m { "g# a -> g#x", function() end, batch=true }
+		}
+	end))
+end)
+
+test_solver_plan = _(function()
+	graph {
+		m { "-> x [a>=0+10]", cf {1} },
+		m { "-> x [a<=0+10]", cf {2} }
+	}
+
+	plan()
+
+	given { a = {1} }
+	solution { x = {1} }
+	solution { x = {1} }
+
+	given { a = {-1} }
+	solution { x = {2} }
+
+	local stats = meta.plan:stats()
+	assert(stats.hit == 1 and stats.miss == 1 and stats.fail == 1)
+end)
+
+test_solver_plan_computed_guard = _(function()
+	local calls = 0
+
+	graph {
+		m { "-> y [a>=0+10]", function() calls = calls+1 return {1} end },
+		m { "-> y [a<=0+10]", cf {-1} },
+		m { "-> x [y>=0+10]", cf {1} },
+		m { "-> x [y<=0+10]", cf {2} }
+	}
+
+	plan()
+
+	given { a = {1} }
+	solution { x = {1} }
+	assert(calls == 1)
+
+	-- the changed guard selects y's chain, replaying the old chain would call `-> y [a>=0]`
+	-- to evaluate the guard on y.
+	given { a = {-1} }
+	solution { x = {2} }
+	assert(calls == 1)
+
+	local stats = meta.plan:stats()
+	assert(stats.hit == 0)
+end)
+
+-- this only runs on a FHK_INSTBITS=32 build (make FHK_INSTBITS=32), a 16-bit group can't
+-- hold this many instances.
+test_solver_wide_group = _(function()
+	if ffi.sizeof("fhk_inst") < 4 then return end
+
+	local n = 70000
+	local a, x = {}, {}
+	for i=1, n do
+		a[i] = i
+		x[i] = 2*i
+	end
+
+	graph {
+		m { "g# g#a -> g#x", function(a) return {2*a[1]} end },
+		m { "g#x:@space -> s", function(x)
+			local s = 0
+			for _,v in ipairs(x) do s = s+v end
+			return {s}
+		end }
+	}
+
+	given { ["g#a"] = a }
+	solution {
+		["g#x"] = x,
+		s       = {n*(n+1)}
+	}
+end)
+
+test_solver_invalidate = _(function()
+	local calls = 0
+
+	graph {
+		m { "g# g#a -> g#x", function(a) calls = calls+1 return {2*a[1]} end },
+		m { "g# g#x -> g#y", function(x) calls = calls+1 return {x[1]+1} end }
+	}
+
+	given { ["g#a"] = {1, 2, 3} }
+	solution { ["g#y"] = {3, 5, 7} }
+	assert(calls == 6)
+
+	update { ["g#a"] = {na, 10, na} }
+	solution { ["g#y"] = {3, 21, 7} }
+	assert(calls == 8)
+end)
+
 test_prune_omit_model = _(function()
 	graph {
 		m { "->x %1", k=1 },
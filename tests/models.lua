@@ -1,4 +1,6 @@
-return {
+local models
+
+models = {
 	id            = function(...) return ... end,
 	ret1          = function() return 1 end,
 	runtime_error = function() error("model crashed") end,
@@ -27,5 +29,19 @@ return {
 		for i=0, #v-1 do
 			v[i] = w*i
 		end
+	end,
+
+	-- busy for `ms` milliseconds
+	spin          = function(ms)
+		local t = os.clock() + ms/1000
+		while os.clock() < t do end
+		return ms
+	end,
+
+	-- calls models.f, which tests can set after the graph is compiled
+	hook          = function(...)
+		return models.f(...)
 	end
 }
+
+return models
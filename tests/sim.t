@@ -75,3 +75,13 @@ test_invalid_branchpoint = function()
 	-- so the message isn't checked
 	assert(fails(function() sim:enter_branch(sim:fp()) end))
 end
+
+test_try_extend = function()
+	local sim = sim.create()
+	local a = sim:alloc(64, 16, "frame")
+	local b = sim:alloc(64, 16, "frame")
+	assert(not ffi.C.sim_try_extend(sim, a, 64, 128, ffi.C.SIM_FRAME))
+	assert(ffi.C.sim_try_extend(sim, b, 64, 128, ffi.C.SIM_FRAME))
+	local c = sim:alloc(8, 8, "frame")
+	assert(ffi.cast("uintptr_t", c) >= ffi.cast("uintptr_t", b) + 128)
+end
@@ -4,6 +4,8 @@ local scripting = require "scripting"
 local fhk = require "fhk"
 local ffi = require "ffi"
 local fff = require "fff"
+local profile = require "fhk.profile"
+local trace = require "trace"
 local fails = fails
 
 local function _(f1, f2)
@@ -126,6 +128,42 @@ end, function()
 	end
 end)
 
+test_soa_view_tiled = _(function()
+	model "s#model" {
+		params { "s#x", "s#y" },
+		returns { "s#z", "s#w"} *as "double",
+		impl.LuaJIT("models", "id")
+	}
+end, function()
+	local soa_ct = m2.soa.from_bands({ x="double", y="double" }, nil, {
+		tile       = 8,
+		interleave = {"x", "y"}
+	})
+	local soa = m2.new_soa(soa_ct)
+
+	local solver = m2.fhk.solver(
+		m2.fhk.view()
+			:add(m2.fhk.edge_view("=>$", "ident"))
+			:add(m2.fhk.group("s", m2.fhk.soa_view(soa_ct, soa))),
+		"s#z", "s#w"
+	)
+
+	function m2.export.test()
+		soa:alloc(20)
+		soa:newband("x")
+		local x, y = soa:band("x"), soa:band("y")
+		for i=0, 19 do
+			x[i] = i
+			y[i] = 100*i
+		end
+
+		local res = solver()
+		for i=0, 19 do
+			assert(res.s_z[i] == i and res.s_w[i] == 100*i)
+		end
+	end
+end)
+
 test_mixed_view = _(function()
 	model "plot#ba_sum" {
 		params {"plot#time", "tree#ba"},
@@ -163,6 +201,96 @@ end, function()
 	end
 end)
 
+-- plot#s sums tree#x over the space map, so the solver asks for the whole tree run in one
+-- vref. `f` gives the struct view of tree `inst`, `calls` records the instances it's asked for.
+local function tree_sum_model()
+	model "plot#sum" {
+		params "tree#x",
+		returns "plot#s" *as "double",
+		impl.LuaJIT("models", "sum_vec")
+	}
+end
+
+local Tree = ffi.typeof "struct { double x; }"
+
+local function tree_sum_solver(m2, trees, n, calls, f)
+	for i=0, n-1 do
+		trees[i].x = i+1
+	end
+
+	return m2.fhk.solver(
+		m2.fhk.view()
+			:add(m2.fhk.edge_view("=>$", "ident"))
+			:add(m2.fhk.group("plot", m2.fhk.edge_view("=>tree", "space"), m2.fhk.fixed_size(1)))
+			:add(m2.fhk.group("tree",
+				m2.fhk.struct_view(Tree, function(inst)
+					table.insert(calls, inst)
+					return f(inst)
+				end),
+				m2.fhk.fixed_size(n)
+			)),
+		"plot#s"
+	)
+end
+
+local function assert_calls(calls, expect)
+	assert(#calls == #expect)
+	for i,inst in ipairs(expect) do
+		assert(calls[i] == inst)
+	end
+end
+
+test_struct_userfunc_run = _(tree_sum_model, function()
+	local trees = ffi.new(ffi.typeof("$[?]", Tree), 4)
+	local calls = {}
+	local solver = tree_sum_solver(m2, trees, 4, calls, function(inst) return trees+inst end)
+
+	function m2.export.test()
+		assert(solver().plot_s[0] == 1+2+3+4)
+		-- the whole run is answered in the first request
+		assert_calls(calls, {0, 1, 2, 3})
+	end
+end)
+
+test_struct_userfunc_run_nil = _(tree_sum_model, function()
+	local trees = ffi.new(ffi.typeof("$[?]", Tree), 4)
+	local calls = {}
+	local refused = false
+	local solver = tree_sum_solver(m2, trees, 4, calls, function(inst)
+		if inst == 2 and not refused then
+			refused = true
+			return nil
+		end
+		return trees+inst
+	end)
+
+	function m2.export.test()
+		assert(solver().plot_s[0] == 1+2+3+4)
+		-- nil stops the run, the solver asks again from the first missing instance
+		assert_calls(calls, {0, 1, 2, 2, 3})
+	end
+end)
+
+test_struct_userfunc_one_at_a_time = _(tree_sum_model, function()
+	local trees = ffi.new(ffi.typeof("$[?]", Tree), 4)
+	local calls = {}
+	local last
+	local solver = tree_sum_solver(m2, trees, 4, calls, function(inst)
+		-- only answer the required (first) instance of each request
+		if last and inst == last+1 then
+			last = nil
+			return nil
+		end
+		last = inst
+		return trees+inst
+	end)
+
+	function m2.export.test()
+		assert(solver().plot_s[0] == 1+2+3+4)
+		assert_calls(calls, {0, 1, 1, 2, 2, 3, 3})
+	end
+end)
+
 test_empty_space = _(function()
 	model "g#model" {
 		params "g#x",
@@ -790,3 +918,103 @@ end, function()
 		assert(s6.g_x[0] == 4)
 	end
 end)
+
+test_profile = _(function()
+	model "s#model" {
+		params "s#x",
+		returns "s#y" *as "double",
+		impl.LuaJIT("models", "id"),
+		cost { k=2, c=1.25 }
+	}
+end, function()
+	local subgraph = trace.subgraph
+	trace.subgraph = profile.attach
+
+	local soa_ct = m2.soa.from_bands { x="double" }
+	local soa = m2.new_soa(soa_ct)
+
+	local solver = m2.fhk.solver(
+		m2.fhk.view()
+			:add(m2.fhk.edge_view("=>$", "ident"))
+			:add(m2.fhk.group("s", m2.fhk.soa_view(soa_ct, soa))),
+		"s#y"
+	)
+
+	function m2.export.test()
+		trace.subgraph = subgraph
+
+		soa:alloc(3)
+		local x = soa:newband("x")
+		x[0] = 1; x[1] = 2; x[2] = 3
+
+		profile.reset()
+		solver()
+
+		local p = profile.collect()
+		assert(#p == 1 and p[1].name == "s#model" and p[1].calls == 3 and p[1].insts == 3)
+
+		-- the only profiled model keeps its total k with the default unit
+		local def = fhk.def()
+		setfenv(load(profile.calibrate()), fhk.env(def.nodeset, def.impls))()
+		local m = def.nodeset.models["s#model"]
+		assert(math.abs(m.k - 2) < 1e-5 and m.c == 1.25)
+	end
+end)
+
+test_profile_nested = _(function()
+	model "s#outer" {
+		returns "s#y" *as "double",
+		impl.LuaJIT("models", "hook")
+	}
+
+	model "g#inner" {
+		params "g#ms",
+		returns "g#t" *as "double",
+		impl.LuaJIT("models", "spin")
+	}
+end, function()
+	local subgraph = trace.subgraph
+	trace.subgraph = profile.attach
+
+	local outer = m2.fhk.solver(
+		m2.fhk.view()
+			:add(m2.fhk.edge_view("=>$", "ident"))
+			:add(m2.fhk.group("s", m2.fhk.fixed_size(1))),
+		"s#y"
+	)
+
+	local ct = ffi.typeof "struct { double ms; }"
+	local inner = m2.fhk.solver(
+		m2.fhk.view()
+			:add(m2.fhk.edge_view("=>$", "ident"))
+			:add(m2.fhk.group("g", m2.fhk.struct_view(ct, ct(20)))),
+		"g#t"
+	)
+
+	local function ns(name)
+		for _,p in ipairs(profile.collect()) do
+			if p.name == name then return p.ns end
+		end
+		return 0
+	end
+
+	function m2.export.test()
+		trace.subgraph = subgraph
+		local models = require "models"
+
+		-- the inner model's time isn't charged to the outer model
+		models.f = function() return inner().g_t[0] end
+		profile.reset()
+		assert(outer().s_y[0] == 20)
+		assert(ns("g#inner") >= 20e6 and ns("s#outer") < 5e6)
+
+		-- an aborted solve doesn't leave its model running
+		models.f = function() error("model aborted") end
+		assert(fails(outer, "model aborted"))
+		models.spin(20)
+		models.f = function() return 1 end
+		profile.reset()
+		assert(outer().s_y[0] == 1)
+		assert(ns("s#outer") < 5e6)
+	end
+end)
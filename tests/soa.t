@@ -0,0 +1,188 @@
+-- vim: ft=lua
+local sim = require "sim"
+local soa = require "soa"
+local ffi = require "ffi"
+local C = ffi.C
+
+local function isset(bits, i)
+	return bit.band(bit.rshift(bits[math.floor(i/64)], i%64), 1) ~= 0
+end
+
+local function newvec(bands)
+	local sim = sim.create()
+	local env = { m2 = { sim = sim } }
+	soa.inject(env)
+	return env.m2.new_soa(env.m2.soa.from_bands(bands)), sim
+end
+
+test_vec_grow = function()
+	local v = newvec { a="float", b="double", c="float" }
+	v:alloc(64)
+	v:newband("c")
+	v:newband("b")
+	v:newband("a")
+	for i=0, 63 do
+		v.a[i] = i
+		v.b[i] = -i
+		v.c[i] = 2*i
+	end
+
+	-- `a` is on top of the frame: it's extended in place, the rest are copied and the widest
+	-- band goes on top.
+	local a = v.a
+	v:alloc(64)
+	assert(v.a == a)
+	for i=64, 127 do
+		v.a[i] = i
+		v.b[i] = -i
+		v.c[i] = 2*i
+	end
+
+	local b = v.b
+	v:alloc(1000)
+	assert(#v == 1128)
+	assert(v.b == b)
+
+	for i=0, 127 do
+		assert(v.a[i] == i and v.b[i] == -i and v.c[i] == 2*i)
+	end
+end
+
+test_vec_changed = function()
+	local v, sim = newvec { x="double" }
+	v:alloc(200)
+	v:newband("x")
+
+	-- untracked vectors report every row
+	local _, n = v:changed()
+	assert(n == 200)
+
+	v:track()
+	local fid = C.sim_frame_id(sim)
+	sim:savepoint()
+	sim:enter()
+
+	local _, n = v:changed(fid)
+	assert(n == 0)
+
+	v:set("x", 3, 1)
+	v:touch(62, 4)
+	v:touch(100, 90)
+	local bits, n = v:changed(fid)
+	assert(n == 1+4+90)
+	for i=0, 199 do
+		assert(isset(bits, i) == (i == 3 or (i >= 62 and i < 66) or (i >= 100 and i < 190)))
+	end
+
+	-- the log of the entered frame doesn't count for changes since the frame itself
+	local _, n = v:changed(C.sim_frame_id(sim))
+	assert(n == 0)
+
+	-- rows changed before tracking started are unknown
+	local _, n = v:changed(fid-1)
+	assert(n == 200)
+end
+
+test_vec_changed_newband = function()
+	local v, sim = newvec { x="double", y="double" }
+	v:alloc(100)
+	v:newband("x")
+	v:newband("y")
+	v:track()
+	local fid = C.sim_frame_id(sim)
+	sim:savepoint()
+	sim:enter()
+
+	-- a fresh band is written through its raw pointer, every row counts as changed
+	local x = v:newband("x")
+	for i=0, 99 do
+		x[i] = i
+	end
+	local _, n = v:changed(fid)
+	assert(n == 100)
+
+	-- same for bands that are assigned by the caller
+	fid = C.sim_frame_id(sim)
+	sim:savepoint()
+	sim:enter()
+	v.y = v:xnewband("y")
+	local _, n = v:changed(fid)
+	assert(n == 100)
+end
+
+local function lazyvec(n)
+	local v, sim = newvec { x="double" }
+	v:alloc(n)
+	v:newband("x")
+	for i=0, n-1 do
+		v.x[i] = i
+	end
+	v:lazydel()
+	return v, sim
+end
+
+local function checklive(v, deleted)
+	local j = 0
+	for i=0, #v-1 do
+		while deleted[j] do j = j+1 end
+		assert(v.x[i] == j)
+		j = j+1
+	end
+end
+
+test_vec_lazydel = function()
+	local v = lazyvec(100)
+
+	v:delete({10, 20, 20})
+	assert(#v == 100 and v:live() == 98)
+	assert(v:dead(10) and v:dead(20) and not v:dead(11))
+	assert(v.x[10] == 10)
+
+	-- a quarter of the rows dead triggers compaction
+	local deleted = { [10]=true, [20]=true }
+	local idx = {}
+	for i=30, 52 do
+		table.insert(idx, i)
+		deleted[i] = true
+	end
+	v:delete(idx)
+	assert(#v == 75 and v:live() == 75 and not v:dead(10))
+	checklive(v, deleted)
+end
+
+test_vec_compact = function()
+	local v = lazyvec(100)
+	v:delete({0, 5, 99})
+	v:compact()
+	assert(#v == 97 and v:live() == 97 and not v:dead(0))
+	checklive(v, { [0]=true, [5]=true, [99]=true })
+
+	-- chunked iteration only sees live rows
+	v:delete({1})
+	local sum = v:chunked(function(v, from, to, slot)
+		for i=from, to-1 do
+			slot[0] = slot[0] + v.x[i]
+		end
+	end, 1)
+	assert(#v == 96)
+	assert(sum == 99*100/2 - 0 - 5 - 99 - 2)
+end
+
+test_vec_lazydel_savepoint = function()
+	local v, sim = lazyvec(100)
+	v:delete({10, 20})
+
+	-- savepoints compact first, so the saved state has no tombstones
+	local fp = sim:fp()
+	sim:savepoint()
+	assert(#v == 98 and v:live() == 98)
+	checklive(v, { [10]=true, [20]=true })
+
+	-- a child's tombstones don't leak into the saved state
+	sim:enter()
+	v:delete({0})
+	assert(v:dead(0) and v:live() == 97)
+	sim:load(fp)
+	assert(#v == 98 and v:live() == 98 and not v:dead(0))
+	checklive(v, { [10]=true, [20]=true })
+end
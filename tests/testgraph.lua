@@ -255,7 +255,8 @@ local function build(def)
 	end
 
 	for _,m in pairs(def.models) do
-		local obj = D:add_model(objs.g[m.group], m.k, m.c, m.cmin or m.k)
+		local obj = D:add_model(objs.g[m.group], m.k, m.c, m.cmin or m.k,
+			m.batch and C.FHKM_BATCH or 0)
 		objs[m] = obj
 
 		for _,e in ipairs(m.params) do
@@ -424,6 +425,7 @@ local function decl_model(decl)
 	m.f = wrapmodf(tomodf(decl[2]))
 	m.k = decl.k or m.k
 	m.c = decl.c or m.c
+	m.batch = decl.batch
 
 	local params, returns = signature:gsub("^[^#]+#", ""):match("([%w#_%-:@,]*)%->([%w#_%-:@,]*)")
 	if not (params and returns) then
@@ -534,45 +536,27 @@ local function infershape(mapping, n, ...)
 	return shape
 end
 
-local function check_solution(G, ng, meta)
-	local bufs, indices = {}, {}
-	local arena = alloc.arena()
-	local S = C.fhk_create_solver(G, arena)
-
-	for name,values in pairs(meta.solution) do
-		local x = meta.def.vars[toname(name)]
-		indices[name] = defidx(values)
-		bufs[name] = ffi.new(ffi.typeof("$[?]", x.ctype), #indices[name])
-		S:setroot(meta.mapping[x], fhk.subset(indices[name], arena), bufs[name])
-	end
-
-	local shape = infershape(meta.mapping, ng, meta.solution, meta.given)
-	for g,n in pairs(shape) do
-		S:setshape(g, n)
-	end
-
-	if meta.given then
-		for name, values in pairs(meta.given) do
-			name = toname(name)
-			local xi = meta.mapping[meta.def.vars[name]]
+local function setgiven(S, meta, given)
+	for name, values in pairs(given) do
+		name = toname(name)
+		local xi = meta.mapping[meta.def.vars[name]]
 
-			if values.n then
-				S:setvaluei(xi, 0, values.n, values.buf)
-			else
-				local buf = ffi.new(ffi.typeof("$[1]", meta.def.vars[name].ctype))
-				for i,v in ipairs(values) do
-					if v ~= NA then
-						buf[0] = v
-						S:setvaluei(xi, i-1, 1, buf)
-					end
+		if values.n then
+			S:setvaluei(xi, 0, values.n, values.buf)
+		else
+			local buf = ffi.new(ffi.typeof("$[1]", meta.def.vars[name].ctype))
+			for i,v in ipairs(values) do
+				if v ~= NA then
+					buf[0] = v
+					S:setvaluei(xi, i-1, 1, buf)
 				end
 			end
 		end
 	end
+end
 
-	driver(S, meta.mapping)
-
-	for name,truth in pairs(meta.solution) do
+local function checkbufs(solution, indices, bufs)
+	for name,truth in pairs(solution) do
 		local solved = bufs[name]
 
 		for i,j in ipairs(indices[name]) do
@@ -584,6 +568,73 @@ local function check_solution(G, ng, meta)
 	end
 end
 
+local function check_solution(G, ng, meta)
+	local bufs, indices = {}, {}
+	local update = meta.update
+	local arena
+
+	-- reuse the solver between solutions of the same graph, this also tests fhk_reset_solver
+	if not meta.solver then
+		meta.solver_arena = alloc.arena()
+		meta.solver = C.fhk_create_solver(G, meta.solver_arena)
+	end
+
+	local S = meta.solver
+
+	if update then
+		-- keep the previous solution and only invalidate the updated given values,
+		-- this tests fhkS_invalidate
+		arena = meta.arena
+		meta.update = nil
+
+		for name,values in pairs(update) do
+			local xi = meta.mapping[meta.def.vars[toname(name)]]
+			S:invalidate(xi, fhk.subset(defidx(values), arena))
+		end
+
+		setgiven(S, meta, update)
+	else
+		arena = alloc.arena()
+		meta.arena = arena
+		S:reset(arena)
+
+		if meta.plan then
+			S:setplan(meta.plan)
+		end
+	end
+
+	-- shapes go first (like pushstate does), so that roots over a whole group can be used
+	-- as value buffers.
+	if not update then
+		local shape = infershape(meta.mapping, ng, meta.solution, meta.given)
+		for g,n in pairs(shape) do
+			S:setshape(g, n)
+		end
+	end
+
+	for name,values in pairs(meta.solution) do
+		local x = meta.def.vars[toname(name)]
+		indices[name] = defidx(values)
+		bufs[name] = ffi.new(ffi.typeof("$[?]", x.ctype), #indices[name])
+		S:setroot(meta.mapping[x], fhk.subset(indices[name], arena), bufs[name])
+	end
+
+	if not update and meta.given then
+		setgiven(S, meta, meta.given)
+	end
+
+	driver(S, meta.mapping)
+	checkbufs(meta.solution, indices, bufs)
+
+	-- the solver may have used the previous root buffers as value buffers. fhkS_invalidate
+	-- copies the values out of them, so they must still hold the previous solution.
+	if update then
+		checkbufs(meta.prev.solution, meta.prev.indices, meta.prev.bufs)
+	end
+
+	meta.prev = { solution=meta.solution, indices=indices, bufs=bufs }
+end
+
 local function check_prune(G, meta)
 	local P = C.fhk_create_prune(G)
 	local flags = P:flags()
@@ -653,10 +704,18 @@ local function inject(env)
 		}
 	end
 
+	env.plan = function()
+		env.meta.plan = ffi.gc(C.fhk_create_plan(env.G), C.fhk_destroy_plan)
+	end
+
 	env.given = function(decl)
 		env.meta.given = decl
 	end
 
+	env.update = function(decl)
+		env.meta.update = decl
+	end
+
 	env.retain = function(decl)
 		env.meta.retain = decl
 	end
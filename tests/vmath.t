@@ -0,0 +1,341 @@
+-- vim: ft=lua
+local ffi = require "ffi"
+local vmath = require "vmath"
+local vd = vmath.vmath_f.double
+local C = ffi.C
+
+local N = 10000
+
+-- distance in ulps between x and the libm reference r
+local function ulps(x, r)
+	if x == r then return 0 end
+	local u = ffi.new("union { double d; int64_t i; }[2]")
+	u[0].d, u[1].d = x, r
+	return math.abs(tonumber(u[0].i - u[1].i))
+end
+
+-- max error of vmath function `f` against `ref` over arguments generated by `gen`
+local function maxulp(f, ref, gen)
+	local x = ffi.new("double[?]", N)
+	local y = ffi.new("double[?]", N)
+	local d = ffi.new("double[?]", N)
+
+	for i=0, N-1 do
+		x[i], y[i] = gen()
+	end
+
+	f(d, x, y)
+
+	local m = 0
+	for i=0, N-1 do
+		m = math.max(m, ulps(d[i], ref(x[i], y[i])))
+	end
+
+	return m
+end
+
+local function uniform(a, b)
+	return a + (b-a)*math.random()
+end
+
+-- distance in ulps between single precision x and the reference r rounded to single precision
+local function fulps(x, r)
+	local u = ffi.new("union { float f; int32_t i; }[2]")
+	u[0].f, u[1].f = x, r
+	return math.abs(u[0].i - u[1].i)
+end
+
+local function relerr(x, r)
+	return math.abs(x - r) / math.abs(r)
+end
+
+local function floats(n, gen)
+	local x = ffi.new("float[?]", n)
+	for i=0, n-1 do
+		x[i] = gen(i)
+	end
+	return x
+end
+
+test_exp_ulp = function()
+	math.randomseed(1)
+	assert(maxulp(
+		function(d, x) vd.exp(x, N, d) end,
+		math.exp,
+		function() return uniform(-708, 709) end
+	) <= 1)
+end
+
+test_log_ulp = function()
+	math.randomseed(2)
+	assert(maxulp(
+		function(d, x) vd.log(x, N, d) end,
+		math.log,
+		function() return math.exp(uniform(-700, 700)) end
+	) <= 1)
+end
+
+test_pow_ulp = function()
+	math.randomseed(3)
+	assert(maxulp(
+		function(d, x, y) C.vdpow(d, x, y, N) end,
+		math.pow,
+		function() return uniform(0.01, 1000), uniform(-4, 4) end
+	) <= 2)
+end
+
+test_spow = function()
+	local x = ffi.new("double[3]", {1, 2, 10})
+	local d = ffi.new("double[3]")
+	vd.spow(x, 3, 2, 3, d)
+	assert(d[0] == 3 and d[1] == 12 and math.abs(d[2] - 300) < 1e-12)
+end
+
+test_sexp = function()
+	local x = ffi.new("double[2]", {0, 1})
+	vd.sexp(x, 2, -1, 2)
+	assert(x[0] == 2 and ulps(x[1], 2*math.exp(-1)) <= 1)
+end
+
+test_sqrt_exact = function()
+	math.randomseed(4)
+	assert(maxulp(
+		function(d, x) vd.sqrt(x, N, d) end,
+		math.sqrt,
+		function() return uniform(0, 1e6) end
+	) == 0)
+end
+
+test_float_elementwise = function()
+	math.randomseed(4)
+	local vf = vmath.vmath_f.float
+	-- on [1, 2] differences of inputs are exact, so each kernel rounds at most once more than
+	-- the reference (computed in double and rounded once), or not at all with fma.
+	local gen = function() return uniform(1, 2) end
+	local x, y = floats(N, gen), floats(N, gen)
+	local d = ffi.new("float[?]", N)
+
+	local function check(ref, maxu)
+		for i=0, N-1 do
+			assert(fulps(d[i], ref(x[i], y[i])) <= (maxu or 1))
+		end
+	end
+
+	vf.saddc(x, 0.5, 3, N, d)
+	check(function(x) return 0.5*x + 3 end)
+	vf.add(x, y, N, d)
+	check(function(x, y) return x + y end)
+	vf.sub(x, 2.5, N, d)
+	check(function(x) return x - 2.5 end)
+	vf.adds(x, -0.25, y, N, d)
+	check(function(x, y) return x - 0.25*y end)
+	vf.mul(x, y, N, d)
+	check(function(x, y) return x * y end)
+	vf.refl(x, 0.5, y, N, d)
+	check(function(x, y) return y + 0.5*(y - x) end)
+	vf.area(x, N, d)
+	check(function(x) return ffi.new("float", math.pi/4) * x * x end, 2)
+end
+
+test_float_reductions = function()
+	math.randomseed(5)
+	local n = 100000
+	local x = floats(n, function() return uniform(0, 1) end)
+	local w = floats(n, function() return uniform(0, 2) end)
+	local wd = ffi.new("double[?]", n)
+	local k = ffi.new("uint8_t[?]", n)
+	local sum, summ, dot, sw = 0, 0, 0, 0
+	for i=0, n-1 do
+		wd[i] = w[i]
+		k[i] = i%5
+		sum = sum + x[i]
+		summ = summ + ((i%5 == 1 or i%5 == 3) and x[i] or 0)
+		dot = dot + x[i]*w[i]
+		sw = sw + w[i]
+	end
+
+	-- f32 accumulators lose about log2(n) bits, f64 accumulators are accurate to the
+	-- double rounding error of the sum.
+	local vf, vm = vmath.vmath_f.float, vmath.vmath_f.mixed
+	assert(relerr(vf.sum(x, n), sum) < 1e-3)
+	assert(relerr(vf.summ8(x, k, 0xa, n), summ) < 1e-3)
+	assert(relerr(vf.dot(x, w, n), dot) < 1e-3)
+	assert(relerr(vf.avgw(x, w, n), dot/sw) < 1e-3)
+	assert(relerr(vm.sum(x, n), sum) < 1e-12)
+	assert(relerr(vm.summ8(x, k, 0xa, n), summ) < 1e-12)
+	assert(relerr(vm.dot(x, w, n), dot) < 1e-12)
+	assert(relerr(vm.dot(x, wd, n), dot) < 1e-12)
+	assert(relerr(vm.avgw(x, w, n), dot/sw) < 1e-12)
+	assert(relerr(vm.avgw(x, wd, n), dot/sw) < 1e-12)
+
+	-- procedural sums of float vectors use the mixed kernels
+	assert(vmath.vmath_f.sum(x, n) == vm.sum(x, n))
+end
+
+test_fuse_store = function()
+	local x = ffi.new("double[3]", {1, 2, 3})
+	local y = ffi.new("double[3]", {4, 5, 6})
+	local d = ffi.new("double[3]")
+
+	local f = vmath.fuse(2):mul(vmath.arg(2)):add(vmath.sarg(3)):store(4)
+	f(x, y, 1, d, 3)
+
+	assert(d[0] == 5 and d[1] == 11 and d[2] == 19)
+	assert(x[0] == 1)
+end
+
+test_fuse_reduce = function()
+	local x = ffi.new("double[4]", {1, 2, 3, 4})
+	local w = ffi.new("double[4]", {1, 0, 1, 0})
+
+	assert(vmath.fuse(1):mul(2):sum()(x, 4) == 20)
+	assert(vmath.fuse(2):dot(vmath.arg(2))(x, w, 4) == 4)
+	assert(vmath.fuse(1):reduce(math.max, -math.huge)(x, 4) == 4)
+end
+
+test_masked = function()
+	local x = ffi.new("double[4]", {1, 2, 3, 4})
+	local k = ffi.new("uint8_t[4]", {0, 1, 2, 1})
+	local v = vd.vec(x, 4)
+
+	local m = v:mask(k, 0x2)
+	m:mul(10)
+	assert(x[0] == 1 and x[1] == 20 and x[2] == 3 and x[3] == 40)
+	assert(m:sum() == 60)
+
+	local bm = ffi.new("uint64_t[1]", 0x5)
+	local b = v:maskb(bm)
+	b:add(1)
+	assert(x[0] == 2 and x[1] == 20 and x[2] == 4 and x[3] == 40)
+	assert(b:sum() == 6)
+end
+
+test_quantw = function()
+	local x = ffi.new("double[5]", {5, 1, 4, 2, 3})
+	local w = ffi.new("double[5]", {1, 1, 0, 1, 1})
+
+	assert(vd.quantw(x, w, 0.5, 5) == 2)
+	assert(vd.quantw(x, w, 0.75, 5) == 3)
+	assert(vd.quantw(x, w, 1, 5) == 5)
+	assert(x[0] == 5 and x[1] == 1)
+end
+
+test_cdfw_histw = function()
+	local x = ffi.new("double[4]", {0.5, 1.5, 1.7, 9})
+	local w = ffi.new("double[4]", {1, 2, 1, 4})
+	local t = ffi.new("double[2]", {1, 2})
+	local d = ffi.new("double[2]")
+	local h = ffi.new("double[3]")
+
+	vd.cdfw(x, w, t, 2, 4, d)
+	assert(d[0] == 1/8 and d[1] == 4/8)
+
+	vd.histw(x, w, 0, 1, 3, 4, h)
+	assert(h[0] == 1 and h[1] == 3 and h[2] == 4)
+
+	x[1] = 0/0
+	vd.histw(x, w, 0, 1, 3, 4, h)
+	assert(h[0] == 1 and h[1] == 1 and h[2] == 4)
+	vd.histw(x, w, 0, 1, 0, 4, h)
+end
+
+-- classes at or above nclass are ignored
+local function grouped(nclass, kmax, n)
+	local x = ffi.new("double[?]", n)
+	local k = ffi.new("uint8_t[?]", n)
+	local sum, cnt = {}, {}
+	for c=0, nclass-1 do
+		sum[c], cnt[c] = 0, 0
+	end
+	for i=0, n-1 do
+		-- small integers so that the sums are exact in any order
+		x[i] = i%17 - 8
+		k[i] = (i*7) % (kmax+1)
+		if k[i] < nclass then
+			sum[k[i]] = sum[k[i]] + x[i]
+			cnt[k[i]] = cnt[k[i]] + 1
+		end
+	end
+
+	local out = ffi.new("double[?]", nclass)
+	vd.sumg8(out, nclass, x, k, n)
+	for c=0, nclass-1 do
+		assert(out[c] == sum[c])
+	end
+
+	vd.cntg8(out, nclass, k, n)
+	for c=0, nclass-1 do
+		assert(out[c] == cnt[c])
+	end
+end
+
+test_sumg8_cntg8 = function()
+	grouped(1, 0, 1000)
+	grouped(3, 3, 1000)
+	grouped(4, 9, 1003)
+	grouped(5, 5, 1000)
+	grouped(10, 40, 1001)
+	grouped(256, 255, 5000)
+	grouped(200, 255, 5000)
+	grouped(7, 7, 0)
+end
+
+test_redmode = function()
+	local x = ffi.new("double[?]", 1001)
+	for i=0, 1000 do
+		x[i] = (i%2 == 0 and 1 or -1) * 2^(i%40 - 20)
+	end
+
+	local repro = vd.sumr(x, 1001, "repro")
+	local isa = C.vmath_isa()
+	for i=0, isa do
+		C.vmath_set_isa(i)
+		assert(vd.sumr(x, 1001, "repro") == repro)
+	end
+	C.vmath_set_isa(isa)
+
+	local old = vmath.redmode("repro")
+	assert(vd.sum(x, 1001) == repro)
+	vmath.redmode(old)
+end
+
+test_parallel_deterministic = function()
+	local n = 100000
+	local x = ffi.new("double[?]", n)
+	local d = ffi.new("double[?]", n)
+	for i=0, n-1 do
+		x[i] = math.sin(i) * 2^(i%30)
+	end
+
+	local w = ffi.new("double[?]", n)
+	local xf = ffi.new("float[?]", n)
+	for i=0, n-1 do
+		w[i] = 1 + math.cos(i)/3
+		xf[i] = math.sin(i)
+	end
+
+	local threads = C.vmath_set_threads(1)
+	local pmin = C.vmath_set_par_min(0)
+	local s1 = vd.sum(x, n)
+	local a1 = vd.avgw(x, w, n)
+	vd.mul(x, 2, n, d)
+
+	for t=2, 4 do
+		C.vmath_set_threads(t)
+		assert(vd.sum(x, n) == s1)
+		assert(vd.avgw(x, w, n) == a1)
+		local d2 = ffi.new("double[?]", n)
+		vd.mul(x, 2, n, d2)
+		assert(C.memcmp(d, d2, n*ffi.sizeof("double")) == 0)
+	end
+
+	-- the mixed average sums the same way on either side of the chunk size
+	local vm = vmath.vmath_f.mixed
+	local af = vm.avgw(xf, w, n)
+	local old = vmath.redmode("kahan")
+	assert(vm.avgw(xf, w, n) == af)
+	vmath.redmode(old)
+
+	C.vmath_set_threads(threads)
+	C.vmath_set_par_min(pmin)
+end